@@ -11,6 +11,12 @@
 #include<page.h>
 #include<mmap.h>
 #include<msg_queue.h>
+#include<memops.h>
+#include<fmap.h>
+#include<fdtable.h>
+#include<slab.h>
+#include<sysstat.h>
+#include<shm_channel.h>
 
 long do_fork()
 {
@@ -23,9 +29,7 @@ long do_fork()
 	new_ctx->ppid = ctx->pid; 
 	copy_mm(new_ctx, ctx);
 	setup_child_context(new_ctx);
-	
-	// call the message queue handler
-	do_add_child_to_msg_queue(new_ctx);
+	fd_table_fork(ctx, new_ctx);	// and the message queue handler
 	return pid;
 }
 
@@ -44,6 +48,9 @@ void do_exit()
 #endif
 	do_msg_queue_cleanup(ctx);
 	do_file_exit(ctx);   // Cleanup the files
+	fd_table_exit(ctx);
+	file_map_exit(ctx);  // and the file mappings
+	shm_channel_exit(ctx);
 
 	// cleanup of this process
 	os_pfn_free(OS_PT_REG, ctx->os_stack_pfn);
@@ -91,12 +98,39 @@ int do_file_open(struct exec_context *ctx,u64 filename, u64 flag, u64 mode)
 	return do_regular_file_open(ctx, (char *)filename, flag, mode);
 }
 
+/*
+ * A PIPE_WAIT pipe returns -EAGAIN when nothing can be read (written)
+ * yet; the caller parks on the pipe and runs the call again once woken.
+ */
+static inline int file_parks(struct file *filep, int ret)
+{
+	return ret == -EAGAIN && filep->type == PIPE && (filep->pipe->flags & PIPE_WAIT);
+}
+
+static int file_wait(struct exec_context *ctx, struct file *filep, int ret)
+{
+	if(file_parks(filep, ret))
+		wait_park(ctx, PIPE_CHANNEL(filep->pipe, filep->mode & O_WRITE), 0);
+	return ret;
+}
+
+/* Count a read (write) of filep that is over, a call that parks is counted when it runs again */
+static int file_done(struct exec_context *ctx, struct file *filep, int write, int ret)
+{
+	if(file_parks(filep, ret))
+		return file_wait(ctx, filep, ret);
+	file_account(filep, write, ret);
+	return ret;
+}
+
 /*system call handler to read file */
 int do_file_read(struct exec_context *ctx, u64 fd, u64 buff, u64 count){
 	int read_size = 0;
-	struct file *filep = ctx->files[fd];
+	struct file *filep = fd_get(ctx, fd);
 	dprintk("fd in read:%d\n",fd);
 
+	wait_unpark(ctx, NULL);
+
 
 	if(!filep){
 		return -EINVAL; //file is not opened
@@ -110,7 +144,7 @@ int do_file_read(struct exec_context *ctx, u64 fd, u64 buff, u64 count){
 		read_size = filep->fops->read(filep, (char*)buff, count);
 		dprintk("buff inside read:%s\n",buff);
 		dprintk("read size:%d\n",read_size);
-		return read_size;
+		return file_done(ctx, filep, 0, read_size);
 	}
 	return -EINVAL;
 }
@@ -118,7 +152,9 @@ int do_file_read(struct exec_context *ctx, u64 fd, u64 buff, u64 count){
 /*system call handler to write file */
 int do_file_write(struct exec_context *ctx,u64 fd,u64 buff,u64 count){
 	int write_size;
-	struct file *filep = ctx->files[fd];
+	struct file *filep = fd_get(ctx, fd);
+
+	wait_unpark(ctx, NULL);
 	if(!filep){
 		return -EINVAL; //file is not opened
 	}
@@ -128,16 +164,118 @@ int do_file_write(struct exec_context *ctx,u64 fd,u64 buff,u64 count){
 	if(filep->fops->write){
 		write_size = filep->fops->write(filep, (char*)buff, count);
 		dprintk("write size:%d\n",write_size);
-		return write_size;
+		return file_done(ctx, filep, 1, write_size);
 	}
 	return -EINVAL;
 }
 
+/*
+ * Vectored and positioned I/O. One call moves the iovecs in order through
+ * the file's read/write (or pread/pwrite if IOV_AT) and stops at the first
+ * short transfer. Returns the bytes moved, or the error if none were.
+ */
+#define IOV_WRITE 0x1	// writev/pwritev/pwrite, else a read
+#define IOV_AT    0x2	// at offset; the file offset is not used or moved
+
+long do_file_iov(struct exec_context *ctx, u64 fd, struct iovec *iov, int iovcnt, long offset, int flags)
+{
+	struct file *filep;
+	long done = 0;
+	int ret, i;
+
+	wait_unpark(ctx, NULL);
+	if(!iov || iovcnt < 0 || iovcnt > IOV_MAX || offset < 0)
+		return -EINVAL;
+	filep = fd_get(ctx, fd);
+	if(!filep)
+		return -EINVAL; //file is not opened
+	if(!(filep->mode & ((flags & IOV_WRITE) ? O_WRITE : O_READ)))
+		return -EACCES;
+	if((flags & IOV_AT) && !((flags & IOV_WRITE) ? filep->fops->pwrite : filep->fops->pread))
+		return -EINVAL; //not seekable
+	if(!(flags & IOV_AT) && !((flags & IOV_WRITE) ? filep->fops->write : filep->fops->read))
+		return -EINVAL;
+
+	for(i = 0; i < iovcnt; i++){
+		char *buff = (char *)iov[i].iov_base;
+		u32 count = iov[i].iov_len;
+
+		if(flags & IOV_AT)
+			ret = (flags & IOV_WRITE) ? filep->fops->pwrite(filep, buff, count, offset + done)
+						  : filep->fops->pread(filep, buff, count, offset + done);
+		else
+			ret = (flags & IOV_WRITE) ? filep->fops->write(filep, buff, count)
+						  : filep->fops->read(filep, buff, count);
+		if(ret < 0){
+			if(!done)
+				return file_done(ctx, filep, flags & IOV_WRITE, ret);
+			file_account(filep, flags & IOV_WRITE, done);
+			return done;
+		}
+		done += ret;
+		if(ret < count)
+			break;
+	}
+	file_account(filep, flags & IOV_WRITE, done);
+	return done;
+}
+
+/* pread/pwrite are the one element case */
+long do_file_pio(struct exec_context *ctx, u64 fd, u64 buff, u64 count, long offset, int flags)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *)buff;
+	iov.iov_len = count;
+	return do_file_iov(ctx, fd, &iov, 1, offset, flags | IOV_AT);
+}
+
 /*system call handler to create pipe */
-int do_create_pipe(struct exec_context *ctx, int* fd)
+int do_create_pipe(struct exec_context *ctx, int* fd, u32 size, u32 flags)
 {
-	int val =  create_pipe(ctx, fd);
-	return val;
+	return create_pipe(ctx, fd, size, flags);
+}
+
+/*
+ * splice moves data between a pipe and a pipe or a file inside the kernel,
+ * tee copies it from one pipe to another and leaves it in the first.
+ */
+int do_splice(struct exec_context *ctx, int infd, int outfd, u32 count, int tee)
+{
+	struct file *in = fd_get(ctx, infd);
+	struct file *out = fd_get(ctx, outfd);
+	int ret;
+
+	wait_unpark(ctx, NULL);
+	if(!in || !out)
+		return -EINVAL; //file is not opened
+	if(!(in->mode & O_READ) || !(out->mode & O_WRITE))
+		return -EACCES;
+	if(tee ? in->type != PIPE || out->type != PIPE : in->type != PIPE && out->type != PIPE)
+		return -EINVAL;
+	if(in->type == PIPE && out->type == PIPE && in->pipe == out->pipe)
+		return -EINVAL;
+	if((in->type != PIPE && !in->fops->read) || (out->type != PIPE && !out->fops->write))
+		return -EINVAL;
+
+	ret = tee ? pipe_tee(in, out, count) : pipe_splice(in, out, count);
+	if(in->type == PIPE && !pipe_count(in->pipe))
+		return file_wait(ctx, in, ret);
+	return file_wait(ctx, out, ret);
+}
+
+int do_dup(struct exec_context *ctx, int oldfd)
+{
+	struct file *filep = fd_get(ctx, oldfd);
+	int fd;
+
+	if(!filep)
+		return -EINVAL;
+	fd = fd_alloc(ctx, 0);
+	if(fd < 0)
+		return fd;
+	filep->ref_count++;
+	return fd_install(ctx, fd, filep);
 }
 
 int do_dup2(struct exec_context *ctx, int oldfd, int newfd)
@@ -149,17 +287,18 @@ int do_dup2(struct exec_context *ctx, int oldfd, int newfd)
 int do_close(struct exec_context *ctx, int fd)
 {
 	int ret;
-	struct file *filep = ctx->files[fd];
+	struct file *filep = fd_get(ctx, fd);
 	if(!filep || !filep->fops || !filep->fops->close){
 		return -EINVAL; //file is not opened
 	}
-	ctx->files[fd] = NULL;
+	fd_clear(ctx, fd);
 	ret = filep->fops->close(filep);
+	return ret < 0 ? ret : 0;
 }
 
 long do_lseek(struct exec_context *ctx, int fd, long offset, int whence)
 {
-	struct file *filep = ctx->files[fd];
+	struct file *filep = fd_get(ctx, fd);
 	if(filep && filep->fops->lseek)
 	{
 		return filep->fops->lseek(filep, offset, whence);
@@ -168,34 +307,279 @@ long do_lseek(struct exec_context *ctx, int fd, long offset, int whence)
 }
 
 int do_get_member_info(struct exec_context *ctx, u64 fd, u64 info){
-	struct file *filep = ctx->files[fd];
+	struct file *filep = fd_get(ctx, fd);
 	if(!filep){
 		return -EINVAL; //file is not opened
 	}
 	return do_msg_queue_get_member_info(ctx, filep, (struct msg_queue_member_info *)info);
 }
 
-int call_msg_queue_send(struct exec_context *ctx, u64 fd, u64 msg)
+/*
+ * Wait channels. A process that has to wait is parked on a channel (the
+ * address of whatever it waits for) in WAITING with its int $0x80 rewound,
+ * so the whole system call runs again once wait_wake() is called on the
+ * channel, or once ticks_to_sleep runs out, which the timer tick takes care
+ * of. Nothing must have been done by the call before it parks.
+ */
+#define INT80_LEN 2	// bytes of the int $0x80 to rewind
+
+struct waiter{
+	void *chan;			// NULL if not parked
+	u32 woken;			// by wait_wake(), else the timeout ran out
+	u32 ticks_left;			// of the timeout when woken
+};
+
+static struct waiter waiters[MAX_PROCESSES];
+
+/* poll waits for any file, it is woken along with the waiters of every channel */
+#define POLL_CHANNEL ((void *)waiters)
+
+void wait_park(struct exec_context *ctx, void *chan, u32 timeout)
+{
+	struct waiter *waiter = &waiters[ctx->pid];
+
+	waiter->chan = chan;
+	waiter->woken = 0;
+	ctx->ticks_to_sleep = timeout;	// 0 waits for good
+	ctx->state = WAITING;
+	ctx->regs.entry_rip -= INT80_LEN;
+	schedule(pick_next_context(ctx));
+}
+
+/* Entry of a call that may park, returns 0 if it timed out and must not park again */
+int wait_unpark(struct exec_context *ctx, u32 *timeout)
+{
+	struct waiter *waiter = &waiters[ctx->pid];
+
+	if(!waiter->chan)
+		return 1;
+	waiter->chan = NULL;
+	if(!waiter->woken)
+		return 0;
+	if(timeout)
+		*timeout = waiter->ticks_left;
+	return 1;
+}
+
+/* Make the waiters on chan runnable (pid or WAKE_ALL), returns one of them */
+struct exec_context *wait_wake(void *chan, u32 pid)
+{
+	struct exec_context *ctx, *woken = NULL;
+	u32 i;
+
+	for(i = 1; i < MAX_PROCESSES; i++){
+		if((waiters[i].chan != chan && waiters[i].chan != POLL_CHANNEL) || waiters[i].woken)
+			continue;
+		if(pid != WAKE_ALL && pid != i)
+			continue;
+		ctx = get_ctx_by_pid(i);
+		if(ctx->state != WAITING)
+			continue;
+		waiters[i].woken = 1;
+		waiters[i].ticks_left = ctx->ticks_to_sleep;
+		ctx->ticks_to_sleep = 0;
+		ctx->state = READY;
+		woken = ctx;
+	}
+	return woken;
+}
+
+/*
+ * poll over the descriptors in fds. Pipes are ready when there is data
+ * (room) or the other end is gone, message queues when a message is
+ * pending (a slot is free); regular files and the console always are.
+ * timeout is in ticks, 0 does not wait and a negative one waits for good.
+ */
+static int file_poll(struct exec_context *ctx, struct file *filep)
+{
+	struct pipe_info *pipe = filep->pipe;
+	int events = 0;
+
+	if(filep->msg_queue){
+		events = do_msg_queue_poll(ctx, filep);
+		return events < 0 ? POLLERR : events;
+	}
+	if(filep->type == PIPE){
+		if(filep->mode & O_READ)
+			events = pipe_count(pipe) ? POLLIN : 0;
+		else
+			events = pipe_space(pipe) ? POLLOUT : 0;
+		if(!((filep->mode & O_READ) ? pipe->is_wopen : pipe->is_ropen))
+			events |= POLLHUP;
+		return events;
+	}
+	if(filep->mode & O_READ)
+		events |= POLLIN;
+	if(filep->mode & O_WRITE)
+		events |= POLLOUT;
+	return events;
+}
+
+int do_poll(struct exec_context *ctx, struct pollfd *fds, u32 nfds, int timeout)
+{
+	u32 ticks = timeout > 0 ? timeout : 0;
+	int park = wait_unpark(ctx, &ticks);
+	struct file *filep;
+	int ready = 0;
+	u32 i;
+
+	if((!fds && nfds) || nfds > FD_TABLE_MAX)
+		return -EINVAL;
+	for(i = 0; i < nfds; i++){
+		filep = fds[i].fd >= 0 ? fd_get(ctx, fds[i].fd) : NULL;
+		if(filep)
+			fds[i].revents = file_poll(ctx, filep) & (fds[i].events | POLLERR | POLLHUP);
+		else
+			fds[i].revents = fds[i].fd >= 0 ? POLLNVAL : 0;	// negative fds are skipped
+		if(fds[i].revents)
+			ready++;
+	}
+	if(!ready && timeout && park && (timeout < 0 || ticks))
+		wait_park(ctx, POLL_CHANNEL, ticks);
+	return ready;
+}
+
+/*
+ * Shared memory channels only enter the kernel when one side has to park
+ * on an empty (full) ring, and to wake it again.
+ */
+int call_shm_channel_wait(struct exec_context *ctx, u64 fd, u32 what, u32 timeout)
+{
+	struct file *filep = fd_get(ctx, fd);
+	int park = wait_unpark(ctx, &timeout);
+	int ret;
+
+	ret = do_shm_channel_wait(filep, what);
+	if(ret == -EAGAIN && park)
+		wait_park(ctx, SHM_CHANNEL_WAITQ(filep->shm, what == SHM_WAIT_SPACE), timeout);
+	return ret;
+}
+
+/*
+ * Blocking message queue calls wait for a send (receivers) or a receive
+ * (senders) on the same queue.
+ */
+#define MSG_QUEUE_CHANNEL(queue, sending) ((char *)(queue) + (sending))	// senders wait a byte up
+
+int call_msg_queue_send(struct exec_context *ctx, u64 fd, u64 msg, int wait, u32 timeout)
+{
+	struct file *filep = fd_get(ctx, fd);
+	struct exec_context *receiver;
+	int park = wait && wait_unpark(ctx, &timeout);
+	u32 to_pid;
+	int ret;
+
+	if(!filep || !msg){
+		return -EINVAL; //file is not opened
+	}
+	to_pid = ((struct message *)msg)->to_pid;
+	if(IS_TOPIC_PID(to_pid))
+		to_pid = BROADCAST_PID;	// wake them all, the ones not subscribed park again
+	ret = do_msg_queue_send(ctx, filep, (struct message *)msg);
+	if(ret == -EOTHERS && park){	// queue full, counted once the call runs again
+		wait_park(ctx, MSG_QUEUE_CHANNEL(filep->msg_queue, 1), timeout);
+		return -EAGAIN;
+	}
+	file_account(filep, 1, ret > 0 ? sizeof(struct message) : ret);
+	if(ret == -EOTHERS && wait)
+		return -EAGAIN;
+	if(ret > 0){
+		receiver = wait_wake(MSG_QUEUE_CHANNEL(filep->msg_queue, 0), to_pid);
+		if(receiver && to_pid != BROADCAST_PID){	// run the receiver right away
+			ctx->regs.rax = ret;
+			ctx->state = READY;
+			schedule(receiver);
+		}
+	}
+	return ret;
+}
+
+int call_msg_queue_rcv(struct exec_context *ctx, u64 fd, u64 msg, int wait, u32 timeout)
+{
+	struct file *filep = fd_get(ctx, fd);
+	int park = wait && wait_unpark(ctx, &timeout);
+	int ret;
+
+	if(!filep){
+		return -EINVAL; //file is not opened
+	}
+	ret = do_msg_queue_rcv(ctx, filep, (struct message *)msg);
+	if(ret == 0 && park){	// counted once the call runs again
+		wait_park(ctx, MSG_QUEUE_CHANNEL(filep->msg_queue, 0), timeout);
+		return ret;
+	}
+	file_account(filep, 0, ret > 0 ? sizeof(struct message) : ret);
+	if(ret > 0)	// a slot is free again
+		wait_wake(MSG_QUEUE_CHANNEL(filep->msg_queue, 1), BROADCAST_PID);
+	return ret;
+}
+
+/* Batches do not block, they return how many messages made it */
+int call_msg_queue_send_batch(struct exec_context *ctx, u64 fd, u64 msgs, u64 count)
 {
-	struct file *filep = ctx->files[fd];
+	struct file *filep = fd_get(ctx, fd);
+	int ret;
+
+	if(!filep){
+		return -EINVAL; //file is not opened
+	}
+	ret = do_msg_queue_send_batch(ctx, filep, (struct message *)msgs, count);
+	file_account(filep, 1, ret > 0 ? ret * sizeof(struct message) : ret);
+	if(ret > 0)
+		wait_wake(MSG_QUEUE_CHANNEL(filep->msg_queue, 0), BROADCAST_PID);
+	return ret;
+}
+
+int call_msg_queue_rcv_batch(struct exec_context *ctx, u64 fd, u64 msgs, u64 count)
+{
+	struct file *filep = fd_get(ctx, fd);
+	int ret;
+
 	if(!filep){
 		return -EINVAL; //file is not opened
 	}
-	return do_msg_queue_send(ctx, filep, (struct message *)msg);
+	ret = do_msg_queue_rcv_batch(ctx, filep, (struct message *)msgs, count);
+	file_account(filep, 0, ret > 0 ? ret * sizeof(struct message) : ret);
+	if(ret > 0)
+		wait_wake(MSG_QUEUE_CHANNEL(filep->msg_queue, 1), BROADCAST_PID);
+	return ret;
+}
+
+int call_msg_queue_send_buf(struct exec_context *ctx, u64 fd, u64 buf)
+{
+	struct file *filep = fd_get(ctx, fd);
+	u32 to_pid;
+	int ret;
+
+	if(!filep || !buf){
+		return -EINVAL; //file is not opened
+	}
+	to_pid = ((struct msg_buf *)buf)->to_pid;
+	ret = do_msg_queue_send_buf(ctx, filep, (struct msg_buf *)buf);
+	file_account(filep, 1, ret >= 0 ? ((struct msg_buf *)buf)->len : ret);
+	if(ret >= 0)
+		wait_wake(MSG_QUEUE_CHANNEL(filep->msg_queue, 0), IS_TOPIC_PID(to_pid) ? BROADCAST_PID : to_pid);
+	return ret;
 }
 
-int call_msg_queue_rcv(struct exec_context *ctx, u64 fd, u64 msg)
+int call_msg_queue_rcv_buf(struct exec_context *ctx, u64 fd, u64 buf)
 {
-	struct file *filep = ctx->files[fd];
+	struct file *filep = fd_get(ctx, fd);
+	int ret;
+
 	if(!filep){
 		return -EINVAL; //file is not opened
 	}
-	return do_msg_queue_rcv(ctx, filep, (struct message *)msg);
+	ret = do_msg_queue_rcv_buf(ctx, filep, (struct msg_buf *)buf);
+	file_account(filep, 0, ret > 0 ? ((struct msg_buf *)buf)->len : ret);
+	if(ret > 0)
+		wait_wake(MSG_QUEUE_CHANNEL(filep->msg_queue, 1), BROADCAST_PID);
+	return ret;
 }
 
 int call_get_msg_count(struct exec_context *ctx, u64 fd)
 {
-	struct file *filep = ctx->files[fd];
+	struct file *filep = fd_get(ctx, fd);
 	if(!filep){
 		return -EINVAL; //file is not opened
 	}
@@ -204,7 +588,7 @@ int call_get_msg_count(struct exec_context *ctx, u64 fd)
 
 int call_msg_queue_block(struct exec_context *ctx, u64 fd, u64 pid)
 {
-	struct file *filep = ctx->files[fd];
+	struct file *filep = fd_get(ctx, fd);
 	int block_pid = pid;
 	if(!filep){
 		return -EINVAL; //file is not opened
@@ -212,6 +596,15 @@ int call_msg_queue_block(struct exec_context *ctx, u64 fd, u64 pid)
 	return do_msg_queue_block(ctx, filep, block_pid);
 }
 
+int call_msg_queue_subscribe(struct exec_context *ctx, u64 fd, u64 topic, u64 on)
+{
+	struct file *filep = fd_get(ctx, fd);
+	if(!filep){
+		return -EINVAL; //file is not opened
+	}
+	return do_msg_queue_subscribe(ctx, filep, topic, on);
+}
+
 int call_msg_queue_close(struct exec_context *ctx, u64 fd)
 {
 	return do_msg_queue_close(ctx, fd);
@@ -222,22 +615,9 @@ int call_sendfile(struct exec_context *ctx, u64 outfd, u64 infd, u64 offset, u64
 	return do_sendfile(ctx, outfd, infd, (long *)offset, count);
 }
 
-/*System Call handler*/
-long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
+/* Calls that do not come back here (exit, a process parked in WAITING) go untimed */
+static long dispatch_syscall(struct exec_context *current, int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 {
-	struct exec_context *current = get_current_ctx();
-	unsigned long saved_sp;
-
-	asm volatile(
-		"mov %%rbp, %0;"
-		: "=r" (saved_sp) 
-		:
-		: "memory"
-	);  
-
-	saved_sp += 0x10;    //rbp points to entry stack and the call-ret address is pushed onto the stack
-	memcpy((char *)(&current->regs), (char *)saved_sp, sizeof(struct user_regs));  //user register state saved onto the regs 
-	stats->syscalls++;
 	dprintk("[GemOS] System call invoked. syscall no = %d\n", syscall);
 	switch(syscall)
 	{
@@ -263,9 +643,23 @@ long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 	case SYSCALL_FORK:
 		return do_fork();
 	case SYSCALL_CFORK:
-		return do_cfork();
+	{
+		long pid = do_cfork();
+		if(pid > 0){
+			fd_table_fork(current, get_ctx_by_pid(pid));
+			file_map_fork(current, get_ctx_by_pid(pid));
+			shm_channel_fork(current, get_ctx_by_pid(pid));
+		}
+		return pid;
+	}
 	case SYSCALL_VFORK:
-		return do_vfork();
+	{
+		long pid;
+		fd_table_vfork(current);	// the child runs before do_vfork returns
+		pid = do_vfork();
+		fd_table_vfork(NULL);
+		return pid;
+	}
 	case SYSCALL_STATS:
 		printk("ticks = %d swapper_invocations = %d context_switches = %d lw_context_switches = %d\n", 
 		stats->ticks, stats->swapper_invocations, stats->context_switches, stats->lw_context_switches);
@@ -273,6 +667,9 @@ long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 		stats->syscalls, stats->page_faults, stats->used_memory, stats->num_processes);
 		printk("copy-on-write faults = %d allocated user_region_pages = %d\n",stats->cow_page_faults,
 		stats->user_reg_pages);
+		printk("page cache hits = %d misses = %d writebacks = %d\n", stats->pcache_hits,
+		stats->pcache_misses, stats->pcache_writebacks);
+		slab_stats();
 		break;
 	case SYSCALL_GET_USER_P:
 		return stats->user_reg_pages;
@@ -294,9 +691,16 @@ long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 	case SYSCALL_MMAP:
 		return (long) vm_area_map(current, param1, param2, param3, param4);
 
+	case SYSCALL_MMAP_FILE:
+		return do_mmap_file(current, (struct mmap_file_args *)param1);
+
 	case SYSCALL_MUNMAP:
+		file_map_unmap(current, param1, param2);
+		shm_channel_unmap(current, param1, param2);
 		return (u64) vm_area_unmap(current, param1, param2);
 	case SYSCALL_MPROTECT:
+		if(file_map_overlaps(current, param1, param2))
+			return -EINVAL;
 		return (long) vm_area_mprotect(current, param1, param2, param3);
 	case SYSCALL_PMAP:
 		return (long) vm_area_dump(current->vm_area, (int)param1);
@@ -306,9 +710,41 @@ long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 		return do_file_read(current,param1,param2,param3);
 	case SYSCALL_WRITE:
 		return do_file_write(current,param1,param2,param3);
+	case SYSCALL_READV:
+		return do_file_iov(current, param1, (struct iovec *)param2, param3, 0, 0);
+	case SYSCALL_WRITEV:
+		return do_file_iov(current, param1, (struct iovec *)param2, param3, 0, IOV_WRITE);
+	case SYSCALL_PREAD:
+		return do_file_pio(current, param1, param2, param3, param4, 0);
+	case SYSCALL_PWRITE:
+		return do_file_pio(current, param1, param2, param3, param4, IOV_WRITE);
+	case SYSCALL_PREADV:
+		return do_file_iov(current, param1, (struct iovec *)param2, param3, param4, IOV_AT);
+	case SYSCALL_PWRITEV:
+		return do_file_iov(current, param1, (struct iovec *)param2, param3, param4, IOV_WRITE|IOV_AT);
 	case SYSCALL_PIPE:
-		return do_create_pipe(current, (void*) param1);
-
+		return do_create_pipe(current, (void*) param1, PIPE_MAX_SIZE, 0);
+	case SYSCALL_PIPE2:
+		return do_create_pipe(current, (void*) param1, param2, param3);
+	case SYSCALL_SPLICE:
+		return do_splice(current, param1, param2, param3, 0);
+	case SYSCALL_TEE:
+		return do_splice(current, param1, param2, param3, 1);
+	case SYSCALL_POLL:
+		return do_poll(current, (struct pollfd *)param1, param2, param3);
+	case SYSCALL_SYSCALL_STATS:
+		return do_syscall_stats(current, (struct syscall_stats *)param1, param2);
+	case SYSCALL_SHM_CHANNEL_CREATE:
+		return do_shm_channel_create(current, param1, param2);
+	case SYSCALL_SHM_CHANNEL_MAP:
+		return do_shm_channel_map(current, fd_get(current, param1));
+	case SYSCALL_SHM_CHANNEL_WAIT:
+		return call_shm_channel_wait(current, param1, param2, param3);
+	case SYSCALL_SHM_CHANNEL_WAKE:
+		return do_shm_channel_wake(fd_get(current, param1));
+
+	case SYSCALL_DUP:
+		return do_dup(current, param1);
 	case SYSCALL_DUP2:
 		return do_dup2(current, param1, param2);  
 	case SYSCALL_CLOSE:
@@ -323,19 +759,59 @@ long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 	case SYSCALL_GET_MEMBER_INFO:
 		return do_get_member_info(current, param1, param2);
 	case SYSCALL_MSG_QUEUE_SEND:
-		return call_msg_queue_send(current, param1, param2);
+		return call_msg_queue_send(current, param1, param2, 0, 0);
+	case SYSCALL_MSG_QUEUE_SEND_WAIT:
+		return call_msg_queue_send(current, param1, param2, 1, param3);
 	case SYSCALL_GET_MSG_COUNT:
 		return call_get_msg_count(current, param1);
 	case SYSCALL_MSG_QUEUE_RCV:
-		return call_msg_queue_rcv(current, param1, param2);
+		return call_msg_queue_rcv(current, param1, param2, 0, 0);
+	case SYSCALL_MSG_QUEUE_RCV_WAIT:
+		return call_msg_queue_rcv(current, param1, param2, 1, param3);
+	case SYSCALL_MSG_QUEUE_SEND_BATCH:
+		return call_msg_queue_send_batch(current, param1, param2, param3);
+	case SYSCALL_MSG_QUEUE_RCV_BATCH:
+		return call_msg_queue_rcv_batch(current, param1, param2, param3);
+	case SYSCALL_MSG_QUEUE_SEND_BUF:
+		return call_msg_queue_send_buf(current, param1, param2);
+	case SYSCALL_MSG_QUEUE_RCV_BUF:
+		return call_msg_queue_rcv_buf(current, param1, param2);
+	case SYSCALL_MSG_QUEUE_SUBSCRIBE:
+		return call_msg_queue_subscribe(current, param1, param2, param3);
 	case SYSCALL_MSG_QUEUE_BLOCK:
 		return call_msg_queue_block(current, param1, param2);
 	case SYSCALL_MSG_QUEUE_CLOSE:
 		return call_msg_queue_close(current, param1);
 	case SYSCALL_SENDFILE:
 		return call_sendfile(current, param1, param2, param3, param4);
+	case SYSCALL_MEMOPS_BENCH:
+		return do_memops_bench(current, (struct memops_bench *)param1);
 	default:
 		return -1;
 	}
 	return 0;   /*GCC shut up!*/
 }
+
+/*System Call handler*/
+long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
+{
+	struct exec_context *current = get_current_ctx();
+	unsigned long saved_sp;
+	u64 start;
+	long ret;
+
+	asm volatile(
+		"mov %%rbp, %0;"
+		: "=r" (saved_sp) 
+		:
+		: "memory"
+	);  
+
+	saved_sp += 0x10;    //rbp points to entry stack and the call-ret address is pushed onto the stack
+	memcpy((char *)(&current->regs), (char *)saved_sp, sizeof(struct user_regs));  //user register state saved onto the regs 
+	stats->syscalls++;
+	start = rdtsc();
+	ret = dispatch_syscall(current, syscall, param1, param2, param3, param4);
+	syscall_account(syscall, rdtsc() - start);
+	return ret;
+}
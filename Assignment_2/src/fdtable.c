@@ -0,0 +1,245 @@
+#include<types.h>
+#include<lib.h>
+#include<context.h>
+#include<memory.h>
+#include<entry.h>
+#include<file.h>
+#include<fdtable.h>
+#include<msg_queue.h>
+
+/*
+ * Per process descriptor tables, indexed by pid. A table is built from
+ * ctx->files[] the first time the process touches it (the init process and
+ * anything else set up by the binaries), copied by the fork hooks, and
+ * released on exit. The binaries only ever see the low MAX_OPEN_FILES slots.
+ */
+
+static struct fd_table fd_tables[MAX_PROCESSES];
+
+/* vfork runs the child before it returns, the child picks this up itself */
+static struct exec_context *vfork_parent;
+
+static inline int bsf(u64 word)
+{
+	u64 bit;
+	asm volatile("bsf %1, %0" : "=r"(bit) : "r"(word));
+	return bit;
+}
+
+static inline struct file **fd_slot(struct exec_context *ctx, struct fd_table *table, int fd)
+{
+	if(fd < MAX_OPEN_FILES)
+		return &ctx->files[fd];
+	fd -= MAX_OPEN_FILES;
+	if(!table->chunks[fd / FD_CHUNK_FILES])
+		return NULL;
+	return &table->chunks[fd / FD_CHUNK_FILES][fd % FD_CHUNK_FILES];
+}
+
+static void fd_mark(struct fd_table *table, int fd, int used)
+{
+	int w = fd / 64;
+
+	if(used)
+		table->used[w] |= 1UL << (fd % 64);
+	else
+		table->used[w] &= ~(1UL << (fd % 64));
+	if(table->used[w] == ~0UL)
+		table->full |= 1UL << w;
+	else
+		table->full &= ~(1UL << w);
+}
+
+static void fd_release(struct fd_table *table)
+{
+	int i;
+
+	for(i = 0; i < FD_CHUNKS; i++)
+		if(table->chunks[i])
+		{
+			os_page_free(OS_DS_REG, table->chunks[i]);
+			table->chunks[i] = NULL;
+		}
+	bzero((char *)table, sizeof(struct fd_table));
+}
+
+static struct fd_table *fd_table(struct exec_context *ctx)
+{
+	struct fd_table *table = &fd_tables[ctx->pid];
+	int fd;
+
+	if(table->valid)
+		return table;
+	if(vfork_parent && vfork_parent->pid == ctx->ppid)
+	{
+		fd_table_fork(vfork_parent, ctx);
+		vfork_parent = NULL;
+		return table;
+	}
+	table->valid = 1;
+	for(fd = 0; fd < MAX_OPEN_FILES; fd++)
+		if(ctx->files[fd])
+			fd_mark(table, fd, 1);
+	return table;
+}
+
+/* Back the slot of fd with memory, 0 or -ENOMEM */
+static int fd_expand(struct fd_table *table, int fd)
+{
+	struct file ***chunk;
+
+	if(fd < MAX_OPEN_FILES)
+		return 0;
+	chunk = &table->chunks[(fd - MAX_OPEN_FILES) / FD_CHUNK_FILES];
+	if(*chunk)
+		return 0;
+	*chunk = (struct file **)os_page_alloc(OS_DS_REG);
+	if(!*chunk)
+		return -ENOMEM;
+	bzero((char *)*chunk, PAGE_SIZE);
+	return 0;
+}
+
+struct file *fd_get(struct exec_context *ctx, int fd)
+{
+	struct file **slot;
+
+	if(fd < 0 || fd >= FD_TABLE_MAX)
+		return NULL;
+	if(fd < MAX_OPEN_FILES)
+		return ctx->files[fd];
+	slot = fd_slot(ctx, fd_table(ctx), fd);
+	return slot ? *slot : NULL;
+}
+
+/*
+ * Lowest free descriptor not below lowest, with its slot backed so that
+ * fd_install() cannot fail. Nothing is reserved until the install.
+ */
+int fd_alloc(struct exec_context *ctx, int lowest)
+{
+	struct fd_table *table = fd_table(ctx);
+	u64 word, words;
+	int w = lowest / 64, fd;
+
+	if(lowest < 0 || lowest >= FD_TABLE_MAX)
+		return -EINVAL;
+	word = table->used[w] | ((1UL << (lowest % 64)) - 1);
+	if(word != ~0UL)
+	{
+		fd = w * 64 + bsf(~word);
+	}
+	else
+	{
+		// next word with a free bit, from the summary
+		words = ~table->full & ((1UL << FD_WORDS) - 1) & ~((2UL << w) - 1);
+		if(!words)
+			return -EMFILE;
+		w = bsf(words);
+		fd = w * 64 + bsf(~table->used[w]);
+	}
+	if(fd_expand(table, fd) < 0)
+		return -ENOMEM;
+	return fd;
+}
+
+int fd_install(struct exec_context *ctx, int fd, struct file *filep)
+{
+	struct fd_table *table = fd_table(ctx);
+
+	if(fd < 0 || fd >= FD_TABLE_MAX)
+		return -EINVAL;
+	if(fd_expand(table, fd) < 0)
+		return -ENOMEM;
+	*fd_slot(ctx, table, fd) = filep;
+	fd_mark(table, fd, filep != NULL);
+	return fd;
+}
+
+/* Empty the slot of fd and return what was in it, the reference is the caller's */
+struct file *fd_clear(struct exec_context *ctx, int fd)
+{
+	struct fd_table *table = fd_table(ctx);
+	struct file **slot, *filep;
+
+	if(fd < 0 || fd >= FD_TABLE_MAX)
+		return NULL;
+	slot = fd_slot(ctx, table, fd);
+	if(!slot)
+		return NULL;
+	filep = *slot;
+	*slot = NULL;
+	fd_mark(table, fd, 0);
+	return filep;
+}
+
+/* First descriptor in use from fd on, -1 if none */
+int fd_next(struct exec_context *ctx, int fd)
+{
+	struct fd_table *table = fd_table(ctx);
+	u64 word;
+	int w;
+
+	if(fd < 0)
+		fd = 0;
+	for(w = fd / 64; w < FD_WORDS; w++)
+	{
+		word = table->used[w];
+		if(w == fd / 64)
+			word &= ~((1UL << (fd % 64)) - 1);
+		if(word)
+			return w * 64 + bsf(word);
+	}
+	return -1;
+}
+
+/*
+ * The child gets a copy of the parent's table and a reference to each file
+ * in it. Message queue files are left to the message queue fork handler,
+ * run from here so that fork, cfork and vfork children all go through it.
+ */
+void fd_table_fork(struct exec_context *parent, struct exec_context *child)
+{
+	struct fd_table *from = fd_table(parent);
+	struct fd_table *to = &fd_tables[child->pid];
+	struct file *filep;
+	int fd, i;
+
+	if(to->valid)
+		fd_release(to);
+	*to = *from;
+	for(i = 0; i < FD_CHUNKS; i++)
+	{
+		if(!from->chunks[i])
+			continue;
+		to->chunks[i] = (struct file **)os_page_alloc(OS_DS_REG);
+		if(!to->chunks[i])
+		{
+			// out of memory, the child goes without these descriptors
+			for(fd = 0; fd < FD_CHUNK_FILES; fd++)
+				if(from->chunks[i][fd])
+					fd_mark(to, MAX_OPEN_FILES + i * FD_CHUNK_FILES + fd, 0);
+			continue;
+		}
+		memcpy((char *)to->chunks[i], (char *)from->chunks[i], PAGE_SIZE);
+	}
+	for(fd = fd_next(child, 0); fd >= 0; fd = fd_next(child, fd + 1))
+	{
+		filep = fd_get(child, fd);
+		if(!filep->msg_queue)
+			filep->ref_count++;
+	}
+	do_add_child_to_msg_queue(child);
+}
+
+/* Set before do_vfork and cleared (NULL) once the parent runs again */
+void fd_table_vfork(struct exec_context *parent)
+{
+	vfork_parent = parent;
+}
+
+/* Called after do_file_exit has dropped the files */
+void fd_table_exit(struct exec_context *ctx)
+{
+	fd_release(&fd_tables[ctx->pid]);
+}
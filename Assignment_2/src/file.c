@@ -6,6 +6,8 @@
 #include<entry.h>
 #include<memory.h>
 #include<fs.h>
+#include<fdtable.h>
+#include<slab.h>
 #include<kbd.h>
 
 
@@ -13,22 +15,35 @@
 /***************************Do Not Modify below Functions****************************/
 /************************************************************************************/
 
+/*
+ * file objects come from a slab cache. Their fops point at a shared table
+ * per file type.
+ */
+
+static void file_ctor(void *obj)
+{
+	struct file *file = (struct file *)obj;
+	bzero((char *)file, sizeof(struct file));
+	file->ref_count = 1;
+}
+
+static struct slab_cache file_cache = SLAB_CACHE("file", struct file, file_ctor);
+
 void free_file_object(struct file *filep)
 {
 	if(filep)
 	{
-		os_page_free(OS_DS_REG ,filep);
+		slab_free(filep);
 		stats->file_objects--;
 	}
 }
 
-struct file *alloc_file()
+struct file *alloc_file_ops(const struct fileops *ops)
 {
-	struct file *file = (struct file *) os_page_alloc(OS_DS_REG); 
-	file->fops = (struct fileops *) (file + sizeof(struct file)); 
-	bzero((char *)file->fops, sizeof(struct fileops));
-	file->ref_count = 1;
-	file->offp = 0;
+	struct file *file = (struct file *) slab_alloc(&file_cache);
+	if(!file)
+		return NULL;
+	file->fops = ops;
 	stats->file_objects++;
 	return file; 
 }
@@ -68,20 +83,25 @@ long std_close(struct file *filep)
 		free_file_object(filep);
 	return 0;
 }
+
+static const struct fileops stdin_ops = {
+	.read = do_read_kbd,
+	.close = std_close,
+};
+
+static const struct fileops stdout_ops = {
+	.write = do_write_console,
+	.close = std_close,
+};
+
 struct file *create_standard_IO(int type)
 {
-	struct file *filep = alloc_file();
+	struct file *filep = alloc_file_ops(type == STDIN ? &stdin_ops : &stdout_ops);
 	filep->type = type;
 	if(type == STDIN)
 		filep->mode = O_READ;
 	else
 		filep->mode = O_WRITE;
-	if(type == STDIN){
-		filep->fops->read = do_read_kbd;
-	}else{
-		filep->fops->write = do_write_console;
-	}
-	filep->fops->close = std_close;
 	return filep;
 }
 
@@ -92,12 +112,12 @@ int open_standard_IO(struct exec_context *ctx, int type)
 	if(!filep){
 		filep = create_standard_IO(type);
 	}else{
+		fd = fd_alloc(ctx, 3);
+		if(fd < 0)
+			return fd;
 		filep->ref_count++;
-		fd = 3;
-		while(ctx->files[fd])
-			fd++; 
 	}
-	ctx->files[fd] = filep;
+	fd_install(ctx, fd, filep);
 	return fd;
 }
 /**********************************************************************************/
@@ -166,7 +186,7 @@ extern int do_regular_file_open(struct exec_context *ctx, char* filename, u64 fl
 
 	/**  
 	*  TODO Implementation of file open, 
-	*  You should be creating file(use the alloc_file function to creat file), 
+	*  You should be creating file(use alloc_file_ops with a fileops table of the regular file handlers), 
 	*  To create or Get inode use File system function calls, 
 	*  Handle mode and flags 
 	*  Validate file existence, Max File count is 16, Max Size is 4KB, etc
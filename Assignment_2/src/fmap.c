@@ -0,0 +1,280 @@
+#include<types.h>
+#include<lib.h>
+#include<context.h>
+#include<memory.h>
+#include<entry.h>
+#include<file.h>
+#include<fs.h>
+#include<page.h>
+#include<mmap.h>
+#include<pcache.h>
+#include<memops.h>
+#include<fmap.h>
+#include<fdtable.h>
+
+/*
+ * mmap of regular files. The pages of a file mapping point straight at the
+ * file store frames of the file and are installed when the mapping is made,
+ * so the (binary) page fault path never sees them.
+ *
+ * MAP_SHARED pages are mapped with the protection asked for; stores go to
+ * the file. MAP_PRIVATE pages are mapped read only with the frame's pfn
+ * refcount raised, so a write takes the copy-on-write fault path, which
+ * copies the page into a fresh user page and drops the extra reference.
+ *
+ * The page cache is bypassed for a file while it is mapped (map_count), so
+ * read/write and the mapping see the same bytes.
+ */
+
+static struct file_map file_maps[MAX_FILE_MAPS];
+
+static struct file_map *file_map_alloc()
+{
+	int i;
+	for(i = 0; i < MAX_FILE_MAPS; i++)
+		if(!file_maps[i].pid)
+			return &file_maps[i];
+	return NULL;
+}
+
+static void file_map_get(struct file_map *map)
+{
+	map->inode->open(map->inode);
+	map->inode->map_count++;
+}
+
+static void file_map_put(struct file_map *map)
+{
+	map->inode->map_count--;
+	map->inode->close(map->inode);
+	map->pid = 0;
+}
+
+/*
+ * Remove the PTEs of [start, end) that point into the file store. Pages a
+ * private mapping has already copied are ordinary user pages and are left
+ * for vm_area_unmap to free.
+ */
+static void file_map_teardown(struct exec_context *ctx, u64 start, u64 end)
+{
+	u64 addr, *pte;
+	u32 pfn;
+	struct pfn_info *info;
+
+	for(addr = start; addr < end; addr += PAGE_SIZE)
+	{
+		pte = get_user_pte(ctx, addr, 0);
+		if(!pte || !(*pte & 0x1))
+			continue;
+		pfn = (*pte >> PTE_SHIFT) & 0xFFFFFFFF;
+		if(!flat_store_pfn(pfn))
+			continue;
+		info = get_pfn_info(pfn);
+		if(get_pfn_info_refcount(info) > 1)
+			decrement_pfn_info_refcount(info);
+		*pte = 0;
+		asm volatile (
+			"invlpg (%0);"
+			:: "r"(addr)
+			: "memory"
+		);
+	}
+}
+
+long do_mmap_file(struct exec_context *ctx, struct mmap_file_args *args)
+{
+	struct file *filep;
+	struct inode *inode;
+	struct file_map *map;
+	struct pfn_info *info;
+	u64 base, pos;
+	u32 pages, file_pages, len, pfn, access, i;
+	long addr;
+	char *frame;
+
+	if(!args || !args->length)
+		return -EINVAL;
+	filep = fd_get(ctx, args->fd);
+	if(!filep || filep->type != REGULAR || (args->offset & (PAGE_SIZE - 1)))
+		return -EINVAL;
+	if(!(filep->mode & O_READ))
+		return -EACCES;
+	if((args->flags & MAP_SHARED) && (args->prot & PROT_WRITE) && !(filep->mode & O_WRITE))
+		return -EACCES;
+
+	// only pages that hold file data can be mapped
+	inode = filep->inode;
+	pages = (args->length + PAGE_SIZE - 1) / PAGE_SIZE;
+	file_pages = (inode->file_size + PAGE_SIZE - 1) / PAGE_SIZE;
+	if(args->offset / PAGE_SIZE + pages > file_pages)
+		return -EINVAL;
+
+	map = file_map_alloc();
+	if(!map)
+		return -ENOMEM;
+	addr = vm_area_map(ctx, args->addr, pages * PAGE_SIZE, args->prot, args->flags & MAP_FIXED);
+	if(addr < 0)
+		return addr;
+
+	pcache_flush(inode);
+	pcache_invalidate(inode);
+
+	// the end of the last page is visible through the mapping, clear it
+	if(inode->file_size % PAGE_SIZE)
+	{
+		len = 1;
+		frame = flat_map(inode, inode->file_size - 1, &len);
+		fast_bzero(frame + 1, PAGE_SIZE - inode->file_size % PAGE_SIZE);
+	}
+
+	access = (args->flags & MAP_SHARED) ? (args->prot & PROT_WRITE) : 0;
+	base = (u64)osmap(ctx->pgd);
+	for(i = 0; i < pages; i++)
+	{
+		pos = args->offset + (u64)i * PAGE_SIZE;
+		len = PAGE_SIZE;
+		frame = flat_map(inode, pos, &len);
+		pfn = (u64)frame >> PAGE_SHIFT;
+
+		// refcount is 1 for the store plus one per private PTE
+		info = get_pfn_info(pfn);
+		if(!get_pfn_info_refcount(info))
+			set_pfn_info(pfn);
+		if(!(args->flags & MAP_SHARED))
+			increment_pfn_info_refcount(info);
+		map_physical_page(base, addr + (u64)i * PAGE_SIZE, access, pfn);
+	}
+
+	map->pid = ctx->pid;
+	map->flags = args->flags & MAP_SHARED;
+	map->access = access;
+	map->start = addr;
+	map->end = addr + (u64)pages * PAGE_SIZE;
+	map->inode = inode;
+	map->pgoff = args->offset / PAGE_SIZE;
+	file_map_get(map);
+	return addr;
+}
+
+/* Called before vm_area_unmap, which would free store frames as user pages */
+void file_map_unmap(struct exec_context *ctx, u64 addr, int length)
+{
+	u64 end = addr + (((u64)length + PAGE_SIZE - 1) & ~((u64)PAGE_SIZE - 1));
+	u64 start, stop;
+	struct file_map *map, *tail;
+	int i;
+
+	for(i = 0; i < MAX_FILE_MAPS; i++)
+	{
+		map = &file_maps[i];
+		if(map->pid != ctx->pid || map->end <= addr || map->start >= end)
+			continue;
+		start = (map->start > addr) ? map->start : addr;
+		stop = (map->end < end) ? map->end : end;
+		file_map_teardown(ctx, start, stop);
+
+		if(start == map->start && stop == map->end)
+		{
+			file_map_put(map);
+		}
+		else if(start == map->start)
+		{
+			map->pgoff += (stop - map->start) / PAGE_SIZE;
+			map->start = stop;
+		}
+		else if(stop == map->end)
+		{
+			map->end = start;
+		}
+		else
+		{
+			// hole in the middle, the part after it gets its own slot
+			tail = file_map_alloc();
+			if(tail)
+			{
+				*tail = *map;
+				tail->pgoff += (stop - map->start) / PAGE_SIZE;
+				tail->start = stop;
+				file_map_get(tail);
+				map->end = start;
+			}
+		}
+	}
+}
+
+int file_map_overlaps(struct exec_context *ctx, u64 addr, int length)
+{
+	int i;
+	for(i = 0; i < MAX_FILE_MAPS; i++)
+		if(file_maps[i].pid == ctx->pid && file_maps[i].start < addr + length &&
+		   file_maps[i].end > addr)
+			return 1;
+	return 0;
+}
+
+/*
+ * cfork made the store PTEs of a MAP_SHARED mapping copy-on-write in both
+ * processes like any other page. Give them their write bit back and drop
+ * the reference cfork took, so stores keep going to the file.
+ */
+static void file_map_share(struct exec_context *parent, struct exec_context *child,
+			   struct file_map *map)
+{
+	u64 addr, *pte, *cpte;
+	u32 pfn;
+	struct pfn_info *info;
+
+	for(addr = map->start; addr < map->end; addr += PAGE_SIZE)
+	{
+		pte = get_user_pte(parent, addr, 0);
+		if(!pte || !(*pte & 0x1))
+			continue;
+		pfn = (*pte >> PTE_SHIFT) & 0xFFFFFFFF;
+		if(!flat_store_pfn(pfn))
+			continue;
+		info = get_pfn_info(pfn);
+		if(get_pfn_info_refcount(info) > 1)
+			decrement_pfn_info_refcount(info);
+		*pte |= map->access;
+		cpte = get_user_pte(child, addr, 0);
+		if(cpte && (*cpte & 0x1))
+			*cpte |= map->access;
+		asm volatile (
+			"invlpg (%0);"
+			:: "r"(addr)
+			: "memory"
+		);
+	}
+}
+
+/* cfork shares the parent's PTEs, including those into the file store */
+void file_map_fork(struct exec_context *parent, struct exec_context *child)
+{
+	struct file_map *map;
+	int i;
+
+	for(i = 0; i < MAX_FILE_MAPS; i++)
+	{
+		if(file_maps[i].pid != parent->pid)
+			continue;
+		map = file_map_alloc();
+		if(!map)
+			return;	// the child keeps cfork's references, unshared
+		if(file_maps[i].flags & MAP_SHARED)
+			file_map_share(parent, child, &file_maps[i]);
+		*map = file_maps[i];
+		map->pid = child->pid;
+		file_map_get(map);
+	}
+}
+
+void file_map_exit(struct exec_context *ctx)
+{
+	int i;
+	for(i = 0; i < MAX_FILE_MAPS; i++)
+		if(file_maps[i].pid == ctx->pid)
+		{
+			file_map_teardown(ctx, file_maps[i].start, file_maps[i].end);
+			file_map_put(&file_maps[i]);
+		}
+}
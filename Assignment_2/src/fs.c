@@ -4,6 +4,8 @@
 #include<file.h>
 #include<memory.h>
 #include<context.h>
+#include<memops.h>
+#include<pcache.h>
 
 struct super_block* super_block; 
 
@@ -22,7 +24,7 @@ u64 get_contigous_pages(u32 region, int number_of_pages)
 		prevpfn = currentpfn;
 	}
 	first_page = first_page  << PAGE_SHIFT;
-	bzero((char*)first_page, (PAGE_SIZE * number_of_pages));
+	fast_bzero((char*)first_page, (PAGE_SIZE * number_of_pages));
 	return first_page;
 }
 
@@ -40,35 +42,29 @@ void init_file_inode(struct super_block * super_block)
 	super_block->sb_op = (struct sb_operations*)os_page_alloc(FILE_DS_REG);
 }
 /*
- * start_reg is Starting address of the first usable page of FILE_STORE_REG 
- * file_size is maximum size of the file [in BYTES] we can allocate But for
- * simplicity we rounding the file_size to a PAGE_SIZE*num_pages;
- * Allocation of pages is taking too much time
+ * The file store is an arena of FILE_STORE_PAGES contiguous pages carved
+ * out of FILE_STORE_REG at boot. Files own a list of extents (runs of
+ * contiguous arena pages) which are handed out on demand as the file grows
+ * and returned to the arena when the inode is removed.
  */
 void alloc_inodes(struct super_block *sb)
 {
-	u32 i, num_pages;
-	u64 start_reg, file_size, file_pfn;
-	start_reg =  get_contigous_pages(FILE_STORE_REG, 1);
-	file_size = (END - start_reg) / NUM_FILES;       
-	num_pages = FILE_SIZE / PAGE_SIZE ;
-	file_size = num_pages * PAGE_SIZE;
+	u32 i;
+
+	for( i=0; i<NAME_HASH_BUCKETS; i++)
+		sb->name_hash[i] = -1;
+	sb->free_inode = 0;
+
+	sb->store_start = get_contigous_pages(FILE_STORE_REG, FILE_STORE_PAGES);
+	sb->store_pages = FILE_STORE_PAGES;
+	sb->free_pages = FILE_STORE_PAGES;
+	sb->store_bitmap = (u64 *)os_page_alloc(FILE_DS_REG);
+	bzero((char *)sb->store_bitmap, PAGE_SIZE);
+
 	for( i=0; i<NUM_FILES; i++)
 	{
 		struct inode *inode = sb->inode[i];
-		if( i == 0 )
-		{	// We allocated already 1 page to get start_reg
-			file_pfn = get_contigous_pages(FILE_STORE_REG, num_pages-1);
-			inode->s_pos = start_reg;
-			inode->e_pos = start_reg + file_size;
-		}
-		else
-		{
-			file_pfn = get_contigous_pages(FILE_STORE_REG, num_pages);
-                        inode->s_pos = file_pfn;
-                        inode->e_pos = file_pfn + file_size;
 
-		}
 		inode->is_valid = 0;
                 inode->filename[0] = '\0';
                 inode->mode = 0;
@@ -80,8 +76,13 @@ void alloc_inodes(struct super_block *sb)
 		inode->close = flat_close;
 
 		inode->inode_no = i;
-                inode->max_pos = inode->s_pos;
+		inode->hash_next = (i + 1 < NUM_FILES) ? i + 1 : -1;
                 inode->file_size = 0;
+		inode->num_pages = 0;
+		inode->num_extents = 0;
+		inode->cached_pages = 0;
+		inode->ra_next = 0;
+		inode->map_count = 0;
                 inode->ref_count = 0;
                 inode->sb = sb;
 	}
@@ -90,10 +91,13 @@ void alloc_inodes(struct super_block *sb)
 void init_file_system()
 {
 	//struct super_block * super_block;
-	super_block = (struct super_block*)os_page_alloc(FILE_DS_REG);
+	memops_init();
+	super_block = (struct super_block*)get_contigous_pages(FILE_DS_REG,
+			(sizeof(struct super_block) + PAGE_SIZE - 1) / PAGE_SIZE);
 
 	init_file_inode(super_block);
 	alloc_inodes(super_block);
+	pcache_init();
 
 	super_block->fs_name = "flat";
 	super_block->num_files = 0;
@@ -199,52 +203,247 @@ static int is_valid_inode( struct inode *inode )
 }
 
 
-struct inode* flat_lookup_inode(struct super_block *sb, char *filename)
+/********************************* Extent allocator ************************************/
+
+static int store_page_used(struct super_block *sb, u32 page)
+{
+	return (sb->store_bitmap[page >> 6] >> (page & 63)) & 1;
+}
+
+static void store_mark(struct super_block *sb, u32 start, u32 num_pages, int used)
+{
+	u32 page;
+	for(page = start; page < start + num_pages; page++)
+	{
+		if(used)
+			sb->store_bitmap[page >> 6] |= (1UL << (page & 63));
+		else
+			sb->store_bitmap[page >> 6] &= ~(1UL << (page & 63));
+	}
+	if(used)
+		sb->free_pages -= num_pages;
+	else
+		sb->free_pages += num_pages;
+}
+
+/*
+ * First fit search for num_pages free contiguous pages in the arena.
+ * Fully used bitmap words are skipped a word at a time.
+ * Returns the start page or -1
+ */
+static int extent_alloc(struct super_block *sb, u32 num_pages)
+{
+	u32 page = 0, run = 0;
+
+	if(num_pages == 0 || num_pages > sb->free_pages)
+		return -1;
+
+	while(page < sb->store_pages)
+	{
+		if(!(page & 63) && sb->store_bitmap[page >> 6] == ~0UL)
+		{
+			run = 0;
+			page += 64;
+			continue;
+		}
+		if(store_page_used(sb, page))
+			run = 0;
+		else if(++run == num_pages)
+		{
+			u32 start = page + 1 - num_pages;
+			store_mark(sb, start, num_pages, 1);
+			return start;
+		}
+		page++;
+	}
+	return -1;
+}
+
+/*
+ * Grow the extent in place if the pages right after it are free
+ */
+static int extent_extend(struct super_block *sb, struct extent *ext, u32 num_pages)
+{
+	u32 page, end = ext->start + ext->num_pages;
+
+	if(end + num_pages > sb->store_pages)
+		return -1;
+	for(page = end; page < end + num_pages; page++)
+	{
+		if(store_page_used(sb, page))
+			return -1;
+	}
+	store_mark(sb, end, num_pages, 1);
+	ext->num_pages += num_pages;
+	return 0;
+}
+
+/*
+ * Make sure inode has room for size bytes. The last extent is extended
+ * in place when possible, otherwise a new extent is added. New extents are
+ * sized to the current file allocation so the number of extents stays
+ * logarithmic in the file size for sequentially growing files.
+ */
+static int flat_grow(struct inode *inode, u32 size)
+{
+	struct super_block *sb = inode->sb;
+	u32 needed, want;
+	int start;
+
+	if(size <= inode->num_pages * PAGE_SIZE)
+		return 0;
+	needed = (size + PAGE_SIZE - 1) / PAGE_SIZE - inode->num_pages;
+
+	if(inode->num_extents &&
+	   extent_extend(sb, &inode->extents[inode->num_extents - 1], needed) == 0)
+	{
+		inode->num_pages += needed;
+		return 0;
+	}
+	if(inode->num_extents == MAX_EXTENTS)
+		return -1;
+
+	want = (inode->num_pages > needed) ? inode->num_pages : needed;
+	start = extent_alloc(sb, want);
+	if(start < 0 && want != needed)
+	{
+		want = needed;
+		start = extent_alloc(sb, want);
+	}
+	if(start < 0)
+		return -1;
+
+	inode->extents[inode->num_extents].start = start;
+	inode->extents[inode->num_extents].num_pages = want;
+	inode->num_extents++;
+	inode->num_pages += want;
+	return 0;
+}
+
+/* Allocate the store behind the first size bytes of the file, 0 on success */
+int flat_reserve(struct inode *inode, u32 size)
+{
+	return flat_grow(inode, size);
+}
+
+static void flat_release_extents(struct inode *inode)
 {
 	u32 i;
-        for( i=0; i< NUM_FILES; i++)
-        {
-                struct inode *inode = sb->inode[i];
-  	   	if( is_valid_inode(inode) && strcmp(inode->filename, filename) == 0 )
-                        return inode;
-        }
-        return NULL;
+	for(i = 0; i < inode->num_extents; i++)
+		store_mark(inode->sb, inode->extents[i].start, inode->extents[i].num_pages, 0);
+	inode->num_extents = 0;
+	inode->num_pages = 0;
+}
+
+/*
+ * Translate a file offset to its address in the store. *contig is set to the
+ * number of bytes that are contiguous from there on (till the extent ends)
+ */
+static char *flat_addr(struct inode *inode, u32 pos, u32 *contig)
+{
+	u32 i, ext_bytes;
+	for(i = 0; i < inode->num_extents; i++)
+	{
+		ext_bytes = inode->extents[i].num_pages * PAGE_SIZE;
+		if(pos < ext_bytes)
+		{
+			*contig = ext_bytes - pos;
+			return (char *)(inode->sb->store_start +
+					((u64)inode->extents[i].start << PAGE_SHIFT) + pos);
+		}
+		pos -= ext_bytes;
+	}
+	*contig = 0;
+	return NULL;
+}
+
+/****************************************************************************************/
+
+/*
+ * Name index: NAME_HASH_BUCKETS chains of inode numbers linked through
+ * inode->hash_next. Free inodes are kept on a separate list threaded
+ * through the same field, so create and remove never scan the inode table.
+ */
+static u32 name_hash(char *name)
+{
+	u32 hash = 2166136261u;		// FNV-1a
+	while(*name)
+	{
+		hash ^= (u8)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static struct inode *hash_find(struct super_block *sb, char *name, u32 hash)
+{
+	int inode_no = sb->name_hash[hash & (NAME_HASH_BUCKETS - 1)];
+	while(inode_no >= 0)
+	{
+		struct inode *inode = sb->inode[inode_no];
+		if( inode->name_hash == hash && strcmp(inode->filename, name) == 0 )
+			return inode;
+		inode_no = inode->hash_next;
+	}
+	return NULL;
+}
+
+static void hash_insert(struct super_block *sb, struct inode *inode)
+{
+	int *head = &sb->name_hash[inode->name_hash & (NAME_HASH_BUCKETS - 1)];
+	inode->hash_next = *head;
+	*head = inode->inode_no;
+}
+
+static void hash_remove(struct super_block *sb, struct inode *inode)
+{
+	int *link = &sb->name_hash[inode->name_hash & (NAME_HASH_BUCKETS - 1)];
+	while(*link >= 0)
+	{
+		if( *link == inode->inode_no )
+		{
+			*link = inode->hash_next;
+			return;
+		}
+		link = &sb->inode[*link]->hash_next;
+	}
+}
+
+struct inode* flat_lookup_inode(struct super_block *sb, char *filename)
+{
+	return hash_find(sb, filename, name_hash(filename));
 }
 
 int flat_get_inode_no( struct super_block *sb, char *name)
 {
-	u32 i;
-        for( i=0; i< NUM_FILES; i++)
-        {
-                struct inode *inode = sb->inode[i];
-                if( is_valid_inode(inode) && strcmp(inode->filename, name) == 0 )
-                        return i;
-        }
-        return -1;
+	struct inode *inode = hash_find(sb, name, name_hash(name));
+	if( inode == NULL )
+		return -1;
+	return inode->inode_no;
 }
 
 static int get_free_inode( struct super_block *sb)
 {
-        u32 i;
-        for(i=0; i<NUM_FILES; i++)
-        {
-                if( !is_valid_inode(sb->inode[i]) )
-                {
-                        return i;
-                }
-        }
-        return -1;
+	int inode_no = sb->free_inode;
+	if( inode_no >= 0 )
+		sb->free_inode = sb->inode[inode_no]->hash_next;
+	return inode_no;
 }
 
 
 int flat_create_inode(struct super_block *sb, char *file_name, u32 mode)
 {
-   	u32 inode_no, i=0;
-        inode_no = get_free_inode(sb);
+   	u32 i=0, hash;
+	int inode_no;
+
 	// check if the filename is exits or not [ Upper layers ]
-	if( sb->sb_op->lookup_inode(sb, file_name) != NULL )
+	hash = name_hash(file_name);
+	if( hash_find(sb, file_name, hash) != NULL )
+		return -1;
+	if( strlen(file_name) >= sizeof(sb->inode[0]->filename) )
 		return -1;
 
+        inode_no = get_free_inode(sb);
         if( inode_no >= 0 && inode_no < NUM_FILES )
         {
                 struct inode *inode = sb->inode[inode_no];
@@ -259,9 +458,11 @@ int flat_create_inode(struct super_block *sb, char *file_name, u32 mode)
                 }
 		inode->filename[i] = '\0';
 
-                inode->max_pos = inode->s_pos;
                 inode->file_size = 0;
                 inode->ref_count = 0;
+		inode->ra_next = 0;
+		inode->name_hash = hash;
+		hash_insert(sb, inode);
                 
 		sb->num_files += 1;
         }
@@ -272,15 +473,19 @@ int flat_create_inode(struct super_block *sb, char *file_name, u32 mode)
 
 int flat_remove_inode(struct super_block *sb, struct inode *inode)
 {
-	if( !inode && inode->ref_count != 0 )
+	if( !inode || inode->ref_count != 0 )
 		return -1;
 	// file->ref_count should be 0 [ Make sure Upper layers ] 
+	hash_remove(sb, inode);
+	pcache_invalidate(inode);
         inode->is_valid = 0;
         inode->filename[0] ='\0';
-        inode->max_pos = inode->s_pos;
+	flat_release_extents(inode);
         inode->file_size = 0;
 	inode->mode = 0;
 
+	inode->hash_next = sb->free_inode;
+	sb->free_inode = inode->inode_no;
         sb->num_files -= 1;
 
         return 0;
@@ -298,25 +503,27 @@ void flat_list_all_files(struct super_block *sb, void *buf)
 }
 int flat_read(struct inode *inode, char *buf, int count, int *offp)
 {
-	// *offp is  start byte to read from the inode->s_pos
+	// *offp is start byte to read from
 	/*
-	 * s_pos is inclusive It will read data from s_pos
-	 * max_pos is exclusive means next byte will be written in max_pos
-	 * e_pos is exclusive meeans max_pos can go upto e_pos
-	 * file_size is max_pos - s_pos ; 
+	 * file_size is the number of valid bytes in the file, the store
+	 * behind it may be larger ( inode->num_pages * PAGE_SIZE )
 	 */
 
-	u64 i, size = 0, s_pos;
-    	
+	u32 size, done = 0, contig, chunk;
+	char *src;
+
         long int remain_len;
 	remain_len = (long int)inode->file_size - *offp;
 	if( remain_len <= 0 )
 		return 0;
 	size = ( count > remain_len ? remain_len : count );
-        s_pos = inode->s_pos;
-	for( i=0 ; i<size ; i++)
+
+	while(done < size)
 	{
-		buf[i] = *(char *)(s_pos+ *offp + i);
+		src = flat_addr(inode, *offp + done, &contig);
+		chunk = (size - done > contig) ? contig : size - done;
+		fast_memcpy(buf + done, src, chunk);
+		done += chunk;
 	}
 
 	return size;
@@ -324,27 +531,123 @@ int flat_read(struct inode *inode, char *buf, int count, int *offp)
 
 int flat_write(struct inode *inode, char *buf, int count, int *offp)
 {
-	u64 i, size, s_pos;
+	u32 done = 0, contig, chunk;
+	char *dst;
 
-	long int max_len;
-        max_len = (long int)inode->e_pos - *offp - (long int)inode->s_pos;
+	if( count < 0 || flat_grow(inode, *offp + count) < 0 )
+	{
+		return -1; // file store exhausted
+	}
 
-	if( count > max_len )
+	while(done < count)
 	{
-		return -1; // file_size exceeded
+		dst = flat_addr(inode, *offp + done, &contig);
+		chunk = (count - done > contig) ? contig : count - done;
+		fast_memcpy(dst, buf + done, chunk);
+		done += chunk;
 	}
-        s_pos = inode->s_pos;
-        for( i=0 ; i<count ; i++)
-        {
-		*(char *)(s_pos + *offp + i) = buf[i];
-        }
 
-	if( inode->s_pos + *offp + count > inode->max_pos )
-		inode->max_pos = inode->s_pos + *offp + count;
-	inode->file_size = inode->max_pos - inode->s_pos;
+	if( *offp + count > inode->file_size )
+		inode->file_size = *offp + count;
         return count;
 }
 
+/*
+ * Address of byte pos of the file in the store. *len is trimmed to the bytes
+ * that are valid and contiguous from there, 0 at or past end of file.
+ */
+char *flat_map(struct inode *inode, u32 pos, u32 *len)
+{
+	u32 contig;
+	char *addr;
+
+	if( pos >= inode->file_size )
+	{
+		*len = 0;
+		return NULL;
+	}
+	addr = flat_addr(inode, pos, &contig);
+	if( contig > inode->file_size - pos )
+		contig = inode->file_size - pos;
+	if( *len > contig )
+		*len = contig;
+	return addr;
+}
+
+static void flat_copy_range(struct inode *dst, u32 dpos, struct inode *src, u32 spos, u32 count)
+{
+	u32 done = 0, dcontig, scontig, chunk;
+	char *to, *from;
+
+	while(done < count)
+	{
+		to = flat_addr(dst, dpos + done, &dcontig);
+		from = flat_addr(src, spos + done, &scontig);
+		chunk = count - done;
+		if( chunk > dcontig )
+			chunk = dcontig;
+		if( chunk > scontig )
+			chunk = scontig;
+		fast_memcpy(to, from, chunk);
+		done += chunk;
+	}
+}
+
+/*
+ * Copy count bytes from src at *src_offp to dst at *dst_offp, store to store.
+ * Like flat_read/flat_write the offsets are not advanced. Returns the bytes
+ * copied (short at end of src) or -1 if dst can not grow.
+ */
+int flat_copy(struct inode *dst, int *dst_offp, struct inode *src, int *src_offp, int count)
+{
+	u32 dpos = *dst_offp, spos = *src_offp, size, gap, chunk, left;
+	long int remain_len;
+
+	remain_len = (long int)src->file_size - spos;
+	if( count < 0 || remain_len <= 0 )
+		return count < 0 ? -1 : 0;
+	size = ( count > remain_len ? remain_len : count );
+
+	if( flat_grow(dst, dpos + size) < 0 )
+		return -1;
+
+	if( dst != src || dpos + size <= spos || spos + size <= dpos )
+	{
+		flat_copy_range(dst, dpos, src, spos, size);
+	}
+	else if( dpos < spos )
+	{
+		// overlapping copy within a file: chunks no longer than the gap never
+		// overwrite bytes that are still to be read
+		gap = spos - dpos;
+		for(left = 0; left < size; left += chunk)
+		{
+			chunk = (size - left > gap) ? gap : size - left;
+			flat_copy_range(dst, dpos + left, src, spos + left, chunk);
+		}
+	}
+	else if( dpos > spos )
+	{
+		gap = dpos - spos;
+		for(left = size; left > 0; left -= chunk)
+		{
+			chunk = (left > gap) ? gap : left;
+			flat_copy_range(dst, dpos + left - chunk, src, spos + left - chunk, chunk);
+		}
+	}
+
+	if( dpos + size > dst->file_size )
+		dst->file_size = dpos + size;
+	return size;
+}
+
+/* Is pfn a frame of the file store? */
+int flat_store_pfn(u64 pfn)
+{
+	u64 first = super_block->store_start >> PAGE_SHIFT;
+	return pfn >= first && pfn < first + super_block->store_pages;
+}
+
 static int get_inode(struct inode *inode)
 {
          inode->ref_count ++;
@@ -40,6 +40,30 @@
 #define SYSCALL_MSG_QUEUE_RCV 35
 #define SYSCALL_MSG_QUEUE_SEND 36
 #define SYSCALL_MSG_QUEUE_CLOSE 37
+#define SYSCALL_MEMOPS_BENCH 39
+#define SYSCALL_MMAP_FILE   40
+#define SYSCALL_READV       41
+#define SYSCALL_WRITEV      42
+#define SYSCALL_PREAD       43
+#define SYSCALL_PWRITE      44
+#define SYSCALL_PREADV      45
+#define SYSCALL_PWRITEV     46
+#define SYSCALL_MSG_QUEUE_RCV_WAIT 47
+#define SYSCALL_MSG_QUEUE_SEND_WAIT 48
+#define SYSCALL_MSG_QUEUE_SEND_BATCH 49
+#define SYSCALL_MSG_QUEUE_RCV_BATCH 50
+#define SYSCALL_MSG_QUEUE_SEND_BUF 51
+#define SYSCALL_MSG_QUEUE_RCV_BUF 52
+#define SYSCALL_MSG_QUEUE_SUBSCRIBE 53
+#define SYSCALL_PIPE2       54
+#define SYSCALL_SPLICE      55
+#define SYSCALL_TEE         56
+#define SYSCALL_POLL        57
+#define SYSCALL_SYSCALL_STATS 58
+#define SYSCALL_SHM_CHANNEL_CREATE 59
+#define SYSCALL_SHM_CHANNEL_MAP 60
+#define SYSCALL_SHM_CHANNEL_WAIT 61
+#define SYSCALL_SHM_CHANNEL_WAKE 62
 
 //Error numbers. must be used by appending a unary ,minus
 
@@ -49,6 +73,7 @@
 #define EACCES 4
 #define ENOMEM 5
 #define EOTHERS 6
+#define EMFILE 7	// descriptor table full
 
 #define MAX_WRITE_LEN 1024
 #define MAX_EXPAND_PAGES 1024
@@ -67,6 +92,10 @@ struct os_stats{
 	u64 mmap_page_faults;
 	u64 user_reg_pages; // used to check copy-on-write 
 	u64 file_objects;
+	/* stats lives in a 128 byte os_alloc chunk, no room past this point */
+	u64 pcache_hits;
+	u64 pcache_misses;
+	u64 pcache_writebacks;
 };
 extern struct os_stats *stats;
 struct os_configs{
@@ -79,6 +108,11 @@ struct os_configs{
 extern struct os_configs *config;
 
 extern long do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4);
+
+#define WAKE_ALL 0xffffffff	// wait_wake() every waiter on the channel
+extern void wait_park(struct exec_context *ctx, void *chan, u32 timeout);
+extern int wait_unpark(struct exec_context *ctx, u32 *timeout);
+extern struct exec_context *wait_wake(void *chan, u32 pid);
 extern int handle_div_by_zero(struct user_regs *regs);
 extern int handle_page_fault(struct user_regs *regs);
 
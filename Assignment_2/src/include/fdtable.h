@@ -0,0 +1,37 @@
+#ifndef __FDTABLE_H_
+#define __FDTABLE_H_
+
+#include<types.h>
+#include<context.h>
+#include<memory.h>
+#include<file.h>
+
+#define FD_TABLE_MAX 1024	// descriptors per process, less than 64 bitmap words
+#define FD_WORDS (FD_TABLE_MAX / 64)
+#define FD_CHUNK_FILES (PAGE_SIZE / sizeof(struct file *))	// 512 slots per page
+#define FD_CHUNKS ((FD_TABLE_MAX - MAX_OPEN_FILES + FD_CHUNK_FILES - 1) / FD_CHUNK_FILES)
+
+/*
+ * Descriptor table of a process. The first MAX_OPEN_FILES descriptors are
+ * ctx->files[] itself (the binaries use it directly); the rest live in
+ * pages allocated as the table grows. A bit per descriptor says whether it
+ * is in use, and a summary bit per bitmap word says whether the word is
+ * full, so the lowest free descriptor is found with two bsf.
+ */
+struct fd_table{
+	u32 valid;			// built for the process that has this pid
+	u64 full;			// bit w set if used[w] is all ones
+	u64 used[FD_WORDS];
+	struct file **chunks[FD_CHUNKS];	// fd MAX_OPEN_FILES + i, FD_CHUNK_FILES per page
+};
+
+extern struct file *fd_get(struct exec_context *ctx, int fd);
+extern int fd_alloc(struct exec_context *ctx, int lowest);
+extern int fd_install(struct exec_context *ctx, int fd, struct file *filep);
+extern struct file *fd_clear(struct exec_context *ctx, int fd);
+extern int fd_next(struct exec_context *ctx, int fd);
+extern void fd_table_fork(struct exec_context *parent, struct exec_context *child);
+extern void fd_table_vfork(struct exec_context *parent);
+extern void fd_table_exit(struct exec_context *ctx);
+
+#endif
@@ -22,6 +22,7 @@ enum{
 	REGULAR,
 	PIPE,
 	MSG_QUEUE,
+	SHM_CHANNEL,
 	MAX_FILE_TYPE,
 };
 
@@ -38,9 +39,10 @@ struct file{
 	u32 offp;
 	u32 ref_count;
 	struct inode * inode;
-	struct fileops * fops;
+	const struct fileops * fops;	// shared by all files of a type
 	struct pipe_info * pipe;
 	struct msg_queue_info *msg_queue;
+	struct shm_channel *shm;
 };
 
 struct fileops{
@@ -48,10 +50,34 @@ struct fileops{
 	int (*write)(struct file *filep, char * buff, u32 count); //seek implementation
 	long (*lseek)(struct file *filep, long offset, int whence);
 	long (*close)(struct file *filep);
+	// positioned I/O, the file offset is neither used nor moved. NULL if not seekable
+	int (*pread)(struct file *filep, char * buff, u32 count, u32 pos);
+	int (*pwrite)(struct file *filep, char * buff, u32 count, u32 pos);
+};
+
+#define IOV_MAX 64
+
+struct iovec{
+	void *iov_base;
+	u64 iov_len;
+};
+
+// poll events; POLLERR, POLLHUP and POLLNVAL are reported even if not asked for
+#define POLLIN   0x1
+#define POLLOUT  0x4
+#define POLLERR  0x8
+#define POLLHUP  0x10	// the other end of a pipe is gone
+#define POLLNVAL 0x20	// fd is not open
+
+struct pollfd{
+	int fd;
+	short events;
+	short revents;
 };
 
 //STDIO handlers and functions
-extern struct file *alloc_file();
+extern struct file *alloc_file_ops(const struct fileops *ops);
+extern void free_file_object(struct file *filep);
 extern void *alloc_memory_buffer();
 extern struct file* create_standard_IO(int);
 extern int open_standard_IO(struct exec_context *ctx, int type);
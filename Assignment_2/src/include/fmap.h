@@ -0,0 +1,43 @@
+#ifndef __FMAP_H_
+#define __FMAP_H_
+
+#include<types.h>
+#include<context.h>
+#include<fs.h>
+
+#define MAX_FILE_MAPS 128
+
+#define MAP_PRIVATE 0
+#define MAP_SHARED 4	// next to MAP_FIXED and MAP_POPULATE in mmap.h
+
+/* Argument of SYSCALL_MMAP_FILE, too many for the four syscall registers */
+struct mmap_file_args{
+	u64 addr;
+	u32 length;
+	u32 prot;
+	u32 flags;	// MAP_FIXED, MAP_SHARED
+	int fd;
+	u64 offset;	// must be page aligned
+};
+
+/*
+ * The vm_area of a file mapping is an ordinary one (its layout is fixed by
+ * mmap.o); what backs it is remembered here, one slot per mapped range.
+ */
+struct file_map{
+	u32 pid;		// owner, 0 if the slot is free
+	u32 flags;		// MAP_SHARED or MAP_PRIVATE
+	u32 access;		// PTE write bit of a MAP_SHARED mapping
+	u64 start;
+	u64 end;
+	struct inode *inode;
+	u32 pgoff;		// file page mapped at start
+};
+
+extern long do_mmap_file(struct exec_context *ctx, struct mmap_file_args *args);
+extern void file_map_unmap(struct exec_context *ctx, u64 addr, int length);
+extern int file_map_overlaps(struct exec_context *ctx, u64 addr, int length);
+extern void file_map_fork(struct exec_context *parent, struct exec_context *child);
+extern void file_map_exit(struct exec_context *ctx);
+
+#endif
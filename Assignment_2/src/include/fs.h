@@ -1,11 +1,21 @@
 #ifndef __FS_H_
 #define __FS_H_
 
-#define NUM_FILES 32
+#define NUM_FILES 1024
+#define NAME_HASH_BUCKETS 256   // power of two
 #define END 0x80000000
-// #define FILE_SIZE 0x10// 16KB
-#define FILE_SIZE 0x1000 // In Bytes
 
+#define FILE_STORE_PAGES 0x800  // pages of FILE_STORE_REG managed by the extent allocator (8MB)
+#define MAX_EXTENTS 16          // extents a single file can be made of
+
+/*
+ * A run of contiguous pages in the file store.
+ * start is the page index relative to sb->store_start
+ */
+struct extent{
+	u32 start;
+	u32 num_pages;
+};
 
 struct inode{
 	int is_valid;
@@ -14,10 +24,15 @@ struct inode{
 	u32 type;
 	u32 inode_no;
 	u32 ref_count;
-	unsigned int s_pos;     //starting position of file
-	unsigned int e_pos;     //ending position of file[ Max_File_Size]
-	unsigned int max_pos;   // ending position of file data
+	u32 name_hash;
+	int hash_next;          // next inode in the name hash chain (free list if !is_valid)
 	unsigned int file_size;  // file_size
+	u32 num_pages;           // pages allocated to the file across all extents
+	u32 num_extents;
+	struct extent extents[MAX_EXTENTS];
+	u32 cached_pages;        // pages of the file in the page cache
+	u32 ra_next;             // page a sequential reader asks for next
+	u32 map_count;           // live mmap()s of the file, bypass the page cache if set
 	struct super_block *sb;
 
 	int (*read) (struct inode *inode, char *buf, int count, int *offp);
@@ -32,6 +47,14 @@ struct super_block{
 	char *fs_name;		//Name
 	struct inode* inode[NUM_FILES];
 	struct sb_operations *sb_op;
+
+	int name_hash[NAME_HASH_BUCKETS];	// head inode number of each chain, -1 if empty
+	int free_inode;				// head of the free inode list, -1 if none
+
+	u64 store_start;	// first byte of the extent arena
+	u32 store_pages;	// pages in the extent arena
+	u32 free_pages;		// pages not owned by any file
+	u64 *store_bitmap;	// one bit per arena page, set if in use
 };
 
 
@@ -54,6 +77,10 @@ void flat_list_all_files (struct super_block *sb, void *buf );
 
 int flat_read(struct inode *inode, char *buf, int count, int *offp);
 int flat_write(struct inode *inode, char *buf, int count, int *offp);
+int flat_reserve(struct inode *inode, u32 size);
+int flat_copy(struct inode *dst, int *dst_offp, struct inode *src, int *src_offp, int count);
+char *flat_map(struct inode *inode, u32 pos, u32 *len);
+int flat_store_pfn(u64 pfn);
 int flat_open(struct inode* inode);
 int flat_close(struct inode *inode);
 
@@ -0,0 +1,45 @@
+#ifndef __MEMOPS_H_
+#define __MEMOPS_H_
+
+#include <types.h>
+#include <context.h>
+
+/* Copy/zero implementations, in order of preference */
+enum{
+	MEMOPS_BYTE,
+	MEMOPS_WORD,
+	MEMOPS_REP_MOVSQ,
+	MEMOPS_REP_MOVSB,
+	MEMOPS_SSE,
+	MEMOPS_AVX,
+	MAX_MEMOPS
+};
+
+/* Copies shorter than this always use the 8-byte loop */
+#define MEMOPS_SMALL 64
+
+/*
+ * Argument of the memops benchmark system call. The caller fills
+ * src, dst, size and iterations; the kernel fills the rest. src and dst
+ * must lie in the caller's own memory, readable and writable respectively.
+ */
+#define MEMOPS_BENCH_MAX_SIZE (2 << 20)
+#define MEMOPS_BENCH_MAX_ITERATIONS 1024
+
+struct memops_bench{
+	u64 src;
+	u64 dst;
+	u64 size;
+	u64 iterations;
+	u64 available;		// bitmap of implementations usable on this CPU
+	u64 selected;		// implementation behind fast_memcpy/fast_bzero
+	u64 copy_cycles[MAX_MEMOPS];
+	u64 zero_cycles[MAX_MEMOPS];
+};
+
+extern void memops_init();
+extern void fast_memcpy(char *dst, char *src, u64 count);
+extern void fast_bzero(char *dst, u64 count);
+extern int user_range_ok(struct exec_context *ctx, u64 addr, u64 size, u32 access);
+extern long do_memops_bench(struct exec_context *current, struct memops_bench *bench);
+#endif
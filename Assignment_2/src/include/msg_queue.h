@@ -5,8 +5,11 @@
 #include <context.h>
 
 #define MAX_TXT_SIZE 24 
-#define MAX_MEMBERS 4 
+#define MAX_MEMBERS 64 
 #define BROADCAST_PID 0xffffffff 
+#define MAX_TOPICS 64
+#define TOPIC_PID(t) (0xffffff00 + (t))	// to_pid of a message to subscribers of topic t
+#define IS_TOPIC_PID(pid) ((pid) >= TOPIC_PID(0) && (pid) < TOPIC_PID(MAX_TOPICS))
 
 struct message{
 
@@ -17,6 +20,17 @@ struct message{
 	char msg_txt[MAX_TXT_SIZE];
 };
 
+#define MSG_MAP 1	// msg_buf flag: map a page payload instead of copying it
+
+/* Variable length message, as passed to and from user space */
+struct msg_buf{
+	u32 from_pid;
+	u32 to_pid;
+	u32 len;		// payload bytes, on receive the room in data first
+	u32 flags;		// MSG_MAP
+	char *data;		// a MSG_MAP receive points it at the mapped page
+};
+
 struct msg_queue_info{
 	// define all the data structures
 	// you need to maintain the message queue
@@ -36,7 +50,13 @@ extern void do_msg_queue_cleanup(struct exec_context *ctx);
 extern int do_msg_queue_get_member_info(struct exec_context *ctx, struct file *filep, struct msg_queue_member_info *info);
 extern int do_msg_queue_send(struct exec_context *ctx, struct file *filep, struct message *msg);
 extern int do_msg_queue_rcv(struct exec_context *ctx, struct file *filep, struct message *msg);
+extern int do_msg_queue_send_batch(struct exec_context *ctx, struct file *filep, struct message *msgs, int count);
+extern int do_msg_queue_rcv_batch(struct exec_context *ctx, struct file *filep, struct message *msgs, int count);
+extern int do_msg_queue_send_buf(struct exec_context *ctx, struct file *filep, struct msg_buf *buf);
+extern int do_msg_queue_rcv_buf(struct exec_context *ctx, struct file *filep, struct msg_buf *buf);
 extern int do_get_msg_count(struct exec_context *ctx, struct file *filep);
 extern int do_msg_queue_block(struct exec_context *ctx, struct file *filep, int pid);
+extern int do_msg_queue_subscribe(struct exec_context *ctx, struct file *filep, int topic, int on);
+extern int do_msg_queue_poll(struct exec_context *ctx, struct file *filep);
 extern int do_msg_queue_close(struct exec_context *ctx, int fd);
 #endif
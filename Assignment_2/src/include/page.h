@@ -9,7 +9,7 @@ struct pfn_info_list{
 	void * end;
 };
 
-struct pfn_info_list list_pfn_info;
+extern struct pfn_info_list list_pfn_info;	// common symbol, allocated by the linker
 
 struct pfn_info * get_pfn_info(u32 index);
 
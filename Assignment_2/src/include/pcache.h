@@ -0,0 +1,43 @@
+#ifndef __PCACHE_H_
+#define __PCACHE_H_
+
+#include <types.h>
+#include <fs.h>
+
+#define PCACHE_PAGES 256	// frames of FILE_DS_REG held by the page cache (1MB)
+#define PCACHE_BUCKETS 128	// power of two
+#define PCACHE_READAHEAD 4	// pages fetched ahead on a sequential miss
+
+#define PCACHE_VALID 0x1
+#define PCACHE_DIRTY 0x2
+
+/*
+ * One cached page of a regular file, identified by (inode, index).
+ * Frames are linked into a hash chain for lookup and into a doubly
+ * linked LRU list, both by frame number (-1 terminates).
+ */
+struct pcache_page{
+	struct inode *inode;
+	u32 index;		// page number within the file
+	u32 flags;
+	int hash_next;		// next frame in the chain, free list if !PCACHE_VALID
+	int lru_prev;		// towards the most recently used frame
+	int lru_next;		// towards the eviction candidate
+};
+
+struct page_cache{
+	char *frames;		// PCACHE_PAGES contiguous pages, frame i at i * PAGE_SIZE
+	int buckets[PCACHE_BUCKETS];
+	int lru_head;		// most recently used
+	int lru_tail;		// least recently used, evicted first
+	int free;		// head of the free frame list
+	struct pcache_page pages[PCACHE_PAGES];
+};
+
+extern void pcache_init();
+extern int pcache_read(struct inode *inode, char *buf, int count, int *offp);
+extern int pcache_write(struct inode *inode, char *buf, int count, int *offp);
+extern void pcache_flush(struct inode *inode);
+extern void pcache_invalidate(struct inode *inode);
+
+#endif
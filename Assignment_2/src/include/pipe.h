@@ -6,22 +6,45 @@
 #include "file.h"
 
 
-#define PIPE_MAX_SIZE 4096
+#define PIPE_MAX_SIZE 4096	// capacity of pipe(), pipe2() with size 0
+#define PIPE_MAX_PAGES 16	// largest ring
+#define PIPE_WAIT 0x1		// pipe2() flag: reads and writes park instead of failing
 
-/** Pipe information structure */
+/*
+ * Pipe information structure. The buffer is a ring of size bytes (a power
+ * of two, at least a page) spread over separately allocated pages. head and
+ * tail run freely and are masked on use, so tail - head is what is in the
+ * pipe and a full ring needs no spare byte.
+ */
 struct pipe_info{
-	int read_pos;       //Last Read position
-	int write_pos;      // Last Write position
-	char* pipe_buff;    // pipe buffer
-	int buffer_offset;  // current buffer length
+	char *pages[PIPE_MAX_PAGES];	// page i holds ring bytes [i * PAGE_SIZE, (i + 1) * PAGE_SIZE)
+	u32 size;
+	u32 mask;		// size - 1
+	u32 head;		// next byte read
+	u32 tail;		// next byte written
+	u32 flags;		// PIPE_WAIT
 	int is_ropen;
 	int is_wopen;
 };
 
+/* Readers of a pipe wait on the pipe, writers a byte up */
+#define PIPE_CHANNEL(pipe, writing) ((char *)(pipe) + ((writing) ? 1 : 0))
 
-/*int pipe_read(struct file *filep, char * buff, u32 count);
-int pipe_write(struct file *filep, char * buff, u32 count);
-int pipe_close(struct file *filep);*/
-extern int create_pipe(struct exec_context *current, int *fd);
+static inline u32 pipe_count(struct pipe_info *pipe)
+{
+	return pipe->tail - pipe->head;
+}
+
+static inline u32 pipe_space(struct pipe_info *pipe)
+{
+	return pipe->size - pipe_count(pipe);
+}
+
+extern int pipe_read(struct file *filep, char * buff, u32 count);
+extern int pipe_write(struct file *filep, char * buff, u32 count);
+extern long pipe_close(struct file *filep);
+extern int create_pipe(struct exec_context *current, int *fd, u32 size, u32 flags);
+extern int pipe_splice(struct file *in, struct file *out, u32 count);
+extern int pipe_tee(struct file *in, struct file *out, u32 count);
 
 #endif
@@ -0,0 +1,66 @@
+#ifndef __SHM_CHANNEL_H_
+#define __SHM_CHANNEL_H_
+
+#include <types.h>
+#include <context.h>
+#include <file.h>
+
+#define SHM_CHANNEL_PAGES 16	// largest mapping, the ring header included
+#define SHM_CACHE_LINE 64
+#define SHM_RING_DATA 256	// offset of slot 0 in the mapping
+
+/* what shm_channel_wait() waits for */
+#define SHM_WAIT_DATA  0x1	// consumer, the ring is empty
+#define SHM_WAIT_SPACE 0x2	// producer, the ring is full
+
+/*
+ * Start of the shared mapping. The consumer only writes head and the
+ * producer only tail, each on a cache line of its own so that the two
+ * sides do not pass a line back and forth on every message. slots and
+ * slot_size are for user space; the kernel keeps its own copies. waiting
+ * is set by the kernel for a side that parks and cleared by the wake.
+ * A slot is a u32 length followed by the message.
+ */
+struct shm_ring{
+	u32 head;		// next slot read, free running
+	u8 pad_head[SHM_CACHE_LINE - sizeof(u32)];
+	u32 tail;		// next slot written
+	u8 pad_tail[SHM_CACHE_LINE - sizeof(u32)];
+	u32 slots;		// a power of two
+	u32 slot_size;		// bytes, the length word included
+	u32 waiting;		// SHM_WAIT_*
+};
+
+struct shm_channel{
+	u32 pfns[SHM_CHANNEL_PAGES];	// user pages, each with a reference held by the channel
+	u32 pages;
+	u32 slots;
+	u32 slot_size;
+	struct shm_ring *ring;		// kernel address of the first page
+};
+
+/*
+ * Where a process has a channel mapped, so that cfork (which makes every
+ * user page copy-on-write) can make the mapping shared again. A channel
+ * can be closed while mapped, so the pages are remembered here too.
+ */
+#define MAX_SHM_MAPS 32
+
+struct shm_map{
+	u32 pid;			// 0 if the slot is free
+	u32 pages;
+	u64 addr;
+	u32 pfns[SHM_CHANNEL_PAGES];
+};
+
+/* The consumer waits on the channel, the producer a byte up */
+#define SHM_CHANNEL_WAITQ(shm, space) ((char *)(shm) + ((space) ? 1 : 0))
+
+extern int do_shm_channel_create(struct exec_context *ctx, u32 slots, u32 slot_size);
+extern long do_shm_channel_map(struct exec_context *ctx, struct file *filep);
+extern int do_shm_channel_wait(struct file *filep, u32 what);
+extern int do_shm_channel_wake(struct file *filep);
+extern void shm_channel_unmap(struct exec_context *ctx, u64 addr, int length);
+extern void shm_channel_fork(struct exec_context *parent, struct exec_context *child);
+extern void shm_channel_exit(struct exec_context *ctx);
+#endif
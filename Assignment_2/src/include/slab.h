@@ -0,0 +1,40 @@
+#ifndef __SLAB_H_
+#define __SLAB_H_
+
+#include <types.h>
+
+/*
+ * Slab caches for small kernel objects of one type. A slab is one
+ * OS_DS_REG page: a struct slab header followed by as many objects as fit.
+ * Free objects of a slab are chained through their first eight bytes.
+ */
+struct slab_cache{
+	char *name;
+	u32 size;			// object size, a multiple of 8
+	void (*ctor)(void *obj);	// run on every object handed out, may be NULL
+	struct slab *partial;		// slabs with a free object
+	struct slab_cache *next;	// registered caches, for slab_stats()
+	u32 registered;
+	u32 slabs;			// pages held by the cache
+	u32 active;			// objects in use
+	u32 empty;			// slabs with no object in use (at most one is kept)
+};
+
+struct slab{
+	struct slab_cache *cache;
+	struct slab *prev;		// partial list
+	struct slab *next;
+	void *free;			// free objects of this slab
+	u32 inuse;
+};
+
+#define SLAB_CACHE(_name, _type, _ctor) { \
+	.name = _name, \
+	.size = (sizeof(_type) + 7) & ~7UL, \
+	.ctor = _ctor, \
+}
+
+extern void *slab_alloc(struct slab_cache *cache);
+extern void slab_free(void *obj);
+extern void slab_stats();
+#endif
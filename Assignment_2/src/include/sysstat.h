@@ -0,0 +1,47 @@
+#ifndef __SYSSTAT_H_
+#define __SYSSTAT_H_
+
+#include <types.h>
+#include <file.h>
+#include <context.h>
+
+#define MAX_SYSCALLS 64		// syscall numbers accounted, larger ones are dropped
+#define LATENCY_BUCKETS 40	// bucket b holds calls of [2^b, 2^(b+1)) cycles
+
+/*
+ * Latency of one system call number. The kernel keeps a log2 histogram per
+ * call; p50 and p99 are the upper bounds (in cycles) of the buckets the
+ * median and the 99th percentile fall in.
+ */
+struct syscall_stat{
+	u64 count;
+	u64 cycles;
+	u64 p50;
+	u64 p99;
+};
+
+/* read/write traffic per file type, message queue messages count as bytes sent or received */
+struct file_io_stat{
+	u64 reads;
+	u64 read_bytes;
+	u64 writes;
+	u64 write_bytes;
+};
+
+/* Argument of the syscall stats system call, filled by the kernel */
+struct syscall_stats{
+	struct syscall_stat calls[MAX_SYSCALLS];
+	struct file_io_stat files[MAX_FILE_TYPE];
+};
+
+static inline u64 rdtsc()
+{
+	u32 lo, hi;
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((u64)hi << 32) | lo;
+}
+
+extern void syscall_account(int syscall, u64 cycles);
+extern void file_account(struct file *filep, int write, long bytes);
+extern long do_syscall_stats(struct exec_context *ctx, struct syscall_stats *buf, int reset);
+#endif
@@ -0,0 +1,368 @@
+#include<types.h>
+#include<lib.h>
+#include<context.h>
+#include<memops.h>
+
+/*
+ * Bulk copy and zero routines. The implementation is picked once from
+ * CPUID (the first call does it if memops_init was not called at boot).
+ * SSE/AVX variants save and restore the vector registers they use since
+ * the kernel does not own the FPU state of the interrupted process.
+ */
+
+static int selected = -1;
+static u64 available;
+
+static inline u64 rdtsc()
+{
+	u32 lo, hi;
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((u64)hi << 32) | lo;
+}
+
+static void cpuid(u32 leaf, u32 subleaf, u32 *a, u32 *b, u32 *c, u32 *d)
+{
+	asm volatile("cpuid"
+		: "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+		: "a"(leaf), "c"(subleaf));
+}
+
+/************************************ copy ****************************************/
+
+static void copy_byte(char *dst, char *src, u64 count)
+{
+	u64 i;
+	for(i = 0; i < count; i++)
+		dst[i] = src[i];
+}
+
+static void copy_word(char *dst, char *src, u64 count)
+{
+	while(count >= 8)
+	{
+		*(u64 *)dst = *(u64 *)src;
+		dst += 8;
+		src += 8;
+		count -= 8;
+	}
+	while(count--)
+		*dst++ = *src++;
+}
+
+static void copy_movsq(char *dst, char *src, u64 count)
+{
+	u64 qwords = count >> 3, tail = count & 7;
+	asm volatile("rep movsq"
+		: "+D"(dst), "+S"(src), "+c"(qwords)
+		:: "memory");
+	asm volatile("rep movsb"
+		: "+D"(dst), "+S"(src), "+c"(tail)
+		:: "memory");
+}
+
+static void copy_movsb(char *dst, char *src, u64 count)
+{
+	asm volatile("rep movsb"
+		: "+D"(dst), "+S"(src), "+c"(count)
+		:: "memory");
+}
+
+static void copy_sse(char *dst, char *src, u64 count)
+{
+	char save[64] __attribute__((aligned(16)));
+	u64 blocks = count >> 6;
+
+	if(blocks)
+	{
+		asm volatile(
+			"movdqa %%xmm0, 0(%[save]);"
+			"movdqa %%xmm1, 16(%[save]);"
+			"movdqa %%xmm2, 32(%[save]);"
+			"movdqa %%xmm3, 48(%[save]);"
+			"1:"
+			"movdqu 0(%[src]), %%xmm0;"
+			"movdqu 16(%[src]), %%xmm1;"
+			"movdqu 32(%[src]), %%xmm2;"
+			"movdqu 48(%[src]), %%xmm3;"
+			"movdqu %%xmm0, 0(%[dst]);"
+			"movdqu %%xmm1, 16(%[dst]);"
+			"movdqu %%xmm2, 32(%[dst]);"
+			"movdqu %%xmm3, 48(%[dst]);"
+			"add $64, %[src];"
+			"add $64, %[dst];"
+			"dec %[blocks];"
+			"jnz 1b;"
+			"movdqa 0(%[save]), %%xmm0;"
+			"movdqa 16(%[save]), %%xmm1;"
+			"movdqa 32(%[save]), %%xmm2;"
+			"movdqa 48(%[save]), %%xmm3;"
+			: [src]"+r"(src), [dst]"+r"(dst), [blocks]"+r"(blocks)
+			: [save]"r"(save)
+			: "memory", "cc");
+	}
+	copy_word(dst, src, count & 63);
+}
+
+static void copy_avx(char *dst, char *src, u64 count)
+{
+	char save[128] __attribute__((aligned(32)));
+	u64 blocks = count >> 7;
+
+	if(blocks)
+	{
+		asm volatile(
+			"vmovdqa %%ymm0, 0(%[save]);"
+			"vmovdqa %%ymm1, 32(%[save]);"
+			"vmovdqa %%ymm2, 64(%[save]);"
+			"vmovdqa %%ymm3, 96(%[save]);"
+			"1:"
+			"vmovdqu 0(%[src]), %%ymm0;"
+			"vmovdqu 32(%[src]), %%ymm1;"
+			"vmovdqu 64(%[src]), %%ymm2;"
+			"vmovdqu 96(%[src]), %%ymm3;"
+			"vmovdqu %%ymm0, 0(%[dst]);"
+			"vmovdqu %%ymm1, 32(%[dst]);"
+			"vmovdqu %%ymm2, 64(%[dst]);"
+			"vmovdqu %%ymm3, 96(%[dst]);"
+			"add $128, %[src];"
+			"add $128, %[dst];"
+			"dec %[blocks];"
+			"jnz 1b;"
+			"vmovdqa 0(%[save]), %%ymm0;"
+			"vmovdqa 32(%[save]), %%ymm1;"
+			"vmovdqa 64(%[save]), %%ymm2;"
+			"vmovdqa 96(%[save]), %%ymm3;"
+			: [src]"+r"(src), [dst]"+r"(dst), [blocks]"+r"(blocks)
+			: [save]"r"(save)
+			: "memory", "cc");
+	}
+	copy_word(dst, src, count & 127);
+}
+
+/************************************ zero ****************************************/
+
+static void zero_byte(char *dst, u64 count)
+{
+	u64 i;
+	for(i = 0; i < count; i++)
+		dst[i] = 0;
+}
+
+static void zero_word(char *dst, u64 count)
+{
+	while(count >= 8)
+	{
+		*(u64 *)dst = 0;
+		dst += 8;
+		count -= 8;
+	}
+	while(count--)
+		*dst++ = 0;
+}
+
+static void zero_stosq(char *dst, u64 count)
+{
+	u64 qwords = count >> 3, tail = count & 7;
+	asm volatile("rep stosq"
+		: "+D"(dst), "+c"(qwords)
+		: "a"(0UL)
+		: "memory");
+	asm volatile("rep stosb"
+		: "+D"(dst), "+c"(tail)
+		: "a"(0UL)
+		: "memory");
+}
+
+static void zero_stosb(char *dst, u64 count)
+{
+	asm volatile("rep stosb"
+		: "+D"(dst), "+c"(count)
+		: "a"(0UL)
+		: "memory");
+}
+
+static void zero_sse(char *dst, u64 count)
+{
+	char save[16] __attribute__((aligned(16)));
+	u64 blocks = count >> 6;
+
+	if(blocks)
+	{
+		asm volatile(
+			"movdqa %%xmm0, 0(%[save]);"
+			"pxor %%xmm0, %%xmm0;"
+			"1:"
+			"movdqu %%xmm0, 0(%[dst]);"
+			"movdqu %%xmm0, 16(%[dst]);"
+			"movdqu %%xmm0, 32(%[dst]);"
+			"movdqu %%xmm0, 48(%[dst]);"
+			"add $64, %[dst];"
+			"dec %[blocks];"
+			"jnz 1b;"
+			"movdqa 0(%[save]), %%xmm0;"
+			: [dst]"+r"(dst), [blocks]"+r"(blocks)
+			: [save]"r"(save)
+			: "memory", "cc");
+	}
+	zero_word(dst, count & 63);
+}
+
+static void zero_avx(char *dst, u64 count)
+{
+	char save[32] __attribute__((aligned(32)));
+	u64 blocks = count >> 7;
+
+	if(blocks)
+	{
+		asm volatile(
+			"vmovdqa %%ymm0, 0(%[save]);"
+			"vpxor %%ymm0, %%ymm0, %%ymm0;"
+			"1:"
+			"vmovdqu %%ymm0, 0(%[dst]);"
+			"vmovdqu %%ymm0, 32(%[dst]);"
+			"vmovdqu %%ymm0, 64(%[dst]);"
+			"vmovdqu %%ymm0, 96(%[dst]);"
+			"add $128, %[dst];"
+			"dec %[blocks];"
+			"jnz 1b;"
+			"vmovdqa 0(%[save]), %%ymm0;"
+			: [dst]"+r"(dst), [blocks]"+r"(blocks)
+			: [save]"r"(save)
+			: "memory", "cc");
+	}
+	zero_word(dst, count & 127);
+}
+
+/**********************************************************************************/
+
+static void (*copy_ops[MAX_MEMOPS])(char *, char *, u64) = {
+	copy_byte, copy_word, copy_movsq, copy_movsb, copy_sse, copy_avx,
+};
+
+static void (*zero_ops[MAX_MEMOPS])(char *, u64) = {
+	zero_byte, zero_word, zero_stosq, zero_stosb, zero_sse, zero_avx,
+};
+
+void memops_init()
+{
+	u32 a, b, c, d, max_leaf;
+	u64 cr4;
+
+	if(selected >= 0)
+		return;
+
+	available = (1 << MEMOPS_BYTE) | (1 << MEMOPS_WORD) | (1 << MEMOPS_REP_MOVSQ);
+
+	cpuid(0, 0, &max_leaf, &b, &c, &d);
+	cpuid(1, 0, &a, &b, &c, &d);
+	asm volatile("mov %%cr4, %0" : "=r"(cr4));
+
+	if((d & (1 << 26)) && (cr4 & (1 << 9)))		// SSE2 and CR4.OSFXSR
+		available |= (1 << MEMOPS_SSE);
+
+	if((c & (1 << 28)) && (c & (1 << 27)))		// AVX and OSXSAVE
+	{
+		u32 xcr0_lo, xcr0_hi;
+		asm volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+		if((xcr0_lo & 0x6) == 0x6)		// XMM and YMM state enabled
+			available |= (1 << MEMOPS_AVX);
+	}
+
+	if(max_leaf >= 7)
+	{
+		cpuid(7, 0, &a, &b, &c, &d);
+		if(b & (1 << 9))			// enhanced rep movsb/stosb
+			available |= (1 << MEMOPS_REP_MOVSB);
+	}
+
+	for(selected = MAX_MEMOPS - 1; !(available & (1 << selected)); selected--)
+		;
+	dprintk("memops: using implementation %d\n", selected);
+}
+
+void fast_memcpy(char *dst, char *src, u64 count)
+{
+	if(count < MEMOPS_SMALL)
+	{
+		copy_word(dst, src, count);
+		return;
+	}
+	if(selected < 0)
+		memops_init();
+	copy_ops[selected](dst, src, count);
+}
+
+void fast_bzero(char *dst, u64 count)
+{
+	if(count < MEMOPS_SMALL)
+	{
+		zero_word(dst, count);
+		return;
+	}
+	if(selected < 0)
+		memops_init();
+	zero_ops[selected](dst, count);
+}
+
+/* Is [addr, addr + size) within one segment or mmap area of ctx allowing access? */
+int user_range_ok(struct exec_context *ctx, u64 addr, u64 size, u32 access)
+{
+	struct vm_area *vma;
+	int i;
+
+	if(!addr || addr + size < addr)
+		return 0;
+	for(i = 0; i < MAX_MM_SEGS; i++)
+		if(addr >= ctx->mms[i].start && addr + size <= ctx->mms[i].end &&
+		   (ctx->mms[i].access_flags & access) == access)
+			return 1;
+	for(vma = ctx->vm_area; vma; vma = vma->vm_next)
+		if(addr >= vma->vm_start && addr + size <= vma->vm_end &&
+		   (vma->access_flags & access) == access)
+			return 1;
+	return 0;
+}
+
+/*
+ * Runs every usable implementation over the caller supplied buffers and
+ * reports the rdtsc cycles taken for bench->iterations copies/zeroings.
+ * The buffers are written from the kernel, so they (and bench itself) are
+ * checked to be user memory the caller may access first.
+ */
+long do_memops_bench(struct exec_context *current, struct memops_bench *bench)
+{
+	int op;
+	u64 i, start;
+
+	if(!user_range_ok(current, (u64)bench, sizeof(struct memops_bench), MM_RD | MM_WR))
+		return -1;
+	if(!bench->size || bench->size > MEMOPS_BENCH_MAX_SIZE ||
+	   !bench->iterations || bench->iterations > MEMOPS_BENCH_MAX_ITERATIONS)
+		return -1;
+	if(!user_range_ok(current, bench->src, bench->size, MM_RD) ||
+	   !user_range_ok(current, bench->dst, bench->size, MM_RD | MM_WR))
+		return -1;
+
+	memops_init();
+	bench->available = available;
+	bench->selected = selected;
+
+	for(op = 0; op < MAX_MEMOPS; op++)
+	{
+		bench->copy_cycles[op] = 0;
+		bench->zero_cycles[op] = 0;
+		if(!(available & (1 << op)))
+			continue;
+
+		start = rdtsc();
+		for(i = 0; i < bench->iterations; i++)
+			copy_ops[op]((char *)bench->dst, (char *)bench->src, bench->size);
+		bench->copy_cycles[op] = rdtsc() - start;
+
+		start = rdtsc();
+		for(i = 0; i < bench->iterations; i++)
+			zero_ops[op]((char *)bench->dst, bench->size);
+		bench->zero_cycles[op] = rdtsc() - start;
+	}
+	return 0;
+}
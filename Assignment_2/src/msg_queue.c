@@ -4,6 +4,7 @@
 #include <file.h>
 #include <lib.h>
 #include <entry.h>
+#include <slab.h>
 
 
 
@@ -11,10 +12,17 @@
 /***************************Do Not Modify below Functions****************************/
 /************************************************************************************/
 
+static void msg_queue_info_ctor(void *obj)
+{
+	bzero((char *)obj, sizeof(struct msg_queue_info));
+}
+
+static struct slab_cache msg_queue_cache = SLAB_CACHE("msg_queue_info", struct msg_queue_info, msg_queue_info_ctor);
+
 struct msg_queue_info *alloc_msg_queue_info()
 {
 	struct msg_queue_info *info;
-	info = (struct msg_queue_info *)os_page_alloc(OS_DS_REG);
+	info = (struct msg_queue_info *)slab_alloc(&msg_queue_cache);
 	
 	if(!info){
 		return NULL;
@@ -24,7 +32,7 @@ struct msg_queue_info *alloc_msg_queue_info()
 
 void free_msg_queue_info(struct msg_queue_info *q)
 {
-	os_page_free(OS_DS_REG, q);
+	slab_free(q);
 }
 
 struct message *alloc_buffer()
@@ -76,6 +84,42 @@ int do_msg_queue_send(struct exec_context *ctx, struct file *filep, struct messa
 	return -EINVAL;
 }
 
+int do_msg_queue_send_batch(struct exec_context *ctx, struct file *filep, struct message *msgs, int count)
+{
+	/** 
+	 * TODO Implement functionality to
+	 * send count messages, returns how many were sent
+	 **/
+	return -EINVAL;
+}
+
+int do_msg_queue_rcv_batch(struct exec_context *ctx, struct file *filep, struct message *msgs, int count)
+{
+	/** 
+	 * TODO Implement functionality to
+	 * recieve up to count messages, returns how many were recieved
+	 **/
+	return -EINVAL;
+}
+
+int do_msg_queue_send_buf(struct exec_context *ctx, struct file *filep, struct msg_buf *buf)
+{
+	/** 
+	 * TODO Implement functionality to
+	 * send a variable length message
+	 **/
+	return -EINVAL;
+}
+
+int do_msg_queue_rcv_buf(struct exec_context *ctx, struct file *filep, struct msg_buf *buf)
+{
+	/** 
+	 * TODO Implement functionality to
+	 * recieve a variable length message
+	 **/
+	return -EINVAL;
+}
+
 void do_add_child_to_msg_queue(struct exec_context *child_ctx)
 {
 	/** 
@@ -117,6 +161,24 @@ int do_msg_queue_block(struct exec_context *ctx, struct file *filep, int pid)
 	return -EINVAL;
 }
 
+int do_msg_queue_subscribe(struct exec_context *ctx, struct file *filep, int topic, int on)
+{
+	/** 
+	 * TODO Implement functionality to
+	 * subscribe to or leave a topic
+	 **/
+	return -EINVAL;
+}
+
+int do_msg_queue_poll(struct exec_context *ctx, struct file *filep)
+{
+	/** 
+	 * TODO Implement functionality to
+	 * report POLLIN/POLLOUT readiness of the queue to calling process
+	 **/
+	return -EINVAL;
+}
+
 int do_msg_queue_close(struct exec_context *ctx, int fd)
 {
 	/** 
@@ -0,0 +1,289 @@
+#include<types.h>
+#include<lib.h>
+#include<memory.h>
+#include<entry.h>
+#include<fs.h>
+#include<pcache.h>
+#include<memops.h>
+
+/*
+ * Page cache for regular files. Reads and writes of regular files go
+ * through PCACHE_PAGES frames taken from FILE_DS_REG at boot; the file
+ * store is only touched to fill a missing page or to write a dirty one
+ * back. Writes reserve their store pages up front (flat_reserve), so a
+ * writeback can never run out of space.
+ *
+ * Anything that reads or writes the store directly (sendfile, file
+ * mappings) must pcache_flush() the inode first, and pcache_invalidate()
+ * it after writing to the store. Mapped files (map_count) are not cached.
+ */
+
+extern u64 get_contigous_pages(u32 region, int number_of_pages);
+
+static struct page_cache *pcache;
+
+static u32 pcache_bucket(struct inode *inode, u32 index)
+{
+	return (inode->inode_no * 31 + index) & (PCACHE_BUCKETS - 1);
+}
+
+static char *pcache_data(int frame)
+{
+	return pcache->frames + ((u64)frame << PAGE_SHIFT);
+}
+
+static void lru_unlink(int frame)
+{
+	struct pcache_page *page = &pcache->pages[frame];
+
+	if(page->lru_prev >= 0)
+		pcache->pages[page->lru_prev].lru_next = page->lru_next;
+	else
+		pcache->lru_head = page->lru_next;
+	if(page->lru_next >= 0)
+		pcache->pages[page->lru_next].lru_prev = page->lru_prev;
+	else
+		pcache->lru_tail = page->lru_prev;
+}
+
+static void lru_push(int frame)
+{
+	struct pcache_page *page = &pcache->pages[frame];
+
+	page->lru_prev = -1;
+	page->lru_next = pcache->lru_head;
+	if(pcache->lru_head >= 0)
+		pcache->pages[pcache->lru_head].lru_prev = frame;
+	else
+		pcache->lru_tail = frame;
+	pcache->lru_head = frame;
+}
+
+static void hash_unlink(int frame)
+{
+	struct pcache_page *page = &pcache->pages[frame];
+	int *link = &pcache->buckets[pcache_bucket(page->inode, page->index)];
+
+	while(*link != frame)
+		link = &pcache->pages[*link].hash_next;
+	*link = page->hash_next;
+}
+
+static int pcache_lookup(struct inode *inode, u32 index)
+{
+	int frame = pcache->buckets[pcache_bucket(inode, index)];
+
+	while(frame >= 0)
+	{
+		struct pcache_page *page = &pcache->pages[frame];
+		if(page->inode == inode && page->index == index)
+			return frame;
+		frame = page->hash_next;
+	}
+	return -1;
+}
+
+static void pcache_writeback(int frame)
+{
+	struct pcache_page *page = &pcache->pages[frame];
+	int pos = page->index * PAGE_SIZE;
+	u32 len = page->inode->file_size - pos;
+
+	if(len > PAGE_SIZE)
+		len = PAGE_SIZE;
+	flat_write(page->inode, pcache_data(frame), len, &pos);
+	page->flags &= ~PCACHE_DIRTY;
+	stats->pcache_writebacks++;
+}
+
+/* Drop a frame from the cache (written back first if dirty) */
+static void pcache_evict(int frame)
+{
+	struct pcache_page *page = &pcache->pages[frame];
+
+	if(page->flags & PCACHE_DIRTY)
+		pcache_writeback(frame);
+	hash_unlink(frame);
+	lru_unlink(frame);
+	page->inode->cached_pages--;
+	page->inode = NULL;
+	page->flags = 0;
+	page->hash_next = pcache->free;
+	pcache->free = frame;
+}
+
+/*
+ * Cache page index of inode without looking it up first. If fill is set the
+ * page is read from the store (zero past end of file), else it is left as
+ * is because the caller is about to overwrite all of its valid bytes.
+ */
+static int pcache_insert(struct inode *inode, u32 index, int fill)
+{
+	struct pcache_page *page;
+	u32 bucket;
+	int frame, pos, valid;
+
+	if(pcache->free < 0)
+		pcache_evict(pcache->lru_tail);
+	frame = pcache->free;
+	page = &pcache->pages[frame];
+	pcache->free = page->hash_next;
+
+	page->inode = inode;
+	page->index = index;
+	page->flags = PCACHE_VALID;
+	bucket = pcache_bucket(inode, index);
+	page->hash_next = pcache->buckets[bucket];
+	pcache->buckets[bucket] = frame;
+	lru_push(frame);
+	inode->cached_pages++;
+
+	if(fill)
+	{
+		pos = index * PAGE_SIZE;
+		valid = flat_read(inode, pcache_data(frame), PAGE_SIZE, &pos);
+		if(valid < PAGE_SIZE)
+			fast_bzero(pcache_data(frame) + valid, PAGE_SIZE - valid);
+	}
+	return frame;
+}
+
+static int pcache_get(struct inode *inode, u32 index, int fill)
+{
+	int frame = pcache_lookup(inode, index);
+
+	if(frame >= 0)
+	{
+		stats->pcache_hits++;
+		lru_unlink(frame);
+		lru_push(frame);
+		return frame;
+	}
+	stats->pcache_misses++;
+	return pcache_insert(inode, index, fill);
+}
+
+/*
+ * Called on sequential access to page index: fetch the pages after it,
+ * stopping at the first one already cached (fetched by an earlier call)
+ */
+static void pcache_readahead(struct inode *inode, u32 index)
+{
+	u32 last = (inode->file_size - 1) / PAGE_SIZE;
+	u32 i;
+
+	for(i = index + 1; i <= index + PCACHE_READAHEAD && i <= last; i++)
+	{
+		if(pcache_lookup(inode, i) >= 0)
+			break;
+		pcache_insert(inode, i, 1);
+	}
+}
+
+void pcache_init()
+{
+	int i;
+
+	pcache = (struct page_cache *)get_contigous_pages(FILE_DS_REG,
+			(sizeof(struct page_cache) + PAGE_SIZE - 1) / PAGE_SIZE);
+	pcache->frames = (char *)get_contigous_pages(FILE_DS_REG, PCACHE_PAGES);
+	for(i = 0; i < PCACHE_BUCKETS; i++)
+		pcache->buckets[i] = -1;
+	for(i = 0; i < PCACHE_PAGES; i++)
+		pcache->pages[i].hash_next = (i + 1 < PCACHE_PAGES) ? i + 1 : -1;
+	pcache->free = 0;
+	pcache->lru_head = -1;
+	pcache->lru_tail = -1;
+
+	stats->pcache_hits = 0;
+	stats->pcache_misses = 0;
+	stats->pcache_writebacks = 0;
+}
+
+int pcache_read(struct inode *inode, char *buf, int count, int *offp)
+{
+	u32 pos = *offp, size, done = 0, index, offset, chunk;
+	long int remain_len;
+	int frame;
+
+	if(inode->map_count)
+		return flat_read(inode, buf, count, offp);
+
+	remain_len = (long int)inode->file_size - pos;
+	if(count <= 0 || remain_len <= 0)
+		return 0;
+	size = (count > remain_len ? remain_len : count);
+
+	while(done < size)
+	{
+		index = (pos + done) / PAGE_SIZE;
+		offset = (pos + done) % PAGE_SIZE;
+		chunk = PAGE_SIZE - offset;
+		if(chunk > size - done)
+			chunk = size - done;
+
+		frame = pcache_get(inode, index, 1);
+		fast_memcpy(buf + done, pcache_data(frame) + offset, chunk);
+		if(index == inode->ra_next)
+			pcache_readahead(inode, index);
+		inode->ra_next = index + 1;
+		done += chunk;
+	}
+	return size;
+}
+
+int pcache_write(struct inode *inode, char *buf, int count, int *offp)
+{
+	u32 pos = *offp, done = 0, index, offset, chunk;
+	int frame, fill;
+
+	if(inode->map_count)
+		return flat_write(inode, buf, count, offp);
+	if(count < 0 || flat_reserve(inode, pos + count) < 0)
+		return -1; // file store exhausted
+
+	while(done < count)
+	{
+		index = (pos + done) / PAGE_SIZE;
+		offset = (pos + done) % PAGE_SIZE;
+		chunk = PAGE_SIZE - offset;
+		if(chunk > count - done)
+			chunk = count - done;
+
+		// a page only partly overwritten needs its old bytes
+		fill = offset != 0 || pos + done + chunk < inode->file_size;
+		frame = pcache_get(inode, index, fill);
+		fast_memcpy(pcache_data(frame) + offset, buf + done, chunk);
+		pcache->pages[frame].flags |= PCACHE_DIRTY;
+		done += chunk;
+
+		if(pos + done > inode->file_size)
+			inode->file_size = pos + done;
+	}
+	return count;
+}
+
+/* Write back every dirty page of inode, the pages stay cached */
+void pcache_flush(struct inode *inode)
+{
+	int i;
+
+	if(!inode->cached_pages)
+		return;
+	for(i = 0; i < PCACHE_PAGES; i++)
+		if(pcache->pages[i].inode == inode && (pcache->pages[i].flags & PCACHE_DIRTY))
+			pcache_writeback(i);
+}
+
+/* Drop every page of inode without writing it back */
+void pcache_invalidate(struct inode *inode)
+{
+	int i;
+
+	for(i = 0; i < PCACHE_PAGES && inode->cached_pages; i++)
+		if(pcache->pages[i].inode == inode)
+		{
+			pcache->pages[i].flags &= ~PCACHE_DIRTY;
+			pcache_evict(i);
+		}
+}
@@ -0,0 +1,308 @@
+#include<types.h>
+#include<lib.h>
+#include<context.h>
+#include<memory.h>
+#include<entry.h>
+#include<file.h>
+#include<memops.h>
+#include<slab.h>
+#include<fdtable.h>
+#include<pipe.h>
+
+/*
+ * Pipes. The data sits in a power-of-two ring of pages (see pipe.h) and is
+ * copied a page-contiguous chunk at a time. A pipe made by pipe() keeps the
+ * old all or nothing rules: a read asking for more than is in the pipe and
+ * a write that does not fit fail with -EINVAL. A PIPE_WAIT pipe reads what
+ * there is, 0 once it is empty and the write end is gone, and writes of up
+ * to size bytes go in whole; when nothing can move -EAGAIN is returned and
+ * the system call parks the caller on the pipe's wait channel. Every read
+ * wakes the writers and every write the readers.
+ */
+
+static struct slab_cache pipe_cache = SLAB_CACHE("pipe", struct pipe_info, NULL);
+
+static const struct fileops pipe_read_ops = {
+	.read = pipe_read,
+	.close = pipe_close,
+};
+
+static const struct fileops pipe_write_ops = {
+	.write = pipe_write,
+	.close = pipe_close,
+};
+
+/* The ring bytes from pos on that are contiguous in memory, *len is cut to fit */
+static char *pipe_chunk(struct pipe_info *pipe, u32 pos, u32 *len)
+{
+	u32 off = pos & pipe->mask;
+	u32 left = PAGE_SIZE - (off & (PAGE_SIZE - 1));
+
+	if(*len > left)
+		*len = left;
+	return pipe->pages[off / PAGE_SIZE] + (off & (PAGE_SIZE - 1));
+}
+
+/* Copy count bytes between buff and the ring at pos, into the ring if in */
+static void pipe_copy(struct pipe_info *pipe, u32 pos, char *buff, u32 count, int in)
+{
+	char *chunk;
+	u32 len;
+
+	while(count){
+		len = count;
+		chunk = pipe_chunk(pipe, pos, &len);
+		if(in)
+			fast_memcpy(chunk, buff, len);
+		else
+			fast_memcpy(buff, chunk, len);
+		pos += len;
+		buff += len;
+		count -= len;
+	}
+}
+
+static void pipe_free(struct pipe_info *pipe)
+{
+	u32 i;
+
+	for(i = 0; i < PIPE_MAX_PAGES && pipe->pages[i]; i++)
+		os_page_free(OS_DS_REG, pipe->pages[i]);
+	slab_free(pipe);
+}
+
+int pipe_read(struct file *filep, char * buff, u32 count)
+{
+	struct pipe_info *pipe = filep->pipe;
+	u32 avail = pipe_count(pipe);
+
+	if(!(filep->mode & O_READ))
+		return -EACCES;
+	if(!(pipe->flags & PIPE_WAIT)){
+		if(count > avail)
+			return -EINVAL;
+	}else if(count && !avail){
+		return pipe->is_wopen ? -EAGAIN : 0;
+	}
+	if(count > avail)
+		count = avail;
+	if(!count)
+		return 0;
+
+	pipe_copy(pipe, pipe->head, buff, count, 0);
+	pipe->head += count;
+	wait_wake(PIPE_CHANNEL(pipe, 1), WAKE_ALL);
+	return count;
+}
+
+int pipe_write(struct file *filep, char * buff, u32 count)
+{
+	struct pipe_info *pipe = filep->pipe;
+	u32 space = pipe_space(pipe);
+
+	if(!(filep->mode & O_WRITE))
+		return -EACCES;
+	if(!(pipe->flags & PIPE_WAIT)){
+		if(count > space)
+			return -EINVAL;
+	}else if(count){
+		if(!pipe->is_ropen)
+			return -EINVAL;	// nobody will ever read it
+		if(count <= pipe->size ? count > space : !space)
+			return -EAGAIN;
+	}
+	if(count > space)
+		count = space;
+	if(!count)
+		return 0;
+
+	pipe_copy(pipe, pipe->tail, buff, count, 1);
+	pipe->tail += count;
+	wait_wake(PIPE_CHANNEL(pipe, 0), WAKE_ALL);
+	return count;
+}
+
+long pipe_close(struct file *filep)
+{
+	struct pipe_info *pipe = filep->pipe;
+
+	if(filep->ref_count == 1){
+		if(filep->mode & O_READ)
+			pipe->is_ropen = 0;
+		else
+			pipe->is_wopen = 0;
+		// the other end sees EOF, or that nobody reads any more
+		wait_wake(PIPE_CHANNEL(pipe, 0), WAKE_ALL);
+		wait_wake(PIPE_CHANNEL(pipe, 1), WAKE_ALL);
+		if(!pipe->is_ropen && !pipe->is_wopen)
+			pipe_free(pipe);
+	}
+	return std_close(filep);
+}
+
+static struct file *pipe_file(struct pipe_info *pipe, u32 mode)
+{
+	struct file *filep = alloc_file_ops(mode == O_READ ? &pipe_read_ops : &pipe_write_ops);
+
+	if(!filep)
+		return NULL;
+	filep->type = PIPE;
+	filep->mode = mode;
+	filep->pipe = pipe;
+	return filep;
+}
+
+/*
+ * fd[0] is the read end and fd[1] the write end, the lowest free
+ * descriptors. size is rounded up to a power of two, 0 is PIPE_MAX_SIZE.
+ */
+int create_pipe(struct exec_context *current, int *fd, u32 size, u32 flags)
+{
+	struct pipe_info *pipe;
+	struct file *rfile, *wfile;
+	u32 ring, i;
+	int ret = -ENOMEM;
+
+	if(!fd || (flags & ~PIPE_WAIT) || size > PIPE_MAX_PAGES * PAGE_SIZE)
+		return -EINVAL;
+	if(!size)
+		size = PIPE_MAX_SIZE;
+	for(ring = PAGE_SIZE; ring < size; ring <<= 1)
+		;
+
+	pipe = (struct pipe_info *) slab_alloc(&pipe_cache);
+	if(!pipe)
+		return -ENOMEM;
+	bzero((char *)pipe, sizeof(struct pipe_info));
+	pipe->size = ring;
+	pipe->mask = ring - 1;
+	pipe->flags = flags;
+	pipe->is_ropen = 1;
+	pipe->is_wopen = 1;
+	for(i = 0; i < ring / PAGE_SIZE; i++){
+		pipe->pages[i] = (char *) os_page_alloc(OS_DS_REG);
+		if(!pipe->pages[i])
+			goto free_pipe;
+	}
+
+	rfile = pipe_file(pipe, O_READ);
+	if(!rfile)
+		goto free_pipe;
+	wfile = pipe_file(pipe, O_WRITE);
+	if(!wfile)
+		goto free_rfile;
+
+	// fd_alloc backs the slot, so the installs cannot fail
+	ret = fd_alloc(current, 0);
+	if(ret < 0)
+		goto free_wfile;
+	fd[0] = fd_install(current, ret, rfile);
+	ret = fd_alloc(current, 0);
+	if(ret < 0){
+		fd_clear(current, fd[0]);
+		goto free_wfile;
+	}
+	fd[1] = fd_install(current, ret, wfile);
+	return 0;
+
+free_wfile:
+	free_file_object(wfile);
+free_rfile:
+	free_file_object(rfile);
+free_pipe:
+	pipe_free(pipe);
+	return ret;
+}
+
+/*
+ * Move up to count bytes from in to out without a user buffer. One of the
+ * two is a pipe, the other a pipe or a file with read (write) file ops;
+ * a pipe end is fed straight from (into) the ring of the other. Returns
+ * the bytes moved, 0 at the end of the input, -EAGAIN if nothing could
+ * move yet.
+ */
+int pipe_splice(struct file *in, struct file *out, u32 count)
+{
+	struct pipe_info *from = in->type == PIPE ? in->pipe : NULL;
+	struct pipe_info *to = out->type == PIPE ? out->pipe : NULL;
+	u32 done = 0, len;
+	char *chunk;
+	int ret = 0;
+
+	if(from){
+		if(!pipe_count(from))
+			return from->is_wopen ? -EAGAIN : 0;
+		if(count > pipe_count(from))
+			count = pipe_count(from);
+	}
+	if(to){
+		if(!to->is_ropen)
+			return -EINVAL;
+		if(!pipe_space(to))
+			return -EAGAIN;
+		if(count > pipe_space(to))
+			count = pipe_space(to);
+	}
+
+	while(done < count){
+		len = count - done;
+		if(from){
+			chunk = pipe_chunk(from, from->head, &len);
+			if(to){
+				pipe_copy(to, to->tail, chunk, len, 1);
+				ret = len;
+			}else{
+				ret = out->fops->write(out, chunk, len);
+			}
+		}else{
+			chunk = pipe_chunk(to, to->tail, &len);
+			ret = in->fops->read(in, chunk, len);
+		}
+		if(ret <= 0)
+			break;
+		if(from)
+			from->head += ret;
+		if(to)
+			to->tail += ret;
+		done += ret;
+		if(ret < len)
+			break;
+	}
+	if(!done)
+		return ret;
+	if(from)
+		wait_wake(PIPE_CHANNEL(from, 1), WAKE_ALL);
+	if(to)
+		wait_wake(PIPE_CHANNEL(to, 0), WAKE_ALL);
+	return done;
+}
+
+/* Copy up to count bytes from pipe in to pipe out, leaving them in in */
+int pipe_tee(struct file *in, struct file *out, u32 count)
+{
+	struct pipe_info *from = in->pipe;
+	struct pipe_info *to = out->pipe;
+	u32 done, len;
+	char *chunk;
+
+	if(!pipe_count(from))
+		return from->is_wopen ? -EAGAIN : 0;
+	if(!to->is_ropen)
+		return -EINVAL;
+	if(!pipe_space(to))
+		return -EAGAIN;
+	if(count > pipe_count(from))
+		count = pipe_count(from);
+	if(count > pipe_space(to))
+		count = pipe_space(to);
+
+	for(done = 0; done < count; done += len){
+		len = count - done;
+		chunk = pipe_chunk(from, from->head + done, &len);
+		pipe_copy(to, to->tail + done, chunk, len, 1);
+	}
+	to->tail += count;
+	if(count)
+		wait_wake(PIPE_CHANNEL(to, 0), WAKE_ALL);
+	return count;
+}
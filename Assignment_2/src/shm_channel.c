@@ -0,0 +1,245 @@
+#include<types.h>
+#include<lib.h>
+#include<context.h>
+#include<memory.h>
+#include<entry.h>
+#include<file.h>
+#include<page.h>
+#include<mmap.h>
+#include<memops.h>
+#include<slab.h>
+#include<fdtable.h>
+#include<shm_channel.h>
+
+/*
+ * Shared memory channels. A channel is a descriptor owning a few user
+ * pages that hold a single producer, single consumer ring (struct
+ * shm_ring). Each process maps the pages itself with shm_channel_map();
+ * fork copies mappings, so a child that inherits the descriptor maps the
+ * channel again rather than using the parent's address. cfork instead
+ * shares the pages and makes them copy-on-write in both processes, which
+ * would give each side a private ring on its first store; the mappings
+ * are recorded (shm_maps) and given their write bit back after cfork, so
+ * a ring mapped before a cfork works on both sides. After that the two
+ * sides move messages with plain loads and stores, and only enter the
+ * kernel to park when the ring is empty (full) and to wake the other side.
+ *
+ * The pages carry a pfn refcount of one for the channel plus one per
+ * mapping; unmapping drops a mapping's reference as for any user page,
+ * and the last close drops the channel's. The child's PTEs of a cforked
+ * mapping are a mapping of their own and keep the reference cfork took.
+ */
+
+static struct slab_cache shm_channel_cache = SLAB_CACHE("shm_channel", struct shm_channel, NULL);
+
+static struct shm_map shm_maps[MAX_SHM_MAPS];
+
+static struct shm_map *shm_map_alloc()
+{
+	int i;
+	for(i = 0; i < MAX_SHM_MAPS; i++)
+		if(!shm_maps[i].pid)
+			return &shm_maps[i];
+	return NULL;
+}
+
+static long shm_channel_close(struct file *filep);
+
+static const struct fileops shm_channel_ops = {
+	.close = shm_channel_close,
+};
+
+static void shm_channel_free(struct shm_channel *shm)
+{
+	struct pfn_info *info;
+	u32 i;
+
+	for(i = 0; i < shm->pages; i++){
+		info = get_pfn_info(shm->pfns[i]);
+		if(get_pfn_info_refcount(info) > 1){
+			decrement_pfn_info_refcount(info);	// still mapped somewhere
+		}else{
+			reset_pfn_info(shm->pfns[i]);
+			os_pfn_free(USER_REG, shm->pfns[i]);
+		}
+	}
+	slab_free(shm);
+}
+
+static long shm_channel_close(struct file *filep)
+{
+	if(filep->ref_count == 1)
+		shm_channel_free(filep->shm);
+	return std_close(filep);
+}
+
+/* slots is a power of two, slot_size a multiple of 8 with room for the length word */
+int do_shm_channel_create(struct exec_context *ctx, u32 slots, u32 slot_size)
+{
+	struct shm_channel *shm;
+	struct file *filep;
+	u64 bytes;
+	int fd;
+	u32 i;
+
+	if(!slots || (slots & (slots - 1)) || slot_size <= sizeof(u32) || (slot_size & 7))
+		return -EINVAL;
+	bytes = SHM_RING_DATA + (u64)slots * slot_size;
+	if(bytes > SHM_CHANNEL_PAGES * PAGE_SIZE)
+		return -EINVAL;
+
+	fd = fd_alloc(ctx, 0);
+	if(fd < 0)
+		return fd;
+	shm = (struct shm_channel *) slab_alloc(&shm_channel_cache);
+	if(!shm)
+		return -ENOMEM;
+	bzero((char *)shm, sizeof(struct shm_channel));
+	for(i = 0; i < (bytes + PAGE_SIZE - 1) / PAGE_SIZE; i++){
+		shm->pfns[i] = os_pfn_alloc(USER_REG);
+		if(!shm->pfns[i])
+			goto free_shm;
+		set_pfn_info(shm->pfns[i]);
+		fast_bzero((char *)osmap(shm->pfns[i]), PAGE_SIZE);
+		shm->pages++;
+	}
+	shm->slots = slots;
+	shm->slot_size = slot_size;
+	shm->ring = (struct shm_ring *)osmap(shm->pfns[0]);
+	shm->ring->slots = slots;
+	shm->ring->slot_size = slot_size;
+
+	filep = alloc_file_ops(&shm_channel_ops);
+	if(!filep)
+		goto free_shm;
+	filep->type = SHM_CHANNEL;
+	filep->mode = O_READ|O_WRITE;
+	filep->shm = shm;
+	return fd_install(ctx, fd, filep);
+
+free_shm:
+	shm_channel_free(shm);
+	return -ENOMEM;
+}
+
+/* Map the channel at a free address of ctx, returns the address of the ring */
+long do_shm_channel_map(struct exec_context *ctx, struct file *filep)
+{
+	struct shm_channel *shm;
+	struct shm_map *map;
+	u64 base;
+	long addr;
+	u32 i;
+
+	if(!filep || filep->type != SHM_CHANNEL)
+		return -EINVAL;
+	shm = filep->shm;
+	map = shm_map_alloc();
+	if(!map)
+		return -ENOMEM;
+	addr = vm_area_map(ctx, 0, shm->pages * PAGE_SIZE, PROT_READ|PROT_WRITE, 0);
+	if(addr < 0)
+		return addr;
+	base = (u64)osmap(ctx->pgd);
+	for(i = 0; i < shm->pages; i++){
+		increment_pfn_info_refcount(get_pfn_info(shm->pfns[i]));
+		map_physical_page(base, addr + (u64)i * PAGE_SIZE, PROT_WRITE, shm->pfns[i]);
+		map->pfns[i] = shm->pfns[i];
+	}
+	map->pid = ctx->pid;
+	map->pages = shm->pages;
+	map->addr = addr;
+	return addr;
+}
+
+/* Called on munmap, a mapping the range touches is forgotten */
+void shm_channel_unmap(struct exec_context *ctx, u64 addr, int length)
+{
+	int i;
+	for(i = 0; i < MAX_SHM_MAPS; i++)
+		if(shm_maps[i].pid == ctx->pid && shm_maps[i].addr < addr + length &&
+		   shm_maps[i].addr + (u64)shm_maps[i].pages * PAGE_SIZE > addr)
+			shm_maps[i].pid = 0;
+}
+
+/* Give the channel PTEs of a mapping in ctx the write bit cfork took away */
+static void shm_map_share(struct exec_context *ctx, struct shm_map *map)
+{
+	u64 addr, *pte;
+	u32 i;
+
+	for(i = 0; i < map->pages; i++){
+		addr = map->addr + (u64)i * PAGE_SIZE;
+		pte = get_user_pte(ctx, addr, 0);
+		if(!pte || !(*pte & 0x1) || ((*pte >> PTE_SHIFT) & 0xFFFFFFFF) != map->pfns[i])
+			continue;
+		*pte |= PROT_WRITE;
+		asm volatile (
+			"invlpg (%0);"
+			:: "r"(addr)
+			: "memory"
+		);
+	}
+}
+
+/* After cfork, the parent's mappings stay shared and the child has them too */
+void shm_channel_fork(struct exec_context *parent, struct exec_context *child)
+{
+	struct shm_map *map;
+	int i;
+
+	for(i = 0; i < MAX_SHM_MAPS; i++){
+		if(shm_maps[i].pid != parent->pid)
+			continue;
+		shm_map_share(parent, &shm_maps[i]);
+		shm_map_share(child, &shm_maps[i]);
+		map = shm_map_alloc();
+		if(!map)
+			continue;	// shared, but a cfork of the child will not know it
+		*map = shm_maps[i];
+		map->pid = child->pid;
+	}
+}
+
+void shm_channel_exit(struct exec_context *ctx)
+{
+	int i;
+	for(i = 0; i < MAX_SHM_MAPS; i++)
+		if(shm_maps[i].pid == ctx->pid)
+			shm_maps[i].pid = 0;
+}
+
+/*
+ * -EAGAIN if the ring is still empty (SHM_WAIT_DATA) or full
+ * (SHM_WAIT_SPACE) and the caller has to park, with the wait noted in
+ * ring->waiting for the other side to see. 0 if there is no need.
+ */
+int do_shm_channel_wait(struct file *filep, u32 what)
+{
+	struct shm_channel *shm;
+	u32 used;
+
+	if(!filep || filep->type != SHM_CHANNEL || (what != SHM_WAIT_DATA && what != SHM_WAIT_SPACE))
+		return -EINVAL;
+	shm = filep->shm;
+	used = shm->ring->tail - shm->ring->head;
+	if(what == SHM_WAIT_DATA ? used : used < shm->slots){
+		shm->ring->waiting &= ~what;
+		return 0;
+	}
+	shm->ring->waiting |= what;
+	return -EAGAIN;
+}
+
+int do_shm_channel_wake(struct file *filep)
+{
+	struct shm_channel *shm;
+
+	if(!filep || filep->type != SHM_CHANNEL)
+		return -EINVAL;
+	shm = filep->shm;
+	shm->ring->waiting = 0;
+	wait_wake(SHM_CHANNEL_WAITQ(shm, 0), WAKE_ALL);
+	wait_wake(SHM_CHANNEL_WAITQ(shm, 1), WAKE_ALL);
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include<types.h>
+#include<lib.h>
+#include<memory.h>
+#include<slab.h>
+
+/*
+ * Slab allocator. Objects are carved out of whole OS_DS_REG pages, the slab
+ * of an object is found by rounding its address down to the page. Only
+ * slabs with a free object are listed (cache->partial), a full slab is
+ * relinked when an object of it is freed. One empty slab is kept per cache
+ * so that an alloc/free pair at a slab boundary does not hit the page
+ * allocator every time.
+ */
+
+static struct slab_cache *slab_caches;
+
+static u32 slab_objects(struct slab_cache *cache)
+{
+	return (PAGE_SIZE - sizeof(struct slab)) / cache->size;
+}
+
+static void slab_link(struct slab_cache *cache, struct slab *slab)
+{
+	slab->prev = NULL;
+	slab->next = cache->partial;
+	if(cache->partial)
+		cache->partial->prev = slab;
+	cache->partial = slab;
+}
+
+static void slab_unlink(struct slab_cache *cache, struct slab *slab)
+{
+	if(slab->prev)
+		slab->prev->next = slab->next;
+	else
+		cache->partial = slab->next;
+	if(slab->next)
+		slab->next->prev = slab->prev;
+}
+
+static struct slab *slab_grow(struct slab_cache *cache)
+{
+	struct slab *slab = (struct slab *)os_page_alloc(OS_DS_REG);
+	char *obj;
+	u32 i, count;
+
+	if(!slab)
+		return NULL;
+	if(!cache->registered)
+	{
+		cache->registered = 1;
+		cache->next = slab_caches;
+		slab_caches = cache;
+	}
+
+	slab->cache = cache;
+	slab->inuse = 0;
+	slab->free = NULL;
+	count = slab_objects(cache);
+	obj = (char *)(slab + 1) + (u64)(count - 1) * cache->size;
+	for(i = 0; i < count; i++, obj -= cache->size)
+	{
+		*(void **)obj = slab->free;
+		slab->free = obj;
+	}
+	slab_link(cache, slab);
+	cache->slabs++;
+	cache->empty++;
+	return slab;
+}
+
+void *slab_alloc(struct slab_cache *cache)
+{
+	struct slab *slab = cache->partial;
+	void *obj;
+
+	if(!slab)
+		slab = slab_grow(cache);
+	if(!slab)
+		return NULL;
+
+	obj = slab->free;
+	slab->free = *(void **)obj;
+	if(!slab->inuse++)
+		cache->empty--;
+	if(!slab->free)
+		slab_unlink(cache, slab);
+	cache->active++;
+
+	if(cache->ctor)
+		cache->ctor(obj);
+	return obj;
+}
+
+void slab_free(void *obj)
+{
+	struct slab *slab = (struct slab *)((u64)obj & ~((u64)PAGE_SIZE - 1));
+	struct slab_cache *cache = slab->cache;
+
+	if(!slab->free)
+		slab_link(cache, slab);
+	*(void **)obj = slab->free;
+	slab->free = obj;
+	cache->active--;
+	if(--slab->inuse)
+		return;
+
+	if(cache->empty)
+	{
+		slab_unlink(cache, slab);
+		os_page_free(OS_DS_REG, slab);
+		cache->slabs--;
+		return;
+	}
+	cache->empty++;
+}
+
+void slab_stats()
+{
+	struct slab_cache *cache;
+
+	for(cache = slab_caches; cache; cache = cache->next)
+		printk("slab %s: objects = %d/%d slabs = %d\n", cache->name, cache->active,
+		       cache->slabs * slab_objects(cache), cache->slabs);
+}
@@ -0,0 +1,107 @@
+#include<types.h>
+#include<lib.h>
+#include<entry.h>
+#include<file.h>
+#include<sysstat.h>
+#include<memops.h>
+
+/*
+ * System call and file I/O accounting. do_syscall times every call with
+ * rdtsc and drops the cycles into a log2 histogram for its number; the
+ * file paths add their calls and bytes per file type. Calls that never
+ * return to do_syscall are not timed: exit, a call parked in WAITING
+ * (timed when it runs again), and a unicast msg_queue_send that hands the
+ * CPU straight to a parked receiver. The file paths count a call once it
+ * is over, so a call that parks is counted once, when it completes; the
+ * handed off send is counted there too.
+ */
+
+struct latency{
+	u64 count;
+	u64 cycles;
+	u64 buckets[LATENCY_BUCKETS];
+};
+
+static struct latency latencies[MAX_SYSCALLS];
+static struct file_io_stat file_io[MAX_FILE_TYPE];
+
+static inline int bsr(u64 word)
+{
+	u64 bit;
+	asm volatile("bsr %1, %0" : "=r"(bit) : "r"(word));
+	return bit;
+}
+
+void syscall_account(int syscall, u64 cycles)
+{
+	struct latency *lat;
+	int b;
+
+	if(syscall < 0 || syscall >= MAX_SYSCALLS)
+		return;
+	lat = &latencies[syscall];
+	b = cycles ? bsr(cycles) : 0;
+	if(b >= LATENCY_BUCKETS)
+		b = LATENCY_BUCKETS - 1;
+	lat->count++;
+	lat->cycles += cycles;
+	lat->buckets[b]++;
+}
+
+/* Count a read (write) of filep that returned bytes, errors count as calls only */
+void file_account(struct file *filep, int write, long bytes)
+{
+	struct file_io_stat *io;
+	u32 type = filep->msg_queue ? MSG_QUEUE : filep->type;	// queue files leave type unset
+
+	if(type >= MAX_FILE_TYPE)
+		return;
+	io = &file_io[type];
+	if(bytes < 0)
+		bytes = 0;
+	if(write){
+		io->writes++;
+		io->write_bytes += bytes;
+	}else{
+		io->reads++;
+		io->read_bytes += bytes;
+	}
+}
+
+/* Upper bound of the bucket holding the pct-th percentile of lat */
+static u64 percentile(struct latency *lat, u64 pct)
+{
+	u64 seen = 0;
+	int b;
+
+	for(b = 0; b < LATENCY_BUCKETS; b++){
+		seen += lat->buckets[b];
+		if(seen * 100 >= lat->count * pct)
+			break;
+	}
+	return 2UL << b;
+}
+
+/* Copy the counters out to buf (if not NULL, user memory of ctx), then clear them if reset */
+long do_syscall_stats(struct exec_context *ctx, struct syscall_stats *buf, int reset)
+{
+	int i;
+
+	if(buf && !user_range_ok(ctx, (u64)buf, sizeof(struct syscall_stats), MM_RD | MM_WR))
+		return -EINVAL;
+
+	if(buf){
+		for(i = 0; i < MAX_SYSCALLS; i++){
+			buf->calls[i].count = latencies[i].count;
+			buf->calls[i].cycles = latencies[i].cycles;
+			buf->calls[i].p50 = latencies[i].count ? percentile(&latencies[i], 50) : 0;
+			buf->calls[i].p99 = latencies[i].count ? percentile(&latencies[i], 99) : 0;
+		}
+		memcpy((char *)buf->files, (char *)file_io, sizeof(file_io));
+	}
+	if(reset){
+		bzero((char *)latencies, sizeof(latencies));
+		bzero((char *)file_io, sizeof(file_io));
+	}
+	return 0;
+}
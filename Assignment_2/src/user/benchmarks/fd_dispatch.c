@@ -0,0 +1,92 @@
+#include<ulib.h>
+
+/*
+ * Times creating and closing a file of each type (regular, stdout, pipe,
+ * message queue) and a small operation dispatched through its file ops.
+ * Copy to user/init.c to run.
+ */
+
+#define ROUNDS 256
+
+static void report(char *type, u64 create, u64 op)
+{
+	printf("%s: create+close = %d cycles op = %d cycles\n", type,
+		(int)(create / ROUNDS), (int)(op / ROUNDS));
+}
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	u64 start, create, op;
+	int fd, pfd[2], r;
+	char c = 'x';
+
+	fd = open("dispatch.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	write(fd, &c, 1);
+	close(fd);
+
+	create = op = 0;
+	for(r = 0; r < ROUNDS; r++){
+		start = rdtsc();
+		fd = open("dispatch.txt", O_RDWR);
+		close(fd);
+		create += rdtsc() - start;
+	}
+	fd = open("dispatch.txt", O_RDWR);
+	for(r = 0; r < ROUNDS; r++){
+		start = rdtsc();
+		pread(fd, &c, 1, 0);
+		op += rdtsc() - start;
+	}
+	close(fd);
+	report("regular", create, op);
+
+	create = op = 0;
+	for(r = 0; r < ROUNDS; r++){
+		start = rdtsc();
+		fd = open("stdout", O_WRITE);
+		close(fd);
+		create += rdtsc() - start;
+	}
+	for(r = 0; r < ROUNDS; r++){
+		start = rdtsc();
+		write(1, &c, 0);	// dispatched, nothing printed
+		op += rdtsc() - start;
+	}
+	report("stdout", create, op);
+
+	create = op = 0;
+	for(r = 0; r < ROUNDS; r++){
+		start = rdtsc();
+		pipe(pfd);
+		close(pfd[0]);
+		close(pfd[1]);
+		create += rdtsc() - start;
+	}
+	pipe(pfd);
+	for(r = 0; r < ROUNDS; r++){
+		start = rdtsc();
+		write(pfd[1], &c, 1);
+		read(pfd[0], &c, 1);
+		op += rdtsc() - start;
+	}
+	close(pfd[0]);
+	close(pfd[1]);
+	report("pipe", create, op);
+
+	create = op = 0;
+	for(r = 0; r < ROUNDS; r++){
+		start = rdtsc();
+		fd = create_msg_queue();
+		msg_queue_close(fd);
+		create += rdtsc() - start;
+	}
+	fd = create_msg_queue();
+	for(r = 0; r < ROUNDS; r++){
+		start = rdtsc();
+		get_msg_count(fd);
+		op += rdtsc() - start;
+	}
+	msg_queue_close(fd);
+	report("msg_queue", create, op);
+	return 0;
+}
@@ -0,0 +1,55 @@
+#include<ulib.h>
+
+/*
+ * Compares the kernel copy/zero implementations (byte loop, 8-byte loop,
+ * rep movsq, rep movsb, SSE, AVX) on 4KB and 2MB buffers using rdtsc
+ * cycle counts taken inside the kernel. Copy to user/init.c to run.
+ */
+
+static char *names[MAX_MEMOPS] = {"byte", "word", "rep movsq", "rep movsb", "sse", "avx"};
+
+static void run(char *src, char *dst, int size, int iterations)
+{
+	struct memops_bench bench;
+	int op;
+
+	bench.src = (u64)src;
+	bench.dst = (u64)dst;
+	bench.size = size;
+	bench.iterations = iterations;
+	if(memops_bench(&bench) < 0){
+		printf("memops_bench failed\n");
+		return;
+	}
+
+	printf("size = %d bytes, selected = %s\n", size, names[bench.selected]);
+	for(op = 0; op < MAX_MEMOPS; op++){
+		if(!(bench.available & (1 << op))){
+			printf("  %s: not available\n", names[op]);
+			continue;
+		}
+		printf("  %s: copy %d cycles zero %d cycles\n", names[op],
+			(int)(bench.copy_cycles[op] / iterations),
+			(int)(bench.zero_cycles[op] / iterations));
+	}
+}
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	int size = 2 << 20;
+	char *src = mmap(NULL, size, PROT_READ|PROT_WRITE, 0);
+	char *dst = mmap(NULL, size, PROT_READ|PROT_WRITE, 0);
+
+	// fault every page in before the kernel touches the buffers
+	for(int i = 0; i < size; i += 4096){
+		src[i] = i;
+		dst[i] = 0;
+	}
+
+	run(src, dst, 4096, 256);
+	run(src, dst, size, 4);
+
+	munmap(src, size);
+	munmap(dst, size);
+	return 0;
+}
@@ -0,0 +1,49 @@
+#include<ulib.h>
+
+/*
+ * Moves messages through a queue to the calling process itself, one
+ * message per system call and then BATCH per system call.
+ * Copy to user/init.c to run.
+ */
+
+#define ROUNDS 64
+#define BATCH 32
+
+struct message msgs[BATCH];
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	u64 start, single, batched;
+	int fd, r, i, moved;
+
+	fd = create_msg_queue();
+	for(i = 0; i < BATCH; i++){
+		msgs[i].from_pid = getpid();
+		msgs[i].to_pid = getpid();
+		msgs[i].msg_txt[0] = 'a' + i % 26;
+		msgs[i].msg_txt[1] = '\0';
+	}
+
+	moved = 0;
+	start = rdtsc();
+	for(r = 0; r < ROUNDS; r++){
+		for(i = 0; i < BATCH; i++)
+			moved += msg_queue_send(fd, &msgs[i]);
+		for(i = 0; i < BATCH; i++)
+			msg_queue_rcv(fd, &msgs[i]);
+	}
+	single = rdtsc() - start;
+	printf("single: %d messages %d cycles/message\n", moved, (int)(single / moved));
+
+	moved = 0;
+	start = rdtsc();
+	for(r = 0; r < ROUNDS; r++){
+		moved += msg_queue_send_batch(fd, msgs, BATCH);
+		msg_queue_rcv_batch(fd, msgs, BATCH);
+	}
+	batched = rdtsc() - start;
+	printf("batch of %d: %d messages %d cycles/message\n", BATCH, moved, (int)(batched / moved));
+
+	msg_queue_close(fd);
+	return 0;
+}
@@ -0,0 +1,66 @@
+#include<ulib.h>
+
+/*
+ * Times open()+close() of existing files and open() of missing files
+ * while the file system holds 32, 256 and 1024 files.
+ * Copy to user/init.c to run.
+ */
+
+#define ROUNDS 64
+
+static void make_name(char *buf, char prefix, int num)
+{
+	char digits[12];
+	int count = 0;
+	*buf++ = prefix;
+	do{
+		digits[count++] = '0' + num % 10;
+		num /= 10;
+	}while(num);
+	while(count--)
+		*buf++ = digits[count];
+	*buf = '\0';
+}
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	int sizes[3] = {32, 256, 1024};
+	int created = 0, fd, i, r;
+	char name[16];
+	u64 start, hit, miss;
+
+	for(i = 0; i < 3; i++){
+		while(created < sizes[i]){
+			make_name(name, 'f', created);
+			fd = open(name, O_CREAT|O_RDWR, O_READ|O_WRITE);
+			if(fd < 0){
+				printf("create %s failed: %d\n", name, fd);
+				return 0;
+			}
+			close(fd);
+			created++;
+		}
+
+		hit = 0;
+		for(r = 0; r < ROUNDS; r++){
+			// the most recently created file is the worst case for a scan
+			make_name(name, 'f', created - 1 - (r % created));
+			start = rdtsc();
+			fd = open(name, O_RDWR);
+			close(fd);
+			hit += rdtsc() - start;
+		}
+
+		miss = 0;
+		for(r = 0; r < ROUNDS; r++){
+			make_name(name, 'm', r);
+			start = rdtsc();
+			open(name, O_RDWR);
+			miss += rdtsc() - start;
+		}
+
+		printf("files = %d open+close = %d cycles missing lookup = %d cycles\n",
+			created, (int)(hit / ROUNDS), (int)(miss / ROUNDS));
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+#include<ulib.h>
+
+/*
+ * Streams ROUNDS messages from a child to its parent, first through a
+ * message queue (two system calls per message) and then through a shared
+ * memory channel (system calls only when the ring runs empty or full).
+ * Copy to user/init.c to run.
+ */
+
+#define ROUNDS 4096
+#define SLOTS 64
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	struct shm_ring *ring;
+	struct message msg;
+	u64 start, queue, shm;
+	int fd, ppid, r;
+
+	ppid = getpid();
+	fd = create_msg_queue();
+	start = rdtsc();
+	if(fork() == 0){
+		msg.from_pid = getpid();
+		msg.to_pid = ppid;
+		for(r = 0; r < ROUNDS; r++)
+			msg_queue_send_wait(fd, &msg, 0);
+		exit(0);
+	}
+	for(r = 0; r < ROUNDS; r++)
+		msg_queue_rcv_wait(fd, &msg, 0);
+	queue = rdtsc() - start;
+	msg_queue_close(fd);
+
+	fd = shm_channel_create(SLOTS, sizeof(struct message) + 8);
+	start = rdtsc();
+	if(fork() == 0){
+		ring = shm_channel_map(fd);
+		for(r = 0; r < ROUNDS; r++)
+			shm_channel_send(fd, ring, &msg, sizeof(msg));
+		exit(0);
+	}
+	ring = shm_channel_map(fd);
+	for(r = 0; r < ROUNDS; r++)
+		shm_channel_recv(fd, ring, &msg, sizeof(msg));
+	shm = rdtsc() - start;
+	close(fd);
+
+	printf("msg_queue: %d cycles/message\n", (int)(queue / ROUNDS));
+	printf("shm_channel: %d cycles/message\n", (int)(shm / ROUNDS));
+	return 0;
+}
@@ -0,0 +1,42 @@
+#include<ulib.h>
+
+/*
+ * Runs a mix of system calls on a regular file, a pipe and a message
+ * queue, then prints the kernel's per call latency histogram summary and
+ * per file type traffic. Copy to user/init.c to run.
+ */
+
+#define ROUNDS 256
+
+struct syscall_stats st;
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	struct message msg;
+	char buf[64];
+	int fd, pfd[2], mq, r;
+
+	fd = open("latency.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	pipe(pfd);
+	mq = create_msg_queue();
+	msg.from_pid = msg.to_pid = getpid();
+	syscall_stats(NULL, 1);
+
+	for(r = 0; r < ROUNDS; r++){
+		getpid();
+		pwrite(fd, buf, sizeof(buf), 0);
+		pread(fd, buf, sizeof(buf), 0);
+		write(pfd[1], buf, sizeof(buf));
+		read(pfd[0], buf, sizeof(buf));
+		msg_queue_send(mq, &msg);
+		msg_queue_rcv(mq, &msg);
+	}
+
+	syscall_stats(&st, 0);
+	print_syscall_stats(&st);
+	msg_queue_close(mq);
+	close(pfd[0]);
+	close(pfd[1]);
+	close(fd);
+	return 0;
+}
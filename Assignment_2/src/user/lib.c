@@ -152,6 +152,19 @@ void* mmap(void *addr, int length, int prot, int flags)
 	return (void*)_syscall4(SYSCALL_MMAP, (u64)addr, length, prot, flags);
 }
 
+void* mmap_file(void *addr, int length, int prot, int flags, int fd, long offset)
+{
+	struct mmap_file_args args;
+
+	args.addr = (u64)addr;
+	args.length = length;
+	args.prot = prot;
+	args.flags = flags;
+	args.fd = fd;
+	args.offset = offset;
+	return (void*)_syscall1(SYSCALL_MMAP_FILE, (u64)&args);
+}
+
 int munmap(void *addr, int length)
 {
 	return (int)_syscall2(SYSCALL_MUNMAP, (u64)addr, length);
@@ -192,11 +205,147 @@ int write(int fd, void * buf, int count)
 	return _syscall3(SYSCALL_WRITE, fd, (u64)buf, count);
 }
 
+long readv(int fd, struct iovec *iov, int iovcnt)
+{
+	return _syscall3(SYSCALL_READV, fd, (u64)iov, iovcnt);
+}
+
+long writev(int fd, struct iovec *iov, int iovcnt)
+{
+	return _syscall3(SYSCALL_WRITEV, fd, (u64)iov, iovcnt);
+}
+
+int pread(int fd, void *buf, int count, long offset)
+{
+	return _syscall4(SYSCALL_PREAD, fd, (u64)buf, count, offset);
+}
+
+int pwrite(int fd, void *buf, int count, long offset)
+{
+	return _syscall4(SYSCALL_PWRITE, fd, (u64)buf, count, offset);
+}
+
+long preadv(int fd, struct iovec *iov, int iovcnt, long offset)
+{
+	return _syscall4(SYSCALL_PREADV, fd, (u64)iov, iovcnt, offset);
+}
+
+long pwritev(int fd, struct iovec *iov, int iovcnt, long offset)
+{
+	return _syscall4(SYSCALL_PWRITEV, fd, (u64)iov, iovcnt, offset);
+}
+
 int pipe(int fd[2])
 {
 	return _syscall1(SYSCALL_PIPE, (unsigned long)fd);
 }
 
+int pipe2(int fd[2], int size, int flags)
+{
+	return _syscall3(SYSCALL_PIPE2, (unsigned long)fd, size, flags);
+}
+
+int splice(int infd, int outfd, int count)
+{
+	return _syscall3(SYSCALL_SPLICE, infd, outfd, count);
+}
+
+int tee(int infd, int outfd, int count)
+{
+	return _syscall3(SYSCALL_TEE, infd, outfd, count);
+}
+
+int poll(struct pollfd *fds, int nfds, int timeout)
+{
+	return _syscall3(SYSCALL_POLL, (u64)fds, nfds, timeout);
+}
+
+int shm_channel_create(int slots, int slot_size)
+{
+	return _syscall2(SYSCALL_SHM_CHANNEL_CREATE, slots, slot_size);
+}
+
+// map after fork, a fork child inherits a private copy of the parent's
+// mapping; a mapping made before cfork is shared by both processes
+struct shm_ring *shm_channel_map(int fd)
+{
+	long addr = _syscall1(SYSCALL_SHM_CHANNEL_MAP, fd);
+	return addr < 0 ? NULL : (struct shm_ring *)addr;
+}
+
+int shm_channel_wait(int fd, int what, int timeout)
+{
+	return _syscall3(SYSCALL_SHM_CHANNEL_WAIT, fd, what, timeout);
+}
+
+int shm_channel_wake(int fd)
+{
+	return _syscall1(SYSCALL_SHM_CHANNEL_WAKE, fd);
+}
+
+static inline u32 shm_load(u32 *p)
+{
+	return *(volatile u32 *)p;
+}
+
+static void shm_copy(char *dst, char *src, int len)
+{
+	for(; len >= 8; len -= 8, dst += 8, src += 8)
+		*(u64 *)dst = *(u64 *)src;
+	while(len--)
+		*dst++ = *src++;
+}
+
+/*
+ * The index is published after the slot is filled; the mfence orders it
+ * before reading waiting, so either the other side sees the new index
+ * when it looks again in the kernel or it is already parked and waiting
+ * tells us to wake it. Both block while the ring is full (empty).
+ */
+int shm_channel_send(int fd, struct shm_ring *ring, void *msg, int len)
+{
+	u32 tail = ring->tail;
+	char *slot;
+
+	if(len < 0 || len > ring->slot_size - 4)
+		return -EINVAL;
+	while(tail - shm_load(&ring->head) == ring->slots)
+		if(shm_channel_wait(fd, SHM_WAIT_SPACE, 0) == -EINVAL)
+			return -EINVAL;
+	slot = (char *)ring + SHM_RING_DATA + (tail & (ring->slots - 1)) * ring->slot_size;
+	*(u32 *)slot = len;
+	shm_copy(slot + 4, msg, len);
+	asm volatile("" ::: "memory");
+	*(volatile u32 *)&ring->tail = tail + 1;
+	asm volatile("mfence" ::: "memory");
+	if(shm_load(&ring->waiting) & SHM_WAIT_DATA)
+		shm_channel_wake(fd);
+	return len;
+}
+
+// returns the message length, -EINVAL if buf is too short (the message stays)
+int shm_channel_recv(int fd, struct shm_ring *ring, void *buf, int len)
+{
+	u32 head = ring->head;
+	char *slot;
+	int size;
+
+	while(shm_load(&ring->tail) == head)
+		if(shm_channel_wait(fd, SHM_WAIT_DATA, 0) == -EINVAL)
+			return -EINVAL;
+	slot = (char *)ring + SHM_RING_DATA + (head & (ring->slots - 1)) * ring->slot_size;
+	size = *(u32 *)slot;
+	if(size > len)
+		return -EINVAL;
+	shm_copy(buf, slot + 4, size);
+	asm volatile("" ::: "memory");
+	*(volatile u32 *)&ring->head = head + 1;
+	asm volatile("mfence" ::: "memory");
+	if(shm_load(&ring->waiting) & SHM_WAIT_SPACE)
+		shm_channel_wake(fd);
+	return size;
+}
+
 int dup(int oldfd)
 {
 	return _syscall1(SYSCALL_DUP, oldfd);
@@ -222,6 +371,17 @@ int sendfile(int outfd, int infd, long *offset, int count)
 	return _syscall4(SYSCALL_SENDFILE, outfd, infd, (u64)offset, count);
 }
 
+int memops_bench(struct memops_bench *bench)
+{
+	return _syscall1(SYSCALL_MEMOPS_BENCH, (u64)bench);
+}
+
+// st may be NULL to only reset the counters
+int syscall_stats(struct syscall_stats *st, int reset)
+{
+	return _syscall2(SYSCALL_SYSCALL_STATS, (u64)st, reset);
+}
+
 // message queue system call wrappers
 
 int create_msg_queue()
@@ -259,6 +419,46 @@ int msg_queue_close(int fd)
 	return _syscall1(SYSCALL_MSG_QUEUE_CLOSE, fd);
 }
 
+int msg_queue_rcv_wait(int fd, struct message *msg, int timeout)
+{
+	return _syscall3(SYSCALL_MSG_QUEUE_RCV_WAIT, fd, (u64)msg, timeout);
+}
+
+int msg_queue_send_wait(int fd, struct message *msg, int timeout)
+{
+	return _syscall3(SYSCALL_MSG_QUEUE_SEND_WAIT, fd, (u64)msg, timeout);
+}
+
+int msg_queue_send_batch(int fd, struct message *msgs, int count)
+{
+	return _syscall3(SYSCALL_MSG_QUEUE_SEND_BATCH, fd, (u64)msgs, count);
+}
+
+int msg_queue_rcv_batch(int fd, struct message *msgs, int count)
+{
+	return _syscall3(SYSCALL_MSG_QUEUE_RCV_BATCH, fd, (u64)msgs, count);
+}
+
+int msg_queue_send_buf(int fd, struct msg_buf *buf)
+{
+	return _syscall2(SYSCALL_MSG_QUEUE_SEND_BUF, fd, (u64)buf);
+}
+
+int msg_queue_rcv_buf(int fd, struct msg_buf *buf)
+{
+	return _syscall2(SYSCALL_MSG_QUEUE_RCV_BUF, fd, (u64)buf);
+}
+
+int msg_queue_subscribe(int fd, int topic)
+{
+	return _syscall3(SYSCALL_MSG_QUEUE_SUBSCRIBE, fd, topic, 1);
+}
+
+int msg_queue_unsubscribe(int fd, int topic)
+{
+	return _syscall3(SYSCALL_MSG_QUEUE_SUBSCRIBE, fd, topic, 0);
+}
+
 // C library functions
 static int vuprintf(char *buf,char *format,va_list args){
 	int count = 0,ch,out=0;
@@ -371,3 +571,37 @@ int ustrcmp(char *s, char *d){
 		return 0;
 	return -1;
 }
+
+static char *file_type_names[FILE_TYPES] = {
+	"stdin", "stdout", "stderr", "regular", "pipe", "msg_queue", "shm_channel",
+};
+
+// one line per system call number and file type that saw any use
+void print_syscall_stats(struct syscall_stats *st)
+{
+	struct syscall_stat *call;
+	struct file_io_stat *io;
+	int i;
+
+	for(i = 0; i < MAX_SYSCALLS; i++){
+		call = &st->calls[i];
+		if(!call->count)
+			continue;
+		printf("syscall %d: calls %d avg %d p50 <%d p99 <%d cycles\n", i, (int)call->count,
+			(int)(call->cycles / call->count), (int)call->p50, (int)call->p99);
+	}
+	for(i = 0; i < FILE_TYPES; i++){
+		io = &st->files[i];
+		if(!io->reads && !io->writes)
+			continue;
+		printf("%s: reads %d (%d bytes) writes %d (%d bytes)\n", file_type_names[i],
+			(int)io->reads, (int)io->read_bytes, (int)io->writes, (int)io->write_bytes);
+	}
+}
+
+u64 rdtsc()
+{
+	u32 lo, hi;
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((u64)hi << 32) | lo;
+}
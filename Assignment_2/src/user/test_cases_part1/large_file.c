@@ -0,0 +1,61 @@
+#include<ulib.h>
+
+static void fill(char *buf, int seed, int count)
+{
+	for(int i = 0; i < count; i++)
+		buf[i] = 'a' + (seed + i) % 26;
+}
+
+static int check(char *buf, int seed, int count)
+{
+	for(int i = 0; i < count; i++)
+		if(buf[i] != 'a' + (seed + i) % 26)
+			return 1;
+	return 0;
+}
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	char buf[4096];
+	int fd1, fd2, i, total = 0, bad = 0;
+
+	// one file growing well past a single page
+	fd1 = open("big.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	for(i = 0; i < 16; i++){
+		fill(buf, i, 4096);
+		if(write(fd1, buf, 4096) == 4096)
+			total += 4096;
+	}
+	printf("written = %d\n", total);
+	printf("size = %d\n", (int)lseek(fd1, 0, SEEK_END));
+
+	lseek(fd1, 0, SEEK_SET);
+	for(i = 0; i < 16; i++){
+		read(fd1, buf, 4096);
+		bad += check(buf, i, 4096);
+	}
+	printf("mismatches = %d\n", bad);
+
+	// two files growing in turns end up with several extents each
+	fd2 = open("big2.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	for(i = 0; i < 8; i++){
+		fill(buf, 100 + i, 3000);
+		write(fd1, buf, 3000);
+		fill(buf, 200 + i, 3000);
+		write(fd2, buf, 3000);
+	}
+	lseek(fd1, 65536, SEEK_SET);
+	lseek(fd2, 0, SEEK_SET);
+	bad = 0;
+	for(i = 0; i < 8; i++){
+		read(fd1, buf, 3000);
+		bad += check(buf, 100 + i, 3000);
+		read(fd2, buf, 3000);
+		bad += check(buf, 200 + i, 3000);
+	}
+	printf("interleaved mismatches = %d\n", bad);
+
+	close(fd1);
+	close(fd2);
+	return 0;
+}
@@ -0,0 +1,37 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	int fds[200], i;
+	char buf[8];
+	int create_fd = open("many.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	write(create_fd, "abcdefgh", 8);
+
+	// well past the 16 slots of ctx->files
+	for(i = 0; i < 200; i++)
+		fds[i] = open("many.txt", O_READ);
+	printf("first = %d last = %d\n", fds[0], fds[199]);
+
+	// the lowest free descriptor is handed out
+	close(fds[50]);
+	close(fds[10]);
+	printf("reused = %d\n", open("many.txt", O_READ));
+	printf("dup = %d\n", dup(fds[199]));
+	printf("dup2 = %d\n", dup2(create_fd, 700));
+
+	read(fds[199], buf, 4);
+	buf[4] = '\0';
+	printf("%s\n", buf);
+
+	// 700 shares the file (and offset) of create_fd
+	lseek(700, 2, SEEK_SET);
+	printf("read = %d ", read(700, buf, 3));
+	buf[3] = '\0';
+	printf("%s offset = %d\n", buf, (int)lseek(create_fd, 0, SEEK_CUR));
+
+	printf("dup2 over open = %d\n", dup2(fds[0], fds[1]));
+	printf("close = %d\n", close(700));
+	printf("read closed = %d\n", read(700, buf, 1));
+	printf("dup bad = %d\n", dup(1000));
+	return 0;
+}
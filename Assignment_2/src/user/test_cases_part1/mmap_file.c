@@ -0,0 +1,61 @@
+#include<ulib.h>
+
+static void fill(char *buf, int from, int count)
+{
+	for(int i = 0; i < count; i++)
+		buf[i] = 'a' + (from + i) % 26;
+}
+
+static int check(char *buf, int from, int count)
+{
+	for(int i = 0; i < count; i++)
+		if(buf[i] != 'a' + (from + i) % 26)
+			return 1;
+	return 0;
+}
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	char buf[4096];
+	char *shared, *private;
+	int fd, i, bad = 0;
+
+	// three full pages and a partial one
+	fd = open("mapped.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	for(i = 0; i < 3; i++){
+		fill(buf, i * 4096, 4096);
+		write(fd, buf, 4096);
+	}
+	fill(buf, 3 * 4096, 100);
+	write(fd, buf, 100);
+
+	shared = mmap_file(NULL, 4 * 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	bad = check(shared, 0, 3 * 4096 + 100);
+	printf("shared mismatches = %d\n", bad);
+	printf("past end of file = %d\n", shared[3 * 4096 + 100]);
+
+	// stores through a shared mapping reach the file
+	shared[4096] = 'X';
+	lseek(fd, 4096, SEEK_SET);
+	read(fd, buf, 1);
+	printf("read after store = %c\n", buf[0]);
+
+	// and writes to the file show up in the mapping
+	lseek(fd, 8192, SEEK_SET);
+	write(fd, "Y", 1);
+	printf("mapping after write = %c\n", shared[8192]);
+
+	// a private mapping of the second page copies on write
+	private = mmap_file(NULL, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 4096);
+	printf("private before = %c\n", private[0]);
+	private[0] = 'Z';
+	printf("private after = %c shared = %c\n", private[0], shared[4096]);
+
+	// offsets must be page aligned and inside the file
+	printf("unaligned = %d\n", (int)(long)mmap_file(NULL, 4096, PROT_READ, MAP_SHARED, fd, 100));
+	printf("past end = %d\n", (int)(long)mmap_file(NULL, 8192, PROT_READ, MAP_SHARED, fd, 3 * 4096));
+
+	printf("munmap = %d %d\n", munmap(private, 4096), munmap(shared, 4 * 4096));
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,39 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	char buf[4096];
+	char *shared, *private;
+	int fd, pid;
+
+	fd = open("cforked.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	for(int i = 0; i < 4096; i++)
+		buf[i] = 'a';
+	write(fd, buf, 4096);
+
+	shared = mmap_file(NULL, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	private = mmap_file(NULL, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+	// a MAP_SHARED mapping stays shared across cfork, a private one does not
+	pid = cfork();
+	if(pid == 0){
+		shared[0] = 'C';
+		private[1] = 'P';
+		sleep(20);
+		printf("child sees parent store = %c\n", shared[2]);
+		exit(0);
+	}
+	else if(pid > 0){
+		shared[2] = 'F';
+		sleep(10);
+		printf("parent sees child store = %c private = %c\n", shared[0], private[1]);
+		lseek(fd, 0, SEEK_SET);
+		read(fd, buf, 3);
+		printf("file = %c%c%c\n", buf[0], buf[1], buf[2]);
+		sleep(20);
+	}
+	else{
+		printf("cfork error\n");
+	}
+	return 0;
+}
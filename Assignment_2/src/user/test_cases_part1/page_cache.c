@@ -0,0 +1,54 @@
+#include<ulib.h>
+
+static void fill(char *buf, int from, int count)
+{
+	for(int i = 0; i < count; i++)
+		buf[i] = 'a' + (from + i) % 26;
+}
+
+static int check(char *buf, int from, int count)
+{
+	for(int i = 0; i < count; i++)
+		if(buf[i] != 'a' + (from + i) % 26)
+			return 1;
+	return 0;
+}
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	char buf[3000];
+	int fd, copy, pos, bad = 0;
+
+	// 1.5MB in page-unaligned writes, more than the page cache holds
+	fd = open("cached.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	for(pos = 0; pos < 1536000; pos += 3000){
+		fill(buf, pos, 3000);
+		write(fd, buf, 3000);
+	}
+	printf("size = %d\n", (int)lseek(fd, 0, SEEK_END));
+
+	// overwrite a range straddling pages that were written back
+	lseek(fd, 5000, SEEK_SET);
+	fill(buf, 5000, 3000);
+	write(fd, buf, 3000);
+
+	// dirty pages must reach the store before sendfile reads it
+	copy = open("cached_copy.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	lseek(fd, 0, SEEK_SET);
+	printf("sent = %d\n", sendfile(copy, fd, NULL, 1536000));
+	close(fd);
+
+	fd = open("cached.txt", O_READ);
+	lseek(copy, 0, SEEK_SET);
+	for(pos = 0; pos < 1536000; pos += 3000){
+		read(fd, buf, 3000);
+		bad += check(buf, pos, 3000);
+		read(copy, buf, 3000);
+		bad += check(buf, pos, 3000);
+	}
+	printf("mismatches = %d\n", bad);
+
+	close(fd);
+	close(copy);
+	return 0;
+}
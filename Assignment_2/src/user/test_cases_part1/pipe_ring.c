@@ -0,0 +1,68 @@
+#include<ulib.h>
+
+#define TOTAL 20000
+#define CHUNK 3000
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	char buf[CHUNK];
+	int pfd[2], qfd[2], fd, i, n, got, sum, ok;
+
+	// the old rules still hold for pipe(): all or nothing
+	pipe(pfd);
+	printf("short pipe read = %d\n", read(pfd[0], buf, 1));
+	close(pfd[0]);
+	close(pfd[1]);
+
+	printf("pipe2 too big = %d\n", pipe2(pfd, PIPE_MAX_PAGES * 4096 + 1, PIPE_WAIT));
+
+	// a blocking 8k ring, the writer stalls until the reader catches up
+	pipe2(pfd, 8000, PIPE_WAIT);
+	if(fork() == 0){
+		close(pfd[0]);
+		for(i = 0; i < CHUNK; i++)
+			buf[i] = 'a' + i % 26;
+		for(sum = 0; sum < TOTAL; sum += n)
+			n = write(pfd[1], buf, TOTAL - sum < CHUNK ? TOTAL - sum : CHUNK);
+		close(pfd[1]);
+		exit(0);
+	}
+	close(pfd[1]);
+	got = 0;
+	ok = 1;
+	while((n = read(pfd[0], buf, 1000)) > 0){
+		for(i = 0; i < n; i++)
+			if(buf[i] != 'a' + ((got + i) % CHUNK) % 26)
+				ok = 0;
+		got += n;
+	}
+	printf("read %d intact %d eof %d\n", got, ok, n);
+	close(pfd[0]);
+
+	// tee leaves the data in the first pipe, splice moves it on to a file
+	pipe2(pfd, 0, PIPE_WAIT);
+	pipe2(qfd, 0, PIPE_WAIT);
+	write(pfd[1], "spliced bytes", 13);
+	printf("tee = %d\n", tee(pfd[0], qfd[1], 100));
+	n = read(qfd[0], buf, 100);
+	buf[n] = '\0';
+	printf("teed: %s\n", buf);
+	fd = open("spliced.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	printf("splice to file = %d\n", splice(pfd[0], fd, 100));
+	printf("splice same pipe = %d\n", splice(pfd[0], pfd[1], 1));
+
+	// and back from the file into a pipe
+	lseek(fd, 0, SEEK_SET);
+	printf("splice from file = %d\n", splice(fd, qfd[1], 7));
+	n = read(qfd[0], buf, 100);
+	buf[n] = '\0';
+	printf("from file: %s\n", buf);
+	close(qfd[1]);
+	printf("eof = %d\n", read(qfd[0], buf, 1));
+
+	close(fd);
+	close(pfd[0]);
+	close(pfd[1]);
+	close(qfd[0]);
+	return 0;
+}
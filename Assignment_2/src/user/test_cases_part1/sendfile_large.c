@@ -0,0 +1,65 @@
+#include<ulib.h>
+
+static void fill(char *buf, int from, int count)
+{
+	for(int i = 0; i < count; i++)
+		buf[i] = 'a' + (from + i) % 26;
+}
+
+static int check(char *buf, int from, int count)
+{
+	for(int i = 0; i < count; i++)
+		if(buf[i] != 'a' + (from + i) % 26)
+			return 1;
+	return 0;
+}
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	char buf[4096];
+	int src, dst, fd[2], i, bad = 0;
+	long offset;
+
+	src = open("sf_src.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	for(i = 0; i < 5; i++){
+		fill(buf, i * 4096, 4096);
+		write(src, buf, 4096);
+	}
+
+	// whole file in one call, well past a page
+	dst = open("sf_dst.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+	lseek(src, 0, SEEK_SET);
+	printf("sent = %d\n", sendfile(dst, src, NULL, 30000));
+	printf("src pos = %d\n", (int)lseek(src, 0, SEEK_CUR));
+	printf("dst size = %d\n", (int)lseek(dst, 0, SEEK_END));
+	lseek(dst, 0, SEEK_SET);
+	for(i = 0; i < 5; i++){
+		read(dst, buf, 4096);
+		bad += check(buf, i * 4096, 4096);
+	}
+	printf("mismatches = %d\n", bad);
+
+	// explicit offset leaves the file position alone
+	offset = 10000;
+	printf("sent = %d\n", sendfile(dst, src, &offset, 5000));
+	printf("offset = %d\n", (int)offset);
+	printf("src pos = %d\n", (int)lseek(src, 0, SEEK_CUR));
+
+	// pipe target
+	pipe(fd);
+	offset = 26;
+	printf("sent to pipe = %d\n", sendfile(fd[1], src, &offset, 26));
+	read(fd[0], buf, 26);
+	printf("pipe mismatches = %d\n", check(buf, 0, 26));
+
+	// console target
+	offset = 0;
+	sendfile(1, src, &offset, 26);
+	printf("\n");
+
+	close(fd[0]);
+	close(fd[1]);
+	close(src);
+	close(dst);
+	return 0;
+}
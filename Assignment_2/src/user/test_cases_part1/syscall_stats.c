@@ -0,0 +1,33 @@
+#include<ulib.h>
+
+struct syscall_stats st;
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	char buf[16];
+	int pfd[2], i;
+
+	pipe(pfd);
+	syscall_stats(NULL, 1);
+
+	// nothing printed until the counters are read back
+	for(i = 0; i < 10; i++)
+		getpid();
+	for(i = 0; i < 3; i++)
+		write(pfd[1], "hello", 5);
+	read(pfd[0], buf, 15);
+	read(pfd[0], buf, 1);	// empty, an error but still a call
+
+	syscall_stats(&st, 0);
+	printf("getpid calls = %d\n", (int)st.calls[SYSCALL_GETPID].count);
+	printf("write calls = %d read calls = %d\n", (int)st.calls[SYSCALL_WRITE].count,
+		(int)st.calls[SYSCALL_READ].count);
+	printf("p50 <= p99: %d\n", st.calls[SYSCALL_GETPID].p50 <= st.calls[SYSCALL_GETPID].p99);
+	printf("pipe reads %d (%d bytes) writes %d (%d bytes)\n", (int)st.files[4].reads,
+		(int)st.files[4].read_bytes, (int)st.files[4].writes, (int)st.files[4].write_bytes);
+	printf("regular reads %d\n", (int)st.files[3].reads);
+
+	close(pfd[0]);
+	close(pfd[1]);
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	struct iovec iov[3];
+	char name[8], age[4], city[8], buf[32];
+	int fd, pfd[2];
+
+	fd = open("records.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+	// gather write of one record
+	iov[0].iov_base = "alice,";
+	iov[0].iov_len = 6;
+	iov[1].iov_base = "30,";
+	iov[1].iov_len = 3;
+	iov[2].iov_base = "delhi\n";
+	iov[2].iov_len = 6;
+	printf("writev = %d\n", (int)writev(fd, iov, 3));
+	printf("offset = %d\n", (int)lseek(fd, 0, SEEK_CUR));
+
+	// scatter read of it
+	lseek(fd, 0, SEEK_SET);
+	iov[0].iov_base = name;
+	iov[0].iov_len = 6;
+	iov[1].iov_base = age;
+	iov[1].iov_len = 3;
+	iov[2].iov_base = city;
+	iov[2].iov_len = 6;
+	printf("readv = %d\n", (int)readv(fd, iov, 3));
+	name[5] = age[2] = city[5] = '\0';
+	printf("%s %s %s\n", name, age, city);
+
+	// positioned I/O leaves the file offset alone
+	lseek(fd, 2, SEEK_SET);
+	printf("pwrite = %d\n", pwrite(fd, "31", 2, 6));
+	printf("pread = %d\n", pread(fd, buf, 15, 0));
+	buf[14] = '\0';
+	printf("%s offset = %d\n", buf, (int)lseek(fd, 0, SEEK_CUR));
+	printf("pwrite past end = %d\n", pwrite(fd, "x", 1, 100));
+	printf("pread past end = %d\n", pread(fd, buf, 4, 100));
+
+	iov[0].iov_base = "bob,";
+	iov[0].iov_len = 4;
+	iov[1].iov_base = "25,pune\n";
+	iov[1].iov_len = 8;
+	printf("pwritev = %d\n", (int)pwritev(fd, iov, 2, 15));
+	iov[0].iov_base = name;
+	iov[0].iov_len = 4;
+	iov[1].iov_base = city;
+	iov[1].iov_len = 8;
+	printf("preadv = %d\n", (int)preadv(fd, iov, 2, 15));
+	name[3] = city[7] = '\0';
+	printf("%s %s offset = %d\n", name, city, (int)lseek(fd, 0, SEEK_CUR));
+
+	// pipes and the console take vectors too, but not positions
+	pipe(pfd);
+	iov[0].iov_base = "through ";
+	iov[0].iov_len = 8;
+	iov[1].iov_base = "a pipe\n";
+	iov[1].iov_len = 7;
+	writev(pfd[1], iov, 2);
+	printf("pread on pipe = %d\n", pread(pfd[0], buf, 4, 0));
+	read(pfd[0], buf, 15);
+	iov[0].iov_base = buf;
+	iov[0].iov_len = 15;
+	writev(1, iov, 1);
+
+	close(pfd[0]);
+	close(pfd[1]);
+	close(fd);
+	return 0;
+}
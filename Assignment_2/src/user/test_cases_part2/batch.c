@@ -0,0 +1,48 @@
+#include<ulib.h>
+
+#define BATCH 200
+
+struct message msgs[BATCH];
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	int fd, pid, i, st, in_order;
+	
+	// parent creates message queue
+	fd = create_msg_queue();
+	
+	pid = fork();
+	if(pid == 0){
+		// wait until the queue is full
+		while(get_msg_count(fd) < 128);
+		
+		st = msg_queue_rcv_batch(fd, msgs, 10);
+		in_order = 1;
+		for(i = 0; i < st; ++i)
+			if(msgs[i].msg_txt[0] != 'a' + i)
+				in_order = 0;
+		printf("Child got %d, in order: %d\n", st, in_order);
+		st = msg_queue_rcv_batch(fd, msgs, BATCH);
+		printf("Child got %d more, then %d\n", st, msg_queue_rcv_batch(fd, msgs, BATCH));
+	}
+	else if(pid > 0){
+		for(i = 0; i < BATCH; ++i){
+			msgs[i].from_pid = getpid();
+			msgs[i].to_pid = pid;
+			msgs[i].msg_txt[0] = 'a' + i % 26;
+			msgs[i].msg_txt[1] = '\0';
+		}
+		// stops at the message to a non-member
+		msgs[2].to_pid = 99;
+		printf("sent = %d\n", msg_queue_send_batch(fd, msgs, 4));
+		printf("bad first = %d\n", msg_queue_send_batch(fd, msgs + 2, 2));
+		msgs[2].to_pid = pid;
+		printf("until full = %d\n", msg_queue_send_batch(fd, msgs + 2, BATCH - 2));
+		// stay a member till the child is done
+		sleep(40);
+	}
+	else{
+		printf("fork error\n");
+	}
+	return 0;
+}
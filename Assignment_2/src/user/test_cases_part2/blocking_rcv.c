@@ -0,0 +1,52 @@
+
+#include<ulib.h>
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	int fd, pid, i, st, sent;
+	struct message msg;
+	
+	// parent creates message queue
+	fd = create_msg_queue();
+	
+	pid = fork();
+	if(pid == 0){
+		// nothing is sent for a while, gives up after 5 ticks
+		st = msg_queue_rcv_wait(fd, &msg, 5);
+		printf("timeout = %d\n", st);
+
+		// sleeps till the parent's message arrives
+		st = msg_queue_rcv_wait(fd, &msg, 0);
+		printf("Child got %d: %s\n", st, msg.msg_txt);
+
+		// fill the queue, the last send waits for the parent to receive
+		msg.to_pid = msg.from_pid;
+		msg.from_pid = getpid();
+		sent = 0;
+		for(i = 0; i < 128; ++i)
+			if(msg_queue_send(fd, &msg) == 1)
+				++sent;
+		printf("sent = %d\n", sent);
+		st = msg_queue_send_wait(fd, &msg, 0);
+		printf("blocked send = %d\n", st);
+	}
+	else if(pid > 0){
+		sleep(20);
+
+		msg.from_pid = getpid();	
+		msg.to_pid = pid;
+		msg.msg_txt[0] = 'M';
+		msg.msg_txt[1] = 'S';
+		msg.msg_txt[2] = 'G';
+		msg.msg_txt[3] = '\0';
+		msg_queue_send(fd, &msg);
+
+		// make room for the child's last message
+		while(get_msg_count(fd) < 128);
+		msg_queue_rcv(fd, &msg);
+		sleep(20);
+	}
+	else{
+		printf("fork error\n");
+	}
+	return 0;
+}
@@ -0,0 +1,49 @@
+#include<ulib.h>
+
+// cfork and vfork children join the queue like fork children, and leave it
+// on exit without taking the parent's descriptor with them
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	int fd, pid;
+	struct msg_queue_member_info info;
+	struct message msg;
+
+	fd = create_msg_queue();
+
+	pid = cfork();
+	if(pid == 0){
+		get_member_info(fd, &info);
+		printf("cfork child members: %d\n", info.member_count);
+		exit(0);
+	}
+	if(pid < 0){
+		printf("cfork error\n");
+		return 0;
+	}
+	sleep(20);
+	get_member_info(fd, &info);
+	printf("after cfork child exit: %d\n", info.member_count);
+
+	pid = vfork();
+	if(pid == 0){
+		get_member_info(fd, &info);
+		printf("vfork child members: %d\n", info.member_count);
+		exit(0);
+	}
+	if(pid < 0){
+		printf("vfork error\n");
+		return 0;
+	}
+	get_member_info(fd, &info);
+	printf("after vfork child exit: %d\n", info.member_count);
+
+	// the queue is still the parent's
+	msg.from_pid = getpid();
+	msg.to_pid = getpid();
+	msg.msg_txt[0] = 'S';
+	msg.msg_txt[1] = '\0';
+	printf("send = %d\n", msg_queue_send(fd, &msg));
+	printf("rcv = %d %s\n", msg_queue_rcv(fd, &msg), msg.msg_txt);
+	return 0;
+}
@@ -0,0 +1,82 @@
+#include<ulib.h>
+
+#define BIG 3000
+
+char data[MSG_DATA_MAX];
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	int fd, pid, i, st, ok;
+	struct msg_buf buf;
+	struct message msg;
+	
+	// parent creates message queue
+	fd = create_msg_queue();
+	
+	pid = fork();
+	if(pid == 0){
+		// wait for the three messages from the parent
+		while(get_msg_count(fd) < 3);
+
+		// a fixed size receive cannot take it
+		printf("rcv: %d\n", msg_queue_rcv(fd, &msg));
+
+		buf.len = MSG_DATA_MAX;
+		buf.flags = 0;
+		buf.data = data;
+		st = msg_queue_rcv_buf(fd, &buf);
+		ok = 1;
+		for(i = 0; i < buf.len; ++i)
+			if(data[i] != (char)i)
+				ok = 0;
+		printf("rcv_buf: %d len = %d intact: %d\n", st, buf.len, ok);
+
+		// too small, the message stays
+		buf.len = 4;
+		printf("short buffer: %d\n", msg_queue_rcv_buf(fd, &buf));
+		buf.len = MSG_DATA_MAX;
+		st = msg_queue_rcv_buf(fd, &buf);
+		data[buf.len] = '\0';
+		printf("rcv_buf: %d len = %d %s\n", st, buf.len, data);
+
+		// the page is mapped instead of copied
+		buf.len = 0;
+		buf.flags = MSG_MAP;
+		st = msg_queue_rcv_buf(fd, &buf);
+		ok = buf.data != data;
+		for(i = 0; i < buf.len; ++i)
+			if(buf.data[i] != 'p')
+				ok = 0;
+		printf("mapped: %d len = %d intact: %d\n", st, buf.len, ok);
+		munmap(buf.data, MSG_DATA_MAX);
+	}
+	else if(pid > 0){
+		buf.from_pid = getpid();
+		buf.to_pid = pid;
+		buf.flags = 0;
+		buf.data = data;
+		buf.len = MSG_DATA_MAX + 1;
+		printf("too long: %d\n", msg_queue_send_buf(fd, &buf));
+
+		for(i = 0; i < BIG; ++i)
+			data[i] = i;
+		buf.len = BIG;
+		msg_queue_send_buf(fd, &buf);
+
+		buf.len = 11;
+		buf.data = "hello world";
+		msg_queue_send_buf(fd, &buf);
+
+		buf.data = data;
+		for(i = 0; i < MSG_DATA_MAX; ++i)
+			data[i] = 'p';
+		buf.len = MSG_DATA_MAX;
+		msg_queue_send_buf(fd, &buf);
+		// stay a member till the child is done
+		sleep(40);
+	}
+	else{
+		printf("fork error\n");
+	}
+	return 0;
+}
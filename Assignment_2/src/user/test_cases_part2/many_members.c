@@ -0,0 +1,56 @@
+#include<ulib.h>
+
+// Grows a queue past the old limit of 4 members. MAX_PROCESSES is 7, so
+// this is as many members as a queue can get here, far from the 64 the
+// queue takes; the 64 member fan-out is not exercised.
+#define CHILDREN 5
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	int fd, pid, i, st, replies;
+	int pids[CHILDREN];
+	struct msg_queue_member_info info;
+	struct message msg;
+	
+	// parent creates message queue
+	fd = create_msg_queue();
+	
+	for(i = 0; i < CHILDREN; ++i){
+		pid = fork();
+		if(pid == 0){
+			// wait for the broadcast and answer it
+			st = msg_queue_rcv_wait(fd, &msg, 0);
+			msg.to_pid = msg.from_pid;
+			msg.from_pid = getpid();
+			msg.msg_txt[0] = 'A';
+			msg.msg_txt[1] = '\0';
+			msg_queue_send(fd, &msg);
+			// stay a member till the parent is done
+			sleep(40);
+			return 0;
+		}
+		if(pid < 0){
+			printf("fork error\n");
+			return 0;
+		}
+		pids[i] = pid;
+	}
+
+	st = get_member_info(fd, &info);
+	printf("Members: %d\n", info.member_count);
+
+	// the first child cannot answer
+	msg_queue_block(fd, pids[0]);
+
+	msg.from_pid = getpid();
+	msg.to_pid = BROADCAST_PID;
+	msg.msg_txt[0] = 'B';
+	msg.msg_txt[1] = '\0';
+	printf("Broadcast to %d\n", msg_queue_send(fd, &msg));
+
+	replies = 0;
+	while(msg_queue_rcv_wait(fd, &msg, 20) == 1)
+		++replies;
+	printf("Replies: %d\n", replies);
+	return 0;
+}
@@ -0,0 +1,44 @@
+
+#include<ulib.h>
+
+#define MSGS 100
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	int fd, pid, i, st, in_order;
+	struct message msg;
+	
+	// parent creates message queue
+	fd = create_msg_queue();
+	
+	pid = fork();
+	if(pid == 0){
+		// wait until every message from the parent is queued
+		while(get_msg_count(fd) < MSGS);
+		
+		in_order = 1;
+		for(i = 0; i < MSGS; ++i){
+			st = msg_queue_rcv(fd, &msg);
+			if(st != 1 || msg.msg_txt[0] != 'a' + i % 26 || msg.msg_txt[1] != '0' + i / 26)
+				in_order = 0;
+		}
+		printf("Child got %d messages, in order: %d\n", MSGS, in_order);
+		printf("Left: %d, receive on empty: %d\n", get_msg_count(fd), msg_queue_rcv(fd, &msg));
+	}
+	else if(pid > 0){
+		msg.from_pid = getpid();	
+		msg.to_pid = pid;
+		msg.msg_txt[2] = '\0';
+		for(i = 0; i < MSGS; ++i){
+			msg.msg_txt[0] = 'a' + i % 26;
+			msg.msg_txt[1] = '0' + i / 26;
+			msg_queue_send(fd, &msg);
+		}
+		// stay a member till the child is done
+		sleep(40);
+	}
+	else{
+		printf("fork error\n");
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	struct pollfd fds[3];
+	struct message msg;
+	int mq, pfd[2], ppid, n;
+	char buf[8];
+
+	mq = create_msg_queue();
+	pipe2(pfd, 0, PIPE_WAIT);
+	ppid = getpid();
+
+	// nothing to read, but room to write
+	fds[0].fd = pfd[0];
+	fds[0].events = POLLIN;
+	fds[1].fd = pfd[1];
+	fds[1].events = POLLOUT;
+	fds[2].fd = 100;
+	fds[2].events = POLLIN;
+	n = poll(fds, 3, 0);
+	printf("now: %d in %d out %d bad %d\n", n, fds[0].revents, fds[1].revents, fds[2].revents);
+	n = poll(fds, 1, 3);
+	printf("timeout: %d\n", n);
+
+	if(fork() == 0){
+		sleep(2);
+		write(pfd[1], "ping", 4);
+		sleep(2);
+		msg.from_pid = getpid();
+		msg.to_pid = ppid;
+		msg.msg_txt[0] = 'Q';
+		msg_queue_send(mq, &msg);
+		exit(0);
+	}
+	close(pfd[1]);
+
+	// wait on the pipe and the queue together
+	fds[0].fd = pfd[0];
+	fds[0].events = POLLIN;
+	fds[1].fd = mq;
+	fds[1].events = POLLIN;
+	n = poll(fds, 2, -1);
+	read(pfd[0], buf, 4);
+	buf[4] = '\0';
+	printf("first: %d pipe %d queue %d %s\n", n, fds[0].revents, fds[1].revents, buf);
+	n = poll(fds, 2, -1);
+	msg_queue_rcv(mq, &msg);
+	printf("second: %d pipe %d queue %d %c\n", n, fds[0].revents, fds[1].revents, msg.msg_txt[0]);
+
+	// the child exits, the pipe hangs up
+	n = poll(fds, 1, -1);
+	printf("hangup: %d pipe %d eof %d\n", n, fds[0].revents, read(pfd[0], buf, 1));
+
+	close(pfd[0]);
+	msg_queue_close(mq);
+	return 0;
+}
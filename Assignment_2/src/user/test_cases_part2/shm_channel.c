@@ -0,0 +1,37 @@
+#include<ulib.h>
+
+#define COUNT 1000
+#define WORDS 15	// fills a 64 byte slot with the length word
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	struct shm_ring *ring;
+	int msg[WORDS + 1];
+	int fd, i, n, ok;
+
+	printf("bad slots = %d\n", shm_channel_create(12, 64));
+
+	// a small ring, so the producer keeps running into a full one
+	fd = shm_channel_create(16, 64);
+	if(fork() == 0){
+		ring = shm_channel_map(fd);
+		for(i = 0; i < COUNT; i++){
+			msg[0] = i;
+			shm_channel_send(fd, ring, msg, (i % WORDS + 1) * sizeof(int));
+		}
+		exit(0);
+	}
+
+	// mapped after the fork, so both sides see the same pages
+	ring = shm_channel_map(fd);
+	printf("too long = %d\n", shm_channel_send(fd, ring, msg, (WORDS + 1) * sizeof(int)));
+	ok = 1;
+	for(i = 0; i < COUNT; i++){
+		n = shm_channel_recv(fd, ring, msg, sizeof(msg));
+		if(msg[0] != i || n != (i % WORDS + 1) * sizeof(int))
+			ok = 0;
+	}
+	printf("received %d in order %d\n", i, ok);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,31 @@
+#include<ulib.h>
+
+#define COUNT 1000
+
+// the ring is mapped before cfork, both sides keep using that mapping
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	struct shm_ring *ring;
+	int msg[4];
+	int fd, i, ok;
+
+	fd = shm_channel_create(16, 64);
+	ring = shm_channel_map(fd);
+	if(cfork() == 0){
+		for(i = 0; i < COUNT; i++){
+			msg[0] = i;
+			shm_channel_send(fd, ring, msg, sizeof(msg));
+		}
+		exit(0);
+	}
+
+	ok = 1;
+	for(i = 0; i < COUNT; i++){
+		if(shm_channel_recv(fd, ring, msg, sizeof(msg)) != sizeof(msg) || msg[0] != i)
+			ok = 0;
+	}
+	printf("received %d in order %d\n", i, ok);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include<ulib.h>
+
+#define CHILDREN 3
+#define TOPIC 5
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	int fd, pid, ch, i, topic, bcast, ppid;
+	int pids[CHILDREN], answers[CHILDREN];
+	struct message msg;
+	
+	// parent creates message queue
+	fd = create_msg_queue();
+	ppid = getpid();
+	
+	for(ch = 0; ch < CHILDREN; ++ch){
+		pid = fork();
+		if(pid == 0){
+			// even children listen to the topic
+			if(ch % 2 == 0)
+				msg_queue_subscribe(fd, TOPIC);
+			msg.from_pid = getpid();
+			msg.to_pid = ppid;
+			msg.msg_txt[0] = 'R';
+			msg_queue_send(fd, &msg);
+
+			// count topic messages till the broadcast comes
+			topic = 0;
+			do{
+				msg_queue_rcv_wait(fd, &msg, 0);
+				if(msg.msg_txt[0] == 'T' && msg.to_pid == TOPIC_PID(TOPIC))
+					++topic;
+			}while(msg.msg_txt[0] != 'B');
+			bcast = msg.to_pid == getpid();
+
+			msg.to_pid = msg.from_pid;
+			msg.from_pid = getpid();
+			msg.msg_txt[0] = '0' + topic;
+			msg.msg_txt[1] = '0' + bcast;
+			msg_queue_send(fd, &msg);
+			// stay a member till the parent is done
+			sleep(40);
+			return 0;
+		}
+		if(pid < 0){
+			printf("fork error\n");
+			return 0;
+		}
+		pids[ch] = pid;
+	}
+
+	// every child is ready once it has subscribed
+	for(i = 0; i < CHILDREN; ++i)
+		msg_queue_rcv_wait(fd, &msg, 0);
+
+	msg.from_pid = getpid();
+	msg.to_pid = TOPIC_PID(TOPIC);
+	msg.msg_txt[0] = 'T';
+	printf("Topic sent to %d\n", msg_queue_send(fd, &msg));
+	msg.to_pid = BROADCAST_PID;
+	msg.msg_txt[0] = 'B';
+	printf("Broadcast sent to %d\n", msg_queue_send(fd, &msg));
+
+	// answers come back in any order
+	for(i = 0; i < CHILDREN; ++i){
+		msg_queue_rcv_wait(fd, &msg, 0);
+		for(ch = 0; ch < CHILDREN; ++ch)
+			if(pids[ch] == msg.from_pid)
+				answers[ch] = (msg.msg_txt[0] - '0') * 10 + msg.msg_txt[1] - '0';
+	}
+	for(ch = 0; ch < CHILDREN; ++ch)
+		printf("Child %d: topic %d broadcast %d\n", ch, answers[ch] / 10, answers[ch] % 10);
+	return 0;
+}
@@ -52,6 +52,14 @@ typedef long long s64;
 #define SYSCALL_CLOSE       29
 #define SYSCALL_LSEEK       30
 #define SYSCALL_SENDFILE    38
+#define SYSCALL_MEMOPS_BENCH 39
+#define SYSCALL_MMAP_FILE   40
+#define SYSCALL_READV       41
+#define SYSCALL_WRITEV      42
+#define SYSCALL_PREAD       43
+#define SYSCALL_PWRITE      44
+#define SYSCALL_PREADV      45
+#define SYSCALL_PWRITEV     46
 
 // system call definitions for message queue
 #define SYSCALL_CREATE_MSG_QUEUE 31
@@ -61,9 +69,40 @@ typedef long long s64;
 #define SYSCALL_MSG_QUEUE_RCV 35
 #define SYSCALL_MSG_QUEUE_SEND 36
 #define SYSCALL_MSG_QUEUE_CLOSE 37
+#define SYSCALL_MSG_QUEUE_RCV_WAIT 47	// blocking variants, timeout in ticks (0: none)
+#define SYSCALL_MSG_QUEUE_SEND_WAIT 48
+#define SYSCALL_MSG_QUEUE_SEND_BATCH 49	// arrays of messages, partial counts
+#define SYSCALL_MSG_QUEUE_RCV_BATCH 50
+#define SYSCALL_MSG_QUEUE_SEND_BUF 51	// variable length messages
+#define SYSCALL_MSG_QUEUE_RCV_BUF 52
+#define SYSCALL_MSG_QUEUE_SUBSCRIBE 53	// topics
+#define SYSCALL_PIPE2       54	// pipe with a ring size and flags
+#define SYSCALL_SPLICE      55	// pipe to pipe or file, in the kernel
+#define SYSCALL_TEE         56
+#define SYSCALL_POLL        57	// timeout in ticks (0: none, negative: forever)
+#define SYSCALL_SYSCALL_STATS 58	// latency and file I/O counters
+#define SYSCALL_SHM_CHANNEL_CREATE 59	// shared memory rings
+#define SYSCALL_SHM_CHANNEL_MAP 60
+#define SYSCALL_SHM_CHANNEL_WAIT 61
+#define SYSCALL_SHM_CHANNEL_WAKE 62
 
 // constants for message queue
-#define MAX_MEMBERS 4
+#define MAX_MEMBERS 64
+#define MSG_DATA_MAX 4096	// largest msg_buf payload
+#define MSG_MAP 1	// msg_buf flag: map a page sized payload instead of copying it
+#define MAX_TOPICS 64
+
+// poll events, ERR, HUP and NVAL come whether asked for or not
+#define POLLIN   0x1
+#define POLLOUT  0x4
+#define POLLERR  0x8
+#define POLLHUP  0x10
+#define POLLNVAL 0x20
+
+// constants for pipes
+#define PIPE_MAX_SIZE 4096	// ring of pipe()
+#define PIPE_MAX_PAGES 16	// largest pipe2() size in pages
+#define PIPE_WAIT 0x1	// pipe2() flag: read and write block
 
 #define MAP_RD  0x0
 #define MAP_WR  0x1
@@ -71,6 +110,8 @@ typedef long long s64;
 #define NONE 0
 #define MAP_FIXED 1
 #define MAP_POPULATE 2
+#define MAP_PRIVATE 0
+#define MAP_SHARED 4
 
 #define PROT_READ 1
 #define PROT_WRITE 2
@@ -100,6 +141,7 @@ enum{
 #define EACCES 4
 #define ENOMEM 5
 #define EOTHERS 6
+#define EMFILE 7	// descriptor table full
 
 struct os_stats{
 	u64 swapper_invocations;
@@ -114,6 +156,10 @@ struct os_stats{
 	u64 num_vm_area;
 	u64 mmap_page_faults;
 	u64 user_reg_pages; // used to check copy-on-write 
+	u64 file_objects;
+	u64 pcache_hits;
+	u64 pcache_misses;
+	u64 pcache_writebacks;
 };
 
 struct os_configs{
@@ -128,7 +174,16 @@ struct msg_queue_member_info{
 	u32 member_pid[MAX_MEMBERS];
 };	
 
-#define BROADCAST_PID 0xffffffff 
+struct msg_buf{
+	u32 from_pid;
+	u32 to_pid;
+	u32 len;	// payload bytes, on receive the room in data first
+	u32 flags;	// MSG_MAP
+	char *data;	// a MSG_MAP receive may point it at a mapped page
+};
+
+#define BROADCAST_PID 0xffffffff
+#define TOPIC_PID(t) (0xffffff00 + (t))	// to_pid reaching the subscribers of topic t 
 #define MAX_TXT_SIZE 24 
 struct message{
 
@@ -139,6 +194,92 @@ struct message{
 	char msg_txt[MAX_TXT_SIZE];
 };
 
+// one buffer of readv/writev/preadv/pwritev, at most IOV_MAX per call
+#define IOV_MAX 64
+struct iovec{
+	void *iov_base;
+	u64 iov_len;
+};
+
+// one descriptor of poll(), revents is filled in
+struct pollfd{
+	int fd;
+	short events;
+	short revents;
+};
+
+// argument block of SYSCALL_MMAP_FILE, see mmap_file()
+struct mmap_file_args{
+	u64 addr;
+	u32 length;
+	u32 prot;
+	u32 flags;
+	int fd;
+	u64 offset;
+};
+
+// kernel copy/zero implementations, see memops_bench()
+enum{
+	MEMOPS_BYTE,
+	MEMOPS_WORD,
+	MEMOPS_REP_MOVSQ,
+	MEMOPS_REP_MOVSB,
+	MEMOPS_SSE,
+	MEMOPS_AVX,
+	MAX_MEMOPS
+};
+
+struct memops_bench{
+	u64 src;
+	u64 dst;
+	u64 size;
+	u64 iterations;
+	u64 available;
+	u64 selected;
+	u64 copy_cycles[MAX_MEMOPS];
+	u64 zero_cycles[MAX_MEMOPS];
+};
+
+// single producer, single consumer ring shared by two processes, see shm_channel_send()
+#define SHM_CHANNEL_PAGES 16
+#define SHM_CACHE_LINE 64
+#define SHM_RING_DATA 256	// offset of slot 0 from the ring
+#define SHM_WAIT_DATA  0x1
+#define SHM_WAIT_SPACE 0x2
+
+struct shm_ring{
+	u32 head;		// written by the consumer only
+	u8 pad_head[SHM_CACHE_LINE - 4];
+	u32 tail;		// written by the producer only
+	u8 pad_tail[SHM_CACHE_LINE - 4];
+	u32 slots;
+	u32 slot_size;		// a u32 length and the message
+	u32 waiting;		// SHM_WAIT_* of a side parked in the kernel
+};
+
+// latency of a system call number, see syscall_stats()
+#define MAX_SYSCALLS 64
+struct syscall_stat{
+	u64 count;
+	u64 cycles;
+	u64 p50;		// cycles, upper bound of the log2 bucket
+	u64 p99;
+};
+
+// traffic per file type: stdin, stdout, stderr, regular, pipe, msg_queue, shm_channel
+#define FILE_TYPES 7
+struct file_io_stat{
+	u64 reads;
+	u64 read_bytes;
+	u64 writes;
+	u64 write_bytes;
+};
+
+struct syscall_stats{
+	struct syscall_stat calls[MAX_SYSCALLS];
+	struct file_io_stat files[FILE_TYPES];
+};
+
 extern void exit(int);
 extern int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5);
 extern void exit(int code);
@@ -157,6 +298,7 @@ extern long physinfo();
 extern int printf(char *format,...);
 extern void* mmap(void *addr, int length, int prot, int flags);
 extern int munmap(void *addr, int length);
+extern void* mmap_file(void *addr, int length, int prot, int flags, int fd, long offset);
 extern int mprotect(void *addr, int length, int prot);
 extern int pmap(int details);
 extern long get_user_page_stats();
@@ -165,12 +307,32 @@ extern long get_cow_fault_stats();
 extern int open(char * filename, int mode, ...);
 extern int write(int fd, void * buf, int count);
 extern int read(int fd, void * buf, int count);
+extern long readv(int fd, struct iovec *iov, int iovcnt);
+extern long writev(int fd, struct iovec *iov, int iovcnt);
+extern int pread(int fd, void *buf, int count, long offset);
+extern int pwrite(int fd, void *buf, int count, long offset);
+extern long preadv(int fd, struct iovec *iov, int iovcnt, long offset);
+extern long pwritev(int fd, struct iovec *iov, int iovcnt, long offset);
 extern int pipe(int fd[2]);
+extern int pipe2(int fd[2], int size, int flags);
+extern int splice(int infd, int outfd, int count);
+extern int tee(int infd, int outfd, int count);
+extern int poll(struct pollfd *fds, int nfds, int timeout);
+extern int shm_channel_create(int slots, int slot_size);
+extern struct shm_ring *shm_channel_map(int fd);
+extern int shm_channel_wait(int fd, int what, int timeout);
+extern int shm_channel_wake(int fd);
+extern int shm_channel_send(int fd, struct shm_ring *ring, void *msg, int len);
+extern int shm_channel_recv(int fd, struct shm_ring *ring, void *buf, int len);
 extern int dup(int oldfd);
 extern int dup2(int oldfd, int newfd);
 extern int close(int fd);
 extern long lseek(int fd, long offset, int whence);
 extern int ustrcmp(char * s, char * d);
+extern u64 rdtsc();
+extern int memops_bench(struct memops_bench *bench);
+extern int syscall_stats(struct syscall_stats *st, int reset);
+extern void print_syscall_stats(struct syscall_stats *st);
 extern int sendfile(int outfd, int infd, long *offset, int count);
 
 // system call signatures for message queue
@@ -181,5 +343,13 @@ extern int msg_queue_rcv(int fd, struct message *msg);
 extern int get_msg_count(int fd);
 extern int msg_queue_block(int fd, int pid);
 extern int msg_queue_close(int fd);
+extern int msg_queue_rcv_wait(int fd, struct message *msg, int timeout);
+extern int msg_queue_send_wait(int fd, struct message *msg, int timeout);
+extern int msg_queue_send_batch(int fd, struct message *msgs, int count);
+extern int msg_queue_rcv_batch(int fd, struct message *msgs, int count);
+extern int msg_queue_send_buf(int fd, struct msg_buf *buf);
+extern int msg_queue_rcv_buf(int fd, struct msg_buf *buf);
+extern int msg_queue_subscribe(int fd, int topic);
+extern int msg_queue_unsubscribe(int fd, int topic);
 
 #endif
@@ -6,29 +6,46 @@
 #include<entry.h>
 #include<memory.h>
 #include<fs.h>
+#include<fdtable.h>
+#include<slab.h>
 #include<kbd.h>
+#include<pipe.h>
+#include<pcache.h>
 
 
 /************************************************************************************/
 /***************************Do Not Modify below Functions****************************/
 /************************************************************************************/
 
+/*
+ * file objects come from a slab cache. Their fops point at a shared table
+ * per file type.
+ */
+
+static void file_ctor(void *obj)
+{
+	struct file *file = (struct file *)obj;
+	bzero((char *)file, sizeof(struct file));
+	file->ref_count = 1;
+}
+
+static struct slab_cache file_cache = SLAB_CACHE("file", struct file, file_ctor);
+
 void free_file_object(struct file *filep)
 {
 	if(filep)
 	{
-		os_page_free(OS_DS_REG ,filep);
+		slab_free(filep);
 		stats->file_objects--;
 	}
 }
 
-struct file *alloc_file()
+struct file *alloc_file_ops(const struct fileops *ops)
 {
-	struct file *file = (struct file *) os_page_alloc(OS_DS_REG); 
-	file->fops = (struct fileops *) (file + sizeof(struct file)); 
-	bzero((char *)file->fops, sizeof(struct fileops));
-	file->ref_count = 1;
-	file->offp = 0;
+	struct file *file = (struct file *) slab_alloc(&file_cache);
+	if(!file)
+		return NULL;
+	file->fops = ops;
 	stats->file_objects++;
 	return file; 
 }
@@ -68,20 +85,25 @@ long std_close(struct file *filep)
 		free_file_object(filep);
 	return 0;
 }
+
+static const struct fileops stdin_ops = {
+	.read = do_read_kbd,
+	.close = std_close,
+};
+
+static const struct fileops stdout_ops = {
+	.write = do_write_console,
+	.close = std_close,
+};
+
 struct file *create_standard_IO(int type)
 {
-	struct file *filep = alloc_file();
+	struct file *filep = alloc_file_ops(type == STDIN ? &stdin_ops : &stdout_ops);
 	filep->type = type;
 	if(type == STDIN)
 		filep->mode = O_READ;
 	else
 		filep->mode = O_WRITE;
-	if(type == STDIN){
-		filep->fops->read = do_read_kbd;
-	}else{
-		filep->fops->write = do_write_console;
-	}
-	filep->fops->close = std_close;
 	return filep;
 }
 
@@ -92,12 +114,12 @@ int open_standard_IO(struct exec_context *ctx, int type)
 	if(!filep){
 		filep = create_standard_IO(type);
 	}else{
+		fd = fd_alloc(ctx, 3);
+		if(fd < 0)
+			return fd;
 		filep->ref_count++;
-		fd = 3;
-		while(ctx->files[fd])
-			fd++; 
 	}
-	ctx->files[fd] = filep;
+	fd_install(ctx, fd, filep);
 	return fd;
 }
 /**********************************************************************************/
@@ -110,15 +132,16 @@ void do_file_exit(struct exec_context *ctx)
 {
 	/*TODO the process is exiting. Adjust the refcount
 	of files*/
-	for(unsigned int fd=0; fd<MAX_OPEN_FILES; ++fd){
-		struct file* fileptr = ctx->files[fd];
-		if(fileptr){
-			if(fileptr->ref_count==1){
-				free_file_object(fileptr);
-			}else{
-				fileptr->ref_count--;
-			}
-			ctx->files[fd]=NULL;
+	for(int fd=fd_next(ctx, 0); fd>=0; fd=fd_next(ctx, fd+1)){
+		struct file* fileptr = fd_clear(ctx, fd);
+		if(fileptr->type==PIPE || fileptr->type==SHM_CHANNEL){	// the last close tells the other end, or frees the pages
+			fileptr->fops->close(fileptr);
+		}else if(fileptr->ref_count==1){
+			if(fileptr->type==REGULAR)
+				pcache_flush(fileptr->inode);
+			free_file_object(fileptr);
+		}else{
+			fileptr->ref_count--;
 		}
 	}
 }
@@ -134,7 +157,7 @@ static int do_read_regular(struct file *filep, char * buff, u32 count)
 	*  Validate the permission, file existence, Max length etc
 	*  Incase of Error return valid Error code 
 	**/
-	u32 read_bytes = flat_read(filep->inode, buff, count, &(filep->offp));
+	int read_bytes = pcache_read(filep->inode, buff, count, (int*)&(filep->offp));
 	
 	if(read_bytes>=0)
 		filep->offp += read_bytes;
@@ -152,7 +175,7 @@ static int do_write_regular(struct file *filep, char * buff, u32 count)
 	*   Validate the permission, file existence, Max length etc
 	*   Incase of Error return valid Error code 
 	* */
-	u32 written_bytes = flat_write(filep->inode, buff, count, &(filep->offp));
+	int written_bytes = pcache_write(filep->inode, buff, count, (int*)&(filep->offp));
 	
 	if(written_bytes>=0)
 		filep->offp += written_bytes;
@@ -160,6 +183,22 @@ static int do_write_regular(struct file *filep, char * buff, u32 count)
 	return written_bytes;
 }
 
+/* positioned read/write, filep->offp stays where it is */
+
+static int do_pread_regular(struct file *filep, char * buff, u32 count, u32 pos)
+{
+	int offp = pos;
+	return pcache_read(filep->inode, buff, count, &offp);
+}
+
+static int do_pwrite_regular(struct file *filep, char * buff, u32 count, u32 pos)
+{
+	int offp = pos;
+	if(pos > filep->inode->file_size)	// no holes, as with lseek
+		return -EINVAL;
+	return pcache_write(filep->inode, buff, count, &offp);
+}
+
 long do_file_close(struct file *filep)
 {
 	/** TODO Implementation of file close  
@@ -170,6 +209,7 @@ long do_file_close(struct file *filep)
 		return -EINVAL;
 	
 	if(filep->ref_count==1){
+		pcache_flush(filep->inode);	// write back what this file left dirty
 		free_file_object(filep);
 		return 0;
 	}else{
@@ -205,15 +245,24 @@ static long do_lseek_regular(struct file *filep, long offset, int whence)
 	return filep->offp;
 }
 
+static const struct fileops regular_ops = {
+	.read = do_read_regular,
+	.write = do_write_regular,
+	.lseek = do_lseek_regular,
+	.close = do_file_close,
+	.pread = do_pread_regular,
+	.pwrite = do_pwrite_regular,
+};
+
 extern int do_regular_file_open(struct exec_context *ctx, char* filename, u64 flags, u64 mode)
 {
 
 	/**  
 	*  TODO Implementation of file open, 
-	*  You should be creating file(use the alloc_file function to creat file), 
+	*  You should be creating file(use alloc_file_ops with a fileops table of the regular file handlers), 
 	*  To create or Get inode use File system function calls, 
 	*  Handle mode and flags 
-	*  Validate file existence, Max File count is 16, Max Size is 4KB, etc
+	*  Validate file existence, Max File count is 16, etc
 	*  Incase of Error return valid Error code 
 	* */
 	struct inode* file_inode = lookup_inode(filename);
@@ -221,7 +270,8 @@ extern int do_regular_file_open(struct exec_context *ctx, char* filename, u64 fl
 		if(flags<O_CREAT)
 			return -EINVAL;
 		file_inode = create_inode(filename, mode);
-		
+		if(file_inode==NULL)	//inode table full
+			return -ENOMEM;
 	}
 	//check permissions
 	u64 file_mode = flags&(file_inode->mode);
@@ -233,37 +283,22 @@ extern int do_regular_file_open(struct exec_context *ctx, char* filename, u64 fl
 	
 	//printk("Mode just after file creation %x\n", O_WRONLY);
 	
-	//if file size greater than 4KB
-	if(file_inode->file_size>FILE_SIZE)
-		return -EINVAL;
-
-	//search for free file descriptor
-	int file_descr;
-	for(file_descr=3; file_descr<MAX_OPEN_FILES; ++file_descr){
-		if(ctx->files[file_descr]==NULL){
-			break;
-		}
-	}
-	//if no file descriptor available
-	if(file_descr==MAX_OPEN_FILES)
-		return -EINVAL;
+	//lowest free file descriptor
+	int file_descr = fd_alloc(ctx, 3);
+	if(file_descr<0)
+		return file_descr;
 	
-	struct file* fileptr = alloc_file();	//all checks performed, now allocating file object
+	struct file* fileptr = alloc_file_ops(&regular_ops);	//all checks performed, now allocating file object
 	
 	if(fileptr==NULL)
 		return -ENOMEM;
 		
-	ctx->files[file_descr]=fileptr;
+	fd_install(ctx, file_descr, fileptr);
 
 	fileptr->inode = file_inode;
 
 	fileptr->mode = file_mode;	//set permissions
 	fileptr->type = fileptr->inode->type; //assign type 	
-	
-	fileptr->fops->read = do_read_regular;//set function pointers
-	fileptr->fops->write = do_write_regular;
-	fileptr->fops->lseek = do_lseek_regular;
-	fileptr->fops->close = do_file_close;
 
 	return file_descr;
 }
@@ -278,72 +313,127 @@ int fd_dup2(struct exec_context *current, int oldfd, int newfd)
 	*  Incase of Error return valid Error code 
 	**/
 	
-	if(current->files[oldfd]==NULL)
-		return -EINVAL;
-	if(oldfd>=MAX_OPEN_FILES || newfd>=MAX_OPEN_FILES)
+	struct file* filep = fd_get(current, oldfd);
+	if(filep==NULL || newfd<0 || newfd>=FD_TABLE_MAX)
 		return -EINVAL;
+	if(oldfd==newfd)
+		return newfd;
 
-	if(current->files[newfd]->ref_count==1)
-		free_file_object(current->files[newfd]);
-	else
-		current->files[newfd]->ref_count--;
-	
-	current->files[newfd] = current->files[oldfd];
+	struct file* oldfilep = fd_get(current, newfd);
+	filep->ref_count++;
+	if(fd_install(current, newfd, filep)<0){
+		filep->ref_count--;
+		return -ENOMEM;
+	}
+	if(oldfilep && oldfilep->fops->close)	//newfd was open, close it
+		oldfilep->fops->close(oldfilep);
 	
 	return newfd;
 }
 
+/*
+ * sendfile helpers. The source is always a regular file and is read in place
+ * from the file store, so no bounce buffer is needed for any target.
+ */
+
+#define CONSOLE_CHUNK 1024	// largest write the console path accepts
+
+static int sendfile_console(struct inode *src, u32 pos, int count)
+{
+	u32 done = 0, len;
+	char *from;
+
+	while(done < count)
+	{
+		len = count - done;
+		if(len > CONSOLE_CHUNK)
+			len = CONSOLE_CHUNK;
+		from = flat_map(src, pos + done, &len);
+		if(from == NULL)
+			break;
+		print_user(from, len);
+		done += len;
+	}
+	return done;
+}
+
+static int sendfile_pipe(struct file *outfileptr, struct inode *src, u32 pos, int count)
+{
+	u32 done = 0, len, space;
+	char *from;
+	int ret;
+
+	while(done < count)
+	{
+		// pipe writes are all or nothing, never ask for more than fits
+		space = pipe_space(outfileptr->pipe);
+		if(space == 0)
+			break;
+		len = count - done;
+		if(len > space)
+			len = space;
+		from = flat_map(src, pos + done, &len);
+		if(from == NULL)
+			break;
+		ret = outfileptr->fops->write(outfileptr, from, len);
+		if(ret < 0)
+			return done ? done : ret;
+		done += ret;
+	}
+	return done;
+}
+
 int do_sendfile(struct exec_context *ctx, int outfd, int infd, long *offset, int count) {
 	/** 
-	*  TODO Implementation of the sendfile 
+	*  Copies up to count bytes from the regular file infd to outfd (a
+	*  regular file, pipe or the console) without an intermediate buffer.
+	*  Reads from *offset if given and advances it, else from the file offset.
 	*  Incase of Error return valid Error code 
 	**/
-	if(outfd>=MAX_OPEN_FILES || infd>=MAX_OPEN_FILES)
+	if(count<0)
 		return -EINVAL;
 	
-	struct file* infileptr = ctx->files[infd];
-	struct file* outfileptr = ctx->files[outfd]; 
+	struct file* infileptr = fd_get(ctx, infd);
+	struct file* outfileptr = fd_get(ctx, outfd); 
 	
-	if(infileptr==NULL || outfileptr==NULL)
-
+	if(infileptr==NULL || outfileptr==NULL || infileptr->type!=REGULAR)
 		return -EINVAL;
 	
 	if((infileptr->mode & O_READ)==0 || (outfileptr->mode & O_WRITE)==0)
 		return -EACCES;
 
-	char* buff = alloc_memory_buffer();
-	if(buff==NULL)
-		return -ENOMEM;
-	
-	int read_bytes;
-	int write_bytes;
+	int pos = infileptr->offp;
 	if(offset){
-		if(*offset > infileptr->inode->max_pos)
+		if(*offset < 0 || *offset > infileptr->inode->file_size)
 			return -EINVAL;
+		pos = *offset;
+	}
 
-		read_bytes = flat_read(infileptr->inode, buff, count, (int*)offset);
-		
-		if(read_bytes<0)
-			return read_bytes;
-		
-		*offset += read_bytes;
-		write_bytes = flat_write(outfileptr->inode, buff, count, &(outfileptr->offp));
-
-		if(write_bytes<0)
-			return write_bytes;
+	// the store is read (and written) directly, bring it up to date first
+	pcache_flush(infileptr->inode);
+
+	int sent_bytes;
+	if(outfileptr->type==REGULAR){
+		pcache_flush(outfileptr->inode);
+		sent_bytes = flat_copy(outfileptr->inode, (int*)&(outfileptr->offp), infileptr->inode, &pos, count);
+		pcache_invalidate(outfileptr->inode);
+		if(sent_bytes<0)
+			return -ENOMEM;
+		outfileptr->offp += sent_bytes;
+	}else if(outfileptr->type==PIPE){
+		sent_bytes = sendfile_pipe(outfileptr, infileptr->inode, pos, count);
+		if(sent_bytes<0)
+			return sent_bytes;
+	}else if(outfileptr->type==STDOUT || outfileptr->type==STDERR){
+		sent_bytes = sendfile_console(infileptr->inode, pos, count);
 	}else{
-		read_bytes = flat_read(infileptr->inode, buff, count, &(infileptr->offp));
-		
-		if(read_bytes<0)
-			return read_bytes;
-		
-		infileptr->offp += read_bytes;
-		write_bytes = flat_write(outfileptr->inode, buff, count, &(outfileptr->offp));
-		
-		if(write_bytes<0)
-			return write_bytes;
+		return -EINVAL;
 	}
-	free_memory_buffer(buff);
-	return write_bytes;
+
+	if(offset)
+		*offset = pos + sent_bytes;
+	else
+		infileptr->offp = pos + sent_bytes;
+	return sent_bytes;
 }
 
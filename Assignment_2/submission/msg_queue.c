@@ -4,6 +4,11 @@
 #include <file.h>
 #include <lib.h>
 #include <entry.h>
+#include <slab.h>
+#include <fdtable.h>
+#include <page.h>
+#include <mmap.h>
+#include <memops.h>
 
 
 
@@ -11,10 +16,17 @@
 /***************************Do Not Modify below Functions****************************/
 /************************************************************************************/
 
+static void msg_queue_info_ctor(void *obj)
+{
+	bzero((char *)obj, sizeof(struct msg_queue_info));
+}
+
+static struct slab_cache msg_queue_cache = SLAB_CACHE("msg_queue_info", struct msg_queue_info, msg_queue_info_ctor);
+
 struct msg_queue_info *alloc_msg_queue_info()
 {
 	struct msg_queue_info *info;
-	info = (struct msg_queue_info *)os_page_alloc(OS_DS_REG);
+	info = (struct msg_queue_info *)slab_alloc(&msg_queue_cache);
 	
 	if(!info){
 		return NULL;
@@ -24,7 +36,7 @@ struct msg_queue_info *alloc_msg_queue_info()
 
 void free_msg_queue_info(struct msg_queue_info *q)
 {
-	os_page_free(OS_DS_REG, q);
+	slab_free(q);
 }
 
 struct message *alloc_buffer()
@@ -45,117 +57,248 @@ void free_msg_queue_buffer(struct message *b)
 /****************************HELPER FUNCTIONS**************************************/
 /**********************************************************************************/
 
+static inline int lowest_member(u64 mask)
+{
+	u64 pos;
+	asm volatile("bsf %1, %0" : "=r"(pos) : "r"(mask));
+	return pos;
+}
+
 int get_member_pos(struct msg_queue_info* msg_queue, int pid){
 	/*This helper funtion returns the position of the passed pid
-	in the member_pid array.*/
+	in the members array.*/
 	
 	int member_pos;
 
 	for(member_pos=0; member_pos<msg_queue->member_count; ++member_pos){
-		if(msg_queue->member_pid[member_pos]==pid)
+		if(msg_queue->members[member_pos].pid==pid)
 			break;
 	}
 
 	return member_pos;
 }
 
-int is_blocked(struct msg_queue_info* msg_queue, int from_pid, int to_pid){
-	/*Checks whether process 'to_pid' has blocked process
-	 'from_pid' or not*/
+int is_blocked(struct msg_queue_info* msg_queue, int from_pos, int to_pos){
+	/*Checks whether the member at to_pos has blocked
+	the member at from_pos or not*/
 
-	int member_pos = get_member_pos(msg_queue, to_pid);
-	
-	for(int i=0; i<msg_queue->blocked_count[member_pos]; ++i){
-		if(msg_queue->blocked[member_pos][i]==from_pid){
-			//printk("BLOCKED\n");
-			return 1;
-		}
-	}
-	return 0;
+	return (msg_queue->members[to_pos].blocked >> from_pos) & 1;
 }
 
-int push_message(struct msg_queue_info* msg_queue, struct message* msg){
-	/*Pushes a message to the message buffer(implemented as a queue)*/
+int reserve_member(struct msg_queue_info* msg_queue){
+	/*Makes room in members[] for one more member,
+	returns 0 if the queue cannot take another one*/
+
+	if(msg_queue->member_count<msg_queue->member_cap)
+		return 1;
+	if(msg_queue->member_cap>=MAX_MEMBERS)
+		return 0;
 
-	if(msg_queue->rear==MAX_MEMBERS-1 || msg==NULL)    //if buffer full or msg is null
+	int cap = msg_queue->member_cap*2;
+	struct msg_member* members = os_alloc(cap*sizeof(struct msg_member));
+	if(members==NULL)
 		return 0;
-	
-	msg_queue->buffer[msg_queue->rear+1].from_pid = msg->from_pid;		//deep copy the message object msg into the buffer queue and
-	msg_queue->buffer[msg_queue->rear+1].to_pid = msg->to_pid;		//increase the counts
-	int ptr=0;
-	while(ptr<MAX_TXT_SIZE){	
-		msg_queue->buffer[msg_queue->rear+1].msg_txt[ptr] = msg->msg_txt[ptr];
-		ptr++;
+	memcpy((char*)members, (char*)msg_queue->members, msg_queue->member_count*sizeof(struct msg_member));
+	os_free(msg_queue->members, msg_queue->member_cap*sizeof(struct msg_member));
+	msg_queue->members = members;
+	msg_queue->member_cap = cap;
+	return 1;
+}
+
+void remove_member(struct msg_queue_info* msg_queue, int member_pos){
+	/*Drops the member at member_pos, the ones after it move down
+	a position and so do their bits in every block mask*/
+
+	u64 below = (1UL<<member_pos)-1;
+	for(int i=member_pos; i<msg_queue->member_count-1; ++i)
+		msg_queue->members[i] = msg_queue->members[i+1];
+	msg_queue->member_count--;
+	for(int i=0; i<msg_queue->member_count; ++i){
+		u64 blocked = msg_queue->members[i].blocked;
+		msg_queue->members[i].blocked = (blocked & below) | ((blocked >> 1) & ~below);
 	}
-		
-	msg_queue->rear++;
+}
+
+/*
+ * The buffer page is a pool of MSG_QUEUE_SLOTS message slots, a second page
+ * holds MSG_QUEUE_NODES delivery nodes. A message is stored once in a slot;
+ * every recipient gets a node pointing at the slot on its FIFO list, and
+ * refs[] counts the nodes of a slot, so a multicast takes one slot and a
+ * 4 byte node per recipient. Unused slots and nodes are on free lists
+ * (through next[] and nodes[].next). Sending, receiving and counting touch
+ * one list end only.
+ */
+
+struct msg_node *alloc_nodes()
+{
+	return (struct msg_node *)os_page_alloc(OS_DS_REG);
+}
+
+void free_nodes(struct msg_node *nodes)
+{
+	os_page_free(OS_DS_REG, nodes);
+}
+
+void init_slots(struct msg_queue_info* msg_queue){
+	for(int i=0; i<MSG_QUEUE_SLOTS; ++i){
+		msg_queue->next[i] = i+1<MSG_QUEUE_SLOTS ? i+1 : MSG_NONE;
+		msg_queue->refs[i] = 0;
+	}
+	msg_queue->free = 0;
+	msg_queue->msg_count = 0;
+	for(int i=0; i<MSG_QUEUE_NODES; ++i)
+		msg_queue->nodes[i].next = i+1<MSG_QUEUE_NODES ? i+1 : MSG_NONE;
+	msg_queue->free_node = 0;
+	msg_queue->free_nodes = MSG_QUEUE_NODES;
+	for(int i=0; i<MSG_QUEUE_SLOTS/64; ++i)
+		msg_queue->data_slots[i] = 0;
+	msg_queue->data_bytes = 0;
+}
+
+void init_member(struct msg_queue_info* msg_queue, int member_pos, u32 pid){
+	struct msg_member* member = &msg_queue->members[member_pos];
+	member->pid = pid;
+	member->head = MSG_NONE;
+	member->tail = MSG_NONE;
+	member->pending = 0;
+	member->blocked = 0;
+	member->topics = 0;
+}
+
+int store_message(struct msg_queue_info* msg_queue, struct message* msg){
+	/*Copies msg into a free slot for deliveries to be linked to,
+	returns the slot or MSG_NONE if the buffer is full*/
+
+	int slot = msg_queue->free;
+	if(slot==MSG_NONE)
+		return MSG_NONE;
+	msg_queue->free = msg_queue->next[slot];
+	msg_queue->buffer[slot] = *msg;		//deep copy the message object msg into the slot
+	msg_queue->refs[slot] = 0;
 	msg_queue->msg_count++;
+	return slot;
+}
+
+void link_message(struct msg_queue_info* msg_queue, int member_pos, int slot){
+	/*Appends a delivery of slot to the messages of the member at member_pos,
+	the caller has made sure a node is free*/
+
+	int node = msg_queue->free_node;
+	msg_queue->free_node = msg_queue->nodes[node].next;
+	msg_queue->free_nodes--;
+
+	msg_queue->nodes[node].next = MSG_NONE;
+	msg_queue->nodes[node].slot = slot;
+	struct msg_member* member = &msg_queue->members[member_pos];
+	if(member->tail==MSG_NONE)
+		member->head = node;
+	else
+		msg_queue->nodes[member->tail].next = node;
+	member->tail = node;
+		
+	member->pending++;
+	msg_queue->refs[slot]++;
+}
+
+int push_message(struct msg_queue_info* msg_queue, int member_pos, struct message* msg){
+	/*Appends a copy of msg to the messages of the member at member_pos*/
+
+	if(msg==NULL || msg_queue->free==MSG_NONE || !msg_queue->free_nodes)    //if buffer full or msg is null
+		return 0;
+	link_message(msg_queue, member_pos, store_message(msg_queue, msg));
 	return 1;
 }
 
-void get_message(struct msg_queue_info* msg_queue, u32 pid, struct message* msg){
-                /*Gets the earliest message sent to the process 'pid'*/
+/*
+ * A variable length message keeps its header in the slot (struct msg_data)
+ * and its payload outside the buffer page: in an os_alloc chunk of its own,
+ * or in a user page when larger than MSG_DATA_CHUNK so that the receiver
+ * can have the page mapped rather than copied. Such slots are marked in
+ * data_slots, and lose their payload when the last delivery is taken.
+ */
 
-		if(msg_queue->rear<0){ //if buffer empty
-			msg=NULL;
-			return;
-		}
-                        
-
-                int msg_ptr;
-                for(msg_ptr=0; msg_ptr<=msg_queue->rear; ++msg_ptr){
-                        if(msg_queue->buffer[msg_ptr].to_pid==pid)
-                                break;
-                }
-    
-                if(msg_ptr>msg_queue->rear){ //if no message to process 'pid' available
-                        msg = NULL;
-    			return;
-		}	
-		
-		msg->from_pid = msg_queue->buffer[msg_ptr].from_pid;		//deep copy from the buffer into msg
-		msg->to_pid = msg_queue->buffer[msg_ptr].to_pid;
-                int txt_ptr=0;
-		while(txt_ptr<MAX_TXT_SIZE){
-			msg->msg_txt[txt_ptr] = msg_queue->buffer[msg_ptr].msg_txt[txt_ptr];
-			++txt_ptr;
-		}
+int is_data_slot(struct msg_queue_info* msg_queue, int slot){
+	return (msg_queue->data_slots[slot/64] >> (slot%64)) & 1;
+}
+
+int head_slot(struct msg_queue_info* msg_queue, int member_pos){
+	/*Slot of the earliest message to the member, MSG_NONE if there is none*/
 
-                for(int i=msg_ptr; i<msg_queue->rear; ++i){	//shift the buffer and decrease counts
-                        msg_queue->buffer[i] = msg_queue->buffer[i+1];
-                }
-                
-		msg_queue->rear--;
-                msg_queue->msg_count--;
-                return;
+	int node = msg_queue->members[member_pos].head;
+	return node==MSG_NONE ? MSG_NONE : msg_queue->nodes[node].slot;
 }
 
+int head_is_data(struct msg_queue_info* msg_queue, int member_pos){
+	int slot = head_slot(msg_queue, member_pos);
+	return slot!=MSG_NONE && is_data_slot(msg_queue, slot);
+}
+
+void drop_payload(struct msg_queue_info* msg_queue, int slot, int free){
+	/*Unmarks a data slot, the payload is freed unless
+	it was handed over to the receiver*/
+
+	struct msg_data* data = (struct msg_data*)&msg_queue->buffer[slot];
+	if(free && data->pfn)
+		os_pfn_free(USER_REG, data->pfn);
+	else if(free && data->payload)
+		os_free(data->payload, data->len);
+	msg_queue->data_bytes -= data->len;
+	msg_queue->data_slots[slot/64] &= ~(1UL<<(slot%64));
+}
+
+int get_message(struct msg_queue_info* msg_queue, int member_pos, struct message* msg){
+	/*Takes the earliest message sent to the member at member_pos,
+	returns 0 if there is none*/
+
+	struct msg_member* member = &msg_queue->members[member_pos];
+	int node = member->head;
+	if(node==MSG_NONE)
+		return 0;
+	int slot = msg_queue->nodes[node].slot;
 
+	if(msg && !is_data_slot(msg_queue, slot)){
+		*msg = msg_queue->buffer[slot];		//deep copy from the buffer into msg
+		if(msg->to_pid==BROADCAST_PID)		//each copy of a broadcast names its recipient
+			msg->to_pid = member->pid;
+	}
+	member->head = msg_queue->nodes[node].next;
+	if(member->head==MSG_NONE)
+		member->tail = MSG_NONE;
+	msg_queue->nodes[node].next = msg_queue->free_node;	//return the node and decrease counts
+	msg_queue->free_node = node;
+	msg_queue->free_nodes++;
+	member->pending--;
+
+	if(--msg_queue->refs[slot])		//other recipients still to take it
+		return 1;
+	if(is_data_slot(msg_queue, slot))
+		drop_payload(msg_queue, slot, 1);
+	msg_queue->next[slot] = msg_queue->free;	//return the slot
+	msg_queue->free = slot;
+	msg_queue->msg_count--;
+	return 1;
+}
 
 /*********************************************************************************/
 /*********************************************************************************/
 /*********************************************************************************/
 
+/* message queues are not read or written through the file ops */
+static const struct fileops msg_queue_ops;
+
 int do_create_msg_queue(struct exec_context *ctx)
 {
 	/** 
 	 * TODO Implement functionality to
 	 * create a message queue
 	 **/
-	int fd;
-	for(fd=3; fd<MAX_OPEN_FILES; ++fd){		//get the smallest closed file descriptor
-		if(ctx->files[fd]==NULL)
-			break;
-	}
-	struct file* fileptr = alloc_file();		//allocate and initialize file object 
+	int fd = fd_alloc(ctx, 3);			//get the smallest closed file descriptor
+	if(fd<0)
+		return fd;
+	struct file* fileptr = alloc_file_ops(&msg_queue_ops);	//allocate and initialize file object 
 	//printk("file descriptor(sys call) = %d\n", fd);
-	if(fileptr==NULL || fd == MAX_OPEN_FILES)
+	if(fileptr==NULL)
 		return -ENOMEM;
-
-	fileptr->fops->read=NULL;		
-	fileptr->fops->write=NULL;
-	fileptr->fops->lseek=NULL;
-	fileptr->fops->close=NULL;
 	
 	struct msg_queue_info* queue_info = alloc_msg_queue_info();	//allocate and initialize message queue info object
 	//initialization of message queue remaining
@@ -166,23 +309,22 @@ int do_create_msg_queue(struct exec_context *ctx)
 	
 	if(queue_info->buffer==NULL)
 		return -ENOMEM;
+	queue_info->nodes = alloc_nodes();
+	if(queue_info->nodes==NULL)
+		return -ENOMEM;
 
-	queue_info->rear=-1;
-	queue_info->msg_count = 0;
+	init_slots(queue_info);
 	
+	queue_info->members = os_alloc(MSG_QUEUE_MIN_MEMBERS*sizeof(struct msg_member));
+	if(queue_info->members==NULL)
+		return -ENOMEM;
+	queue_info->member_cap=MSG_QUEUE_MIN_MEMBERS;
 	queue_info->member_count=1;
-	queue_info->member_pid[0]=ctx->pid;
-			
-	
-	for(int i=0; i<MAX_MEMBERS; ++i)
-		queue_info->blocked[i]=NULL;
-	
-	for(int i=0; i<MAX_MEMBERS; ++i)
-		queue_info->blocked_count[i]=0;
+	init_member(queue_info, 0, ctx->pid);
 	
 	fileptr->msg_queue = queue_info;
 
-	ctx->files[fd] = fileptr;
+	fd_install(ctx, fd, fileptr);
 	return fd;
 }
 
@@ -197,21 +339,73 @@ int do_msg_queue_rcv(struct exec_context *ctx, struct file *filep, struct messag
 	if(filep==NULL || msg==NULL)
 		return -EINVAL;
 	
-	if(get_member_pos(filep->msg_queue, ctx->pid)>=MAX_MEMBERS)
+	int member_pos = get_member_pos(filep->msg_queue, ctx->pid);
+	if(member_pos>=filep->msg_queue->member_count)
 		return -EINVAL;
 	
-	u32 pid = ctx->pid;
-	
-
-	get_message(filep->msg_queue, pid, msg);
-	
-	if(msg==NULL)		//if no message for the process in the queue return 0
+	if(head_is_data(filep->msg_queue, member_pos))		//needs msg_queue_rcv_buf
+		return -EINVAL;
+	if(!get_message(filep->msg_queue, member_pos, msg))		//if no message for the process in the queue return 0
 		return 0;
 	//printk("msg recieved by pid %d, msg from %d to %d = %s\n", ctx->pid, msg->from_pid, msg->to_pid, msg->msg_txt);	
 	return 1;
 }
 
 
+u64 multicast_recipients(struct msg_queue_info* msg_queue, int from_pos, u32 to_pid, int* count){
+	/*Members a broadcast (every other member) or a message to a topic
+	(its subscribers) from the member at from_pos goes to, leaving out
+	those that blocked the sender*/
+
+	u64 topic = IS_TOPIC_PID(to_pid) ? 1UL<<(to_pid-TOPIC_PID(0)) : 0;
+	u64 recipients = 0;
+	*count = 0;
+	for(int member_pos=0; member_pos<msg_queue->member_count; ++member_pos){
+		if(member_pos==from_pos || is_blocked(msg_queue, from_pos, member_pos))
+			continue;
+		if(topic && !(msg_queue->members[member_pos].topics & topic))
+			continue;
+		recipients |= 1UL<<member_pos;
+		++*count;
+	}
+	return recipients;
+}
+
+int queue_message(struct exec_context *ctx, struct msg_queue_info* msg_queue, int from_pos, struct message *msg){
+	/*Queues msg from the calling process, the member at from_pos.
+	Returns the number of recipients or an error*/
+
+	if(ctx->pid != msg->from_pid)
+		return -EINVAL;
+	
+	if(msg->to_pid==BROADCAST_PID || IS_TOPIC_PID(msg->to_pid)){	//one stored copy, a delivery per recipient
+		int count;
+		u64 recipients = multicast_recipients(msg_queue, from_pos, msg->to_pid, &count);
+		if(!count)
+			return 0;
+		if(msg_queue->free==MSG_NONE || count>msg_queue->free_nodes)	//all or nothing, so a full queue can be retried
+			return -EOTHERS;
+		
+		int slot = store_message(msg_queue, msg);
+		for(; recipients; recipients &= recipients-1)
+			link_message(msg_queue, lowest_member(recipients), slot);
+		return count;
+	}else{						//else push one message if allowed
+		int to_pos = get_member_pos(msg_queue, msg->to_pid);
+		if(to_pos>=msg_queue->member_count)
+			return -EINVAL;
+		if(is_blocked(msg_queue, from_pos, to_pos))
+			return -EINVAL;
+
+		if(push_message(msg_queue, to_pos, msg)==0)
+			return -EOTHERS;
+
+		//printk("message sent form %d to %d, mesg_count = %d\n", ctx->pid,  msg->to_pid);
+		//	
+		return 1;
+	}
+}
+
 int do_msg_queue_send(struct exec_context *ctx, struct file *filep, struct message *msg)
 {
 	/** 
@@ -222,41 +416,180 @@ int do_msg_queue_send(struct exec_context *ctx, struct file *filep, struct messa
 	if(filep==NULL || msg==NULL)		
 		return -EINVAL;
 	
-	if(ctx->pid != msg->from_pid)
-		return -EINVAL;
-
 	int member_pos = get_member_pos(filep->msg_queue, ctx->pid);
 	
 	if(member_pos>=filep->msg_queue->member_count){		//check process membership
 		return -EINVAL;
 	}
 	
+	return queue_message(ctx, filep->msg_queue, member_pos, msg);
+}
+
+int do_msg_queue_send_batch(struct exec_context *ctx, struct file *filep, struct message *msgs, int count)
+{
+	/*Sends msgs[0..count-1] in order and stops at the first one that fails.
+	Returns how many were sent, or the error of msgs[0]*/
+
+	if(filep==NULL || filep->msg_queue==NULL || msgs==NULL || count<0)
+		return -EINVAL;
+	
 	struct msg_queue_info* msg_queue = filep->msg_queue;
+	int member_pos = get_member_pos(msg_queue, ctx->pid);
+	if(member_pos>=msg_queue->member_count)
+		return -EINVAL;
+
+	int sent, ret=0;
+	for(sent=0; sent<count; ++sent){
+		ret = queue_message(ctx, msg_queue, member_pos, &msgs[sent]);
+		if(ret<0)
+			break;
+	}
+	return sent ? sent : ret;
+}
+
+int do_msg_queue_rcv_batch(struct exec_context *ctx, struct file *filep, struct message *msgs, int count)
+{
+	/*Receives up to count messages into msgs, oldest first.
+	Returns how many were received, 0 if there was none*/
+
+	if(filep==NULL || filep->msg_queue==NULL || msgs==NULL || count<0)
+		return -EINVAL;
 	
-	if(msg->to_pid==BROADCAST_PID){			//if a broadcast message then push a message into the queue
-		int count=0;				//for every process which is a member and has not blocked this process
-		for(member_pos=0; member_pos<msg_queue->member_count; ++member_pos){
-			if(msg_queue->member_pid[member_pos]!=ctx->pid && !is_blocked(msg_queue, msg->from_pid, msg_queue->member_pid[member_pos])){
-				msg->to_pid = msg_queue->member_pid[member_pos];
+	struct msg_queue_info* msg_queue = filep->msg_queue;
+	int member_pos = get_member_pos(msg_queue, ctx->pid);
+	if(member_pos>=msg_queue->member_count)
+		return -EINVAL;
+
+	int received=0;
+	while(received<count && !head_is_data(msg_queue, member_pos) && get_message(msg_queue, member_pos, &msgs[received]))
+		++received;
+	return received;
+}
+
+int do_msg_queue_send_buf(struct exec_context *ctx, struct file *filep, struct msg_buf *buf)
+{
+	/*Sends buf->len bytes from buf->data to one member, a topic
+	or every other member. Returns the payload length or an error*/
+
+	if(filep==NULL || filep->msg_queue==NULL || buf==NULL)
+		return -EINVAL;
+	if(buf->len>MSG_DATA_MAX || (buf->len && buf->data==NULL))
+		return -EINVAL;
+	if(ctx->pid != buf->from_pid)
+		return -EINVAL;
 	
-				if(push_message(msg_queue, msg)==0)
-					return -EOTHERS;
-				++count;			//counting the number of messages pushed
-			}
-		}
-		
-		return count;
-	}else{						//else push one message if allowed
-		if(is_blocked(msg_queue, msg->from_pid, msg->to_pid))
+	struct msg_queue_info* msg_queue = filep->msg_queue;
+	int member_pos = get_member_pos(msg_queue, ctx->pid);
+	if(member_pos>=msg_queue->member_count)
+		return -EINVAL;
+
+	int count = 1;
+	u64 recipients;
+	if(buf->to_pid==BROADCAST_PID || IS_TOPIC_PID(buf->to_pid)){	//recipients share the payload
+		recipients = multicast_recipients(msg_queue, member_pos, buf->to_pid, &count);
+		if(!count)
+			return buf->len;
+	}else{
+		int to_pos = get_member_pos(msg_queue, buf->to_pid);
+		if(to_pos>=msg_queue->member_count)
+			return -EINVAL;
+		if(is_blocked(msg_queue, member_pos, to_pos))
 			return -EINVAL;
+		recipients = 1UL<<to_pos;
+	}
+	if(msg_queue->free==MSG_NONE || count>msg_queue->free_nodes || msg_queue->data_bytes+buf->len>MSG_QUEUE_DATA_MAX)
+		return -EOTHERS;
+
+	struct msg_data data;
+	data.from_pid = buf->from_pid;
+	data.to_pid = buf->to_pid;
+	data.len = buf->len;
+	data.pfn = 0;
+	data.payload = NULL;
+	if(buf->len>MSG_DATA_CHUNK){
+		data.pfn = os_pfn_alloc(USER_REG);
+		if(!data.pfn)
+			return -ENOMEM;
+		data.payload = (char*)osmap(data.pfn);
+		fast_bzero(data.payload + buf->len, PAGE_SIZE - buf->len);	//the page may get mapped
+	}else if(buf->len){
+		data.payload = os_alloc(buf->len);
+		if(data.payload==NULL)
+			return -ENOMEM;
+	}
+	fast_memcpy(data.payload, buf->data, buf->len);
+
+	int slot = store_message(msg_queue, (struct message*)&data);
+	for(; recipients; recipients &= recipients-1)
+		link_message(msg_queue, lowest_member(recipients), slot);
+	msg_queue->data_slots[slot/64] |= 1UL<<(slot%64);
+	msg_queue->data_bytes += buf->len;
+	return buf->len;
+}
 
-		if(push_message(filep->msg_queue, msg)==0)
-			return -EOTHERS;
+long map_payload(struct exec_context *ctx, u32 pfn){
+	/*Maps the payload page at a free address of ctx, the page
+	then belongs to the mapping*/
+
+	long addr = vm_area_map(ctx, 0, PAGE_SIZE, PROT_READ|PROT_WRITE, 0);
+	if(addr<0)
+		return addr;
+	struct pfn_info* info = get_pfn_info(pfn);
+	if(!get_pfn_info_refcount(info))
+		set_pfn_info(pfn);
+	map_physical_page((u64)osmap(ctx->pgd), addr, PROT_WRITE, pfn);
+	return addr;
+}
 
-		//printk("message sent form %d to %d, mesg_count = %d\n", ctx->pid,  msg->to_pid);
-		//	
+int do_msg_queue_rcv_buf(struct exec_context *ctx, struct file *filep, struct msg_buf *buf)
+{
+	/*Receives the earliest message to the caller, copying only its payload,
+	or mapping the payload page with MSG_MAP when no other recipient still
+	needs it. Returns 1, or 0 if there is no message. A message that does
+	not fit buf->len stays queued*/
+
+	if(filep==NULL || filep->msg_queue==NULL || buf==NULL)
+		return -EINVAL;
+	
+	struct msg_queue_info* msg_queue = filep->msg_queue;
+	int member_pos = get_member_pos(msg_queue, ctx->pid);
+	if(member_pos>=msg_queue->member_count)
+		return -EINVAL;
+
+	int slot = head_slot(msg_queue, member_pos);
+	if(slot==MSG_NONE)
+		return 0;
+
+	if(!is_data_slot(msg_queue, slot)){		//a fixed size message, its whole text is the payload
+		struct message msg;
+		if(buf->len<MAX_TXT_SIZE || buf->data==NULL)
+			return -EINVAL;
+		get_message(msg_queue, member_pos, &msg);
+		buf->from_pid = msg.from_pid;
+		buf->to_pid = msg.to_pid;
+		buf->len = MAX_TXT_SIZE;
+		memcpy(buf->data, msg.msg_txt, MAX_TXT_SIZE);
 		return 1;
 	}
+
+	struct msg_data* data = (struct msg_data*)&msg_queue->buffer[slot];
+	buf->from_pid = data->from_pid;
+	buf->to_pid = data->to_pid==BROADCAST_PID ? ctx->pid : data->to_pid;
+	if((buf->flags & MSG_MAP) && data->pfn && msg_queue->refs[slot]==1){
+		long addr = map_payload(ctx, data->pfn);
+		if(addr<0)
+			return addr;
+		buf->data = (char*)addr;
+		buf->len = data->len;
+		drop_payload(msg_queue, slot, 0);	//the mapping owns the page now
+	}else{
+		if(buf->len<data->len || (data->len && buf->data==NULL))
+			return -EINVAL;
+		fast_memcpy(buf->data, data->payload, data->len);
+		buf->len = data->len;
+	}
+	get_message(msg_queue, member_pos, NULL);	//frees what is left of the payload
+	return 1;
 }
 
 void do_add_child_to_msg_queue(struct exec_context *child_ctx)
@@ -264,17 +597,20 @@ void do_add_child_to_msg_queue(struct exec_context *child_ctx)
 	/** 
 	 * TODO Implementation of fork handler 
 	 **/
-	//Assuming that member_count<MAX_MEMBERS
-	for(int fd=3; fd<MAX_OPEN_FILES; ++fd){
-		if(child_ctx->files[fd]!=NULL && child_ctx->files[fd]->msg_queue!=NULL){
-			child_ctx->files[fd]->ref_count++;					
-			struct msg_queue_info* queue_info = child_ctx->files[fd]->msg_queue;
-			queue_info->member_pid[queue_info->member_count] = child_ctx->pid;
-			queue_info->member_count++;
-			
-			//printk("fork! member count = %d\n", queue_info->member_count);
-			
+	//a queue that cannot grow further does not take the child, which
+	//then loses the descriptor as it holds no reference to the file
+	for(int fd=fd_next(child_ctx, 3); fd>=0; fd=fd_next(child_ctx, fd+1)){
+		struct file* filep = fd_get(child_ctx, fd);
+		if(filep->msg_queue==NULL)
+			continue;
+		if(!reserve_member(filep->msg_queue)){
+			fd_clear(child_ctx, fd);
+			continue;
 		}
+		filep->ref_count++;
+		struct msg_queue_info* queue_info = filep->msg_queue;
+		init_member(queue_info, queue_info->member_count, child_ctx->pid);
+		queue_info->member_count++;
 	}
 	
 }
@@ -284,8 +620,8 @@ void do_msg_queue_cleanup(struct exec_context *ctx)
 	/** 
 	 * TODO Implementation of exit handler 
 	 **/
-	for(int i=3; i<MAX_OPEN_FILES; ++i){
-		if(ctx->files[i]!=NULL && ctx->files[i]->msg_queue!=NULL)
+	for(int i=fd_next(ctx, 3); i>=0; i=fd_next(ctx, i+1)){
+		if(fd_get(ctx, i)->msg_queue!=NULL)
 			do_msg_queue_close(ctx, i);
 	}
 	
@@ -304,7 +640,7 @@ int do_msg_queue_get_member_info(struct exec_context *ctx, struct file *filep, s
 
 	info->member_count = filep->msg_queue->member_count;
 	for(int i=0; i<info->member_count; ++i){
-		info->member_pid[i] = filep->msg_queue->member_pid[i];
+		info->member_pid[i] = filep->msg_queue->members[i].pid;
 	}
 	
 	return 0;
@@ -321,17 +657,12 @@ int do_get_msg_count(struct exec_context *ctx, struct file *filep)
 	if(filep==NULL || filep->msg_queue==NULL)
 		return -EINVAL;
 	
-	int pid = ctx->pid;
 	struct msg_queue_info* msg_queue = filep->msg_queue;
+	int member_pos = get_member_pos(msg_queue, ctx->pid);
 	
-	int count=0;
-	for(int i=0; i<msg_queue->msg_count; ++i){
-		struct message* buff = msg_queue->buffer;
-		if(buff[i].to_pid==pid)
-			++count;
-	} 
-	//printk("query, msg_count = %d, returned count = %d pid = %d\n", filep->msg_queue->msg_count, count, ctx->pid);
-	return count;
+	if(member_pos>=msg_queue->member_count)	//not a member, nothing pending
+		return 0;
+	return msg_queue->members[member_pos].pending;
 }
 
 int do_msg_queue_block(struct exec_context *ctx, struct file *filep, int pid)
@@ -347,54 +678,75 @@ int do_msg_queue_block(struct exec_context *ctx, struct file *filep, int pid)
 	struct msg_queue_info* msg_queue = filep->msg_queue;
 	
 	int member_pos = get_member_pos(msg_queue, ctx->pid);
+	int blocked_pos = get_member_pos(msg_queue, pid);
 	
-	if(member_pos==MAX_MEMBERS)		//check membership
+	if(member_pos>=msg_queue->member_count)		//check membership of both
+		return -EINVAL;
+	if(blocked_pos>=msg_queue->member_count)
 		return -EINVAL;
 	
-	if(msg_queue->blocked[member_pos]==NULL){	//allocate array to store blocked processes if not allocated
-		msg_queue->blocked[member_pos] = alloc_memory_buffer();
+	msg_queue->members[member_pos].blocked |= 1UL<<blocked_pos;
 		
-		if(msg_queue->blocked[member_pos]==NULL)
-			return -ENOMEM;
+	return 0;
+}
 
-		msg_queue->blocked[member_pos][0] = pid;
-		msg_queue->blocked_count[member_pos] = 1;
-	}else{
-		int block_count = msg_queue->blocked_count[member_pos];		//add to 'pid' to the blocked processes
-		msg_queue->blocked[member_pos][block_count] = pid;
-		msg_queue->blocked_count[member_pos]++;
-	}
-		
+int do_msg_queue_subscribe(struct exec_context *ctx, struct file *filep, int topic, int on)
+{
+	/*Starts (on) or stops delivery of messages sent to
+	TOPIC_PID(topic) to the calling process*/
+
+	if(filep==NULL || filep->msg_queue==NULL || topic<0 || topic>=MAX_TOPICS)
+		return -EINVAL;
+	
+	struct msg_queue_info* msg_queue = filep->msg_queue;
+	int member_pos = get_member_pos(msg_queue, ctx->pid);
+	if(member_pos>=msg_queue->member_count)
+		return -EINVAL;
+
+	if(on)
+		msg_queue->members[member_pos].topics |= 1UL<<topic;
+	else
+		msg_queue->members[member_pos].topics &= ~(1UL<<topic);
 	return 0;
 }
 
+int do_msg_queue_poll(struct exec_context *ctx, struct file *filep)
+{
+	/*POLLIN if a message is pending for the calling process,
+	POLLOUT if a send would find a free slot*/
+
+	if(filep==NULL || filep->msg_queue==NULL)
+		return -EINVAL;
+
+	struct msg_queue_info* msg_queue = filep->msg_queue;
+	int events = 0;
+	if(do_get_msg_count(ctx, filep)>0)
+		events |= POLLIN;
+	if(msg_queue->free!=MSG_NONE && msg_queue->free_nodes)
+		events |= POLLOUT;
+	return events;
+}
+
 int do_msg_queue_close(struct exec_context *ctx, int fd)
 {
 	/** 
 	 * TODO Implement functionality to
 	 * remove the calling process from the message queue 
 	 **/
-	if(ctx->files[fd]==NULL || ctx->files[fd]->msg_queue==NULL)
+	struct file* filep = fd_get(ctx, fd);
+	if(filep==NULL || filep->msg_queue==NULL)
 		return -EINVAL;
 	
-	struct msg_queue_info* msg_queue = ctx->files[fd]->msg_queue;	
+	struct msg_queue_info* msg_queue = filep->msg_queue;	
 	
 	int member_pos = get_member_pos(msg_queue, ctx->pid);
 	
-	if(msg_queue->blocked[member_pos]){
-		free_memory_buffer(msg_queue->blocked[member_pos]);
-		msg_queue->blocked[member_pos] = NULL;
+	if(member_pos<msg_queue->member_count){
+		while(get_message(msg_queue, member_pos, NULL));	//drop what was not received
+		remove_member(msg_queue, member_pos);
 	}
 	
-	for(int i=member_pos; i<msg_queue->member_count; ++i){
-		msg_queue->member_pid[i] = msg_queue->member_pid[i+1];
-		msg_queue->blocked_count[i] = msg_queue->blocked_count[i+1];
-		msg_queue->blocked[i] = msg_queue->blocked[i+1];
-	}
-	msg_queue->member_count--;
-	
-	struct file* filep = ctx->files[fd];
-	ctx->files[fd] = NULL;
+	fd_clear(ctx, fd);
 	
 	filep->ref_count--;
 	
@@ -402,6 +754,8 @@ int do_msg_queue_close(struct exec_context *ctx, int fd)
 	
 	if(filep->ref_count==0 && filep->msg_queue->member_count==0){		//free both file object and message queue if message queue has no members
 		free_msg_queue_buffer(filep->msg_queue->buffer);		//and file obj has no references
+		free_nodes(filep->msg_queue->nodes);
+		os_free(filep->msg_queue->members, filep->msg_queue->member_cap*sizeof(struct msg_member));
 		free_msg_queue_info(filep->msg_queue);
 		free_file_object(filep);
 	}else if(filep->ref_count==0){					//otherwise free only the file object
@@ -3,10 +3,15 @@
 
 #include <types.h>
 #include <context.h>
+#include <memory.h>
 
 #define MAX_TXT_SIZE 24 
-#define MAX_MEMBERS 4 
+#define MAX_MEMBERS 64	// one bit per member in the block masks
 #define BROADCAST_PID 0xffffffff 
+#define MAX_TOPICS 64
+#define TOPIC_PID(t) (0xffffff00 + (t))	// to_pid of a message to subscribers of topic t
+#define IS_TOPIC_PID(pid) ((pid) >= TOPIC_PID(0) && (pid) < TOPIC_PID(MAX_TOPICS))
+#define MSG_NONE -1	// end of a slot or node list
 
 struct message{
 
@@ -18,20 +23,69 @@ struct message{
 };
 
 
+#define MSG_QUEUE_SLOTS (PAGE_SIZE / sizeof(struct message))	// one page of messages
+
+struct msg_node{
+	short next;		// next delivery to the same member, or free node
+	short slot;		// message delivered
+};
+
+#define MSG_QUEUE_NODES (PAGE_SIZE / sizeof(struct msg_node))	// one page of deliveries
+
+#define MSG_DATA_MAX PAGE_SIZE			// largest variable length payload
+#define MSG_DATA_CHUNK 2048			// larger payloads get a user page of their own
+#define MSG_QUEUE_DATA_MAX (16 * PAGE_SIZE)	// payload bytes a queue holds at most
+#define MSG_MAP 1	// msg_buf flag: map a page payload instead of copying it
+
+/* Variable length message, as passed to and from user space */
+struct msg_buf{
+	u32 from_pid;
+	u32 to_pid;
+	u32 len;		// payload bytes, on receive the room in data first
+	u32 flags;		// MSG_MAP
+	char *data;		// a MSG_MAP receive points it at the mapped page
+};
+
+/* Slot of a variable length message, where a struct message would be */
+struct msg_data{
+	u32 from_pid;
+	u32 to_pid;
+	u32 len;
+	u32 pfn;		// user page holding the payload, 0 for an os_alloc chunk
+	char *payload;
+	u64 unused;
+};
+
+#define MSG_QUEUE_MIN_MEMBERS 4	// members[] of a new queue, doubled as members join
+
+struct msg_member{
+	u32 pid;
+	short head;			// list of deliveries to the member, oldest first
+	short tail;
+	int pending;			// length of that list
+	u64 blocked;			// bit i set: messages from members[i] are refused
+	u64 topics;			// bit t set: subscribed to TOPIC_PID(t)
+};
+
 struct msg_queue_info{
 	// define all the data structures
 	// you need to maintain the message queue
 
 	// eg: pointer to buffer
 	int member_count;			//fields to maintain member information
-	u32 member_pid[MAX_MEMBERS];
+	int member_cap;				// size of members[], a power of two
+	struct msg_member* members;		// in the order they joined
 
-	int msg_count;			// message buffer
+	int msg_count;			// message buffer, MSG_QUEUE_SLOTS slots
 	struct message* buffer;	
-	int rear;
-
-	int* blocked[MAX_MEMBERS];		//fields to maintain block information
-	int blocked_count[MAX_MEMBERS];
+	short next[MSG_QUEUE_SLOTS];		// next unused slot
+	u8 refs[MSG_QUEUE_SLOTS];		// deliveries of the message in the slot
+	short free;				// list of unused slots
+	struct msg_node* nodes;		// MSG_QUEUE_NODES deliveries
+	short free_node;			// list of unused nodes
+	int free_nodes;
+	u64 data_slots[MSG_QUEUE_SLOTS / 64];	// slots holding a struct msg_data
+	u32 data_bytes;				// payload bytes held by those
 	
 };
 
@@ -46,7 +100,13 @@ extern void do_msg_queue_cleanup(struct exec_context *ctx);
 extern int do_msg_queue_get_member_info(struct exec_context *ctx, struct file *filep, struct msg_queue_member_info *info);
 extern int do_msg_queue_send(struct exec_context *ctx, struct file *filep, struct message *msg);
 extern int do_msg_queue_rcv(struct exec_context *ctx, struct file *filep, struct message *msg);
+extern int do_msg_queue_send_batch(struct exec_context *ctx, struct file *filep, struct message *msgs, int count);
+extern int do_msg_queue_rcv_batch(struct exec_context *ctx, struct file *filep, struct message *msgs, int count);
+extern int do_msg_queue_send_buf(struct exec_context *ctx, struct file *filep, struct msg_buf *buf);
+extern int do_msg_queue_rcv_buf(struct exec_context *ctx, struct file *filep, struct msg_buf *buf);
 extern int do_get_msg_count(struct exec_context *ctx, struct file *filep);
 extern int do_msg_queue_block(struct exec_context *ctx, struct file *filep, int pid);
+extern int do_msg_queue_subscribe(struct exec_context *ctx, struct file *filep, int topic, int on);
+extern int do_msg_queue_poll(struct exec_context *ctx, struct file *filep);
 extern int do_msg_queue_close(struct exec_context *ctx, int fd);
 #endif
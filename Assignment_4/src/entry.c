@@ -7,6 +7,7 @@
 #include<kbd.h>
 #include<page.h>
 #include<mmap.h>
+#include<memops.h>
 
 long do_fork()
 {
@@ -60,6 +61,23 @@ void do_exit()
 	schedule(new_ctx);  //Calling from exit
 }
 
+/*
+ * The boot code allocates *config with room for the fields up to
+ * adv_global only. The first configure() moves config to os_config, the
+ * fields after adv_global read as 0 until then.
+ */
+struct os_configs os_config;
+
+long do_configure(struct os_configs *new_config)
+{
+	if(config != &os_config){
+		memcpy((char *)&os_config, (char *)config, OS_CONFIGS_BOOT_SIZE);
+		config = &os_config;
+	}
+	memcpy((char *)config, (char *)new_config, sizeof(struct os_configs));
+	return 0;
+}
+
 int do_file_open(struct exec_context *ctx,u64 filename, u64 flag, u64 mode)
 {
 
@@ -348,8 +366,7 @@ long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 		return stats->cow_page_faults;
 
 	case SYSCALL_CONFIGURE:
-		memcpy((char *)config, (char *)param1, sizeof(struct os_configs));      
-		break;
+		return do_configure((struct os_configs *)param1);
 	case SYSCALL_PHYS_INFO:
 		printk("OS Data strutures:     0x800000 - 0x2000000\n");
 		printk("Page table structures: 0x2000000 - 0x6400000\n");
@@ -378,6 +395,8 @@ long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 		return vm_area_make_hugepage(current, (void *)param1,(u32)param2, (u32)param3, (u32)param4);
 	case SYSCALL_BREAK_HUGEPAGE:
 		return vm_area_break_hugepage(current, (void *)param1, (u32)param2);
+	case SYSCALL_MEMOPS_BENCH:
+		return do_memops_bench(current, (struct memops_bench *)param1);
 	default:
 		return -1;
 	}
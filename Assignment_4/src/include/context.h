@@ -53,6 +53,13 @@ struct vm_area{
 	u32 access_flags;  // Access rights or protection flags of the vm_area/*R=1, W=2, X=4*/
 	u32 mapping_type;	//This vm area is backed by 4KB pages or 2MB huge page?
 	struct vm_area *vm_next; // Pointer to the next vm_area
+	/* address index (mmap.c): an AVL tree of the areas ordered by vm_start */
+	struct vm_area *vm_left;
+	struct vm_area *vm_right;
+	unsigned long vm_max_gap;	// largest free range after an area of this subtree
+	u32 vm_height;
+	struct vm_area *vm_root;	// list head only: root of the tree
+	struct vm_area *vm_last;	// list head only: area of the last page fault
 };
 
 
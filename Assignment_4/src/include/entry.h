@@ -34,6 +34,8 @@
 #define SYSCALL_MAKE_HUGEPAGE	31 
 #define SYSCALL_BREAK_HUGEPAGE	32 
 
+#define SYSCALL_MEMOPS_BENCH	33
+
 //Error numbers. must be used by appending a unary ,minus
 #define EAGAIN 2
 #define EBUSY 3
@@ -65,9 +67,14 @@ struct os_configs{
 	u64 apic_tick_interval;
 	u64 debug;
 	u64 adv_global; 
+	u64 fault_around;	// pages mapped around an mmap page fault, 0 maps just the one
+	u64 thp;		// map hugepages on faults in 2MB aligned windows of normal mmap areas
 };
 
+#define OS_CONFIGS_BOOT_SIZE 32	// bytes of *config set up at boot
+
 extern struct os_configs *config;
+extern struct os_configs os_config;	// config, once configure() has been called
 
 extern long do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4);
 extern long int3_entry();
@@ -90,6 +97,7 @@ extern long do_clone(void *th_func, void *user_stack);
 extern long invoke_sync_signal(int signo, u64 *ustackp, u64 *urip); 
 extern long do_signal(int signo, unsigned long handler); 
 extern long do_alarm(u32 ticks);
+extern long do_configure(struct os_configs *new_config);
 extern int do_div_by_zero(struct user_regs *regs);
 extern int do_page_fault(struct user_regs *regs, u64 error_code);
 #endif //__ENTRY_S
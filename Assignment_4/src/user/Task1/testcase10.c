@@ -0,0 +1,67 @@
+#include<ulib.h>
+
+// Many small vm_areas: faults, unmapping every other area and filling a hole
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+  int pages = 4096;
+  int areas = 512;
+  char *mm[512];
+  char c;
+
+  // Alternating protections keep the areas from merging.
+  for(int i = 0; i < areas; i++)
+  {
+    mm[i] = mmap(NULL, pages, (i % 2) ? PROT_READ : PROT_READ|PROT_WRITE, 0);
+    if((long)mm[i] <= 0 || (i && mm[i] != mm[i - 1] + pages))
+    {
+      printf("Test case failed \n");
+      return 1;
+    }
+  }
+  // vm_area count should be 512.
+  pmap(0);
+
+  for(int i = 0; i < areas; i++)
+  {
+    if(i % 2)
+      c = mm[i][0];
+    else
+      mm[i][0] = 'a';
+  }
+  // Touching the pages again does not fault.
+  for(int i = 0; i < areas; i += 2)
+    mm[i][100] = mm[i][0];
+  // vm_area count should be 512, page faults 512.
+  pmap(0);
+
+  for(int i = 1; i < areas; i += 2)
+  {
+    if(munmap(mm[i], pages) < 0)
+    {
+      printf("Test case failed \n");
+      return 1;
+    }
+  }
+  // vm_area count should be 256.
+  pmap(0);
+
+  // The lowest hole is the one after the first area, filling it joins three areas.
+  char *hole = mmap(NULL, pages, PROT_READ|PROT_WRITE, 0);
+  if(hole != mm[1])
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+  // vm_area count should be 255.
+  pmap(0);
+
+  if(munmap(mm[0], areas * pages) < 0)
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+  // vm_area count should be 0.
+  pmap(0);
+  return 0;
+}
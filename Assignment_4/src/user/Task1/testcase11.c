@@ -0,0 +1,55 @@
+#include<ulib.h>
+
+// Fault-around and MAP_POPULATE
+
+static void touch(char *buf, int length)
+{
+  for(int i = 0; i < length; i += 4096)
+    buf[i] = 'a';
+}
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+  int MB = 1 << 20;
+  struct os_configs cfg = {
+    .apic_tick_interval = 0x20,  // boot default
+    .fault_around = 16,
+  };
+
+  if(configure(&cfg) < 0)
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+
+  // The 16 page windows are 64KB aligned, the first one is cut short by the
+  // start of the area: 17 faults for 256 pages.
+  char *mm1 = mmap(NULL, MB, PROT_READ|PROT_WRITE, 0);
+  if((long)mm1 <= 0)
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+  touch(mm1, MB);
+  // vm_area count should be 1, page faults 17.
+  pmap(0);
+
+  // Populated up front, touching it does not fault.
+  char *mm2 = mmap(NULL, MB, PROT_READ|PROT_WRITE, MAP_POPULATE);
+  if(mm2 != mm1 + MB)
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+  touch(mm2, MB);
+  // vm_area count should be 1 (merged), page faults 17.
+  pmap(0);
+
+  cfg.fault_around = 0;
+  configure(&cfg);
+  char *mm3 = mmap(NULL, 16 * 4096, PROT_READ|PROT_WRITE, 0);
+  touch(mm3, 16 * 4096);
+  // vm_area count should be 1, page faults 33.
+  pmap(0);
+  return 0;
+}
@@ -0,0 +1,39 @@
+#include<ulib.h>
+
+// munmap drops the pages: mapping the range again faults again
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+  int pages = 4096;
+
+  char *mm1 = mmap(NULL, pages*16, PROT_READ|PROT_WRITE, 0);
+  if((long)mm1 <= 0)
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+  for(int i = 0; i < 16; i++)
+    mm1[i * pages] = 'a';
+  // vm_area count should be 1, page faults 16.
+  pmap(0);
+
+  if(munmap(mm1, pages*16) < 0)
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+  // vm_area count should be 0.
+  pmap(0);
+
+  char *mm2 = mmap(NULL, pages*16, PROT_READ|PROT_WRITE, 0);
+  if(mm2 != mm1)
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+  for(int i = 0; i < 16; i++)
+    mm2[i * pages] = 'b';
+  // vm_area count should be 1, page faults 32.
+  pmap(0);
+  return 0;
+}
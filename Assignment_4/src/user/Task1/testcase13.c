@@ -0,0 +1,58 @@
+#include<ulib.h>
+
+// Transparent hugepages: a fault in a 2MB aligned window of a normal area
+// maps the whole window, the pages outside such windows come one by one
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+  int MB = 1 << 20;
+  int pages = 4096;
+  u64 aligned = 0x180400000; // 2MB aligned address
+  struct os_configs cfg = {
+    .apic_tick_interval = 0x20,  // boot default
+    .thp = 1,
+  };
+
+  if(configure(&cfg) < 0)
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+
+  char *mm1 = mmap((void *)aligned, 4*MB + pages, PROT_READ|PROT_WRITE, MAP_FIXED);
+  if((u64)mm1 != aligned)
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+  // Two hugepages and one 4KB page: 3 faults for 1025 pages.
+  for(int i = 0; i < 4*MB + pages; i += pages)
+  {
+    if(mm1[i] != 0)
+    {
+      printf("Test case failed \n");
+      return 1;
+    }
+    mm1[i] = 'a';
+  }
+  // vm_area count should be 1, page faults 3.
+  pmap(0);
+
+  // A partial munmap splits the hugepage, the rest of it stays mapped.
+  if(munmap(mm1 + MB, pages) < 0)
+  {
+    printf("Test case failed \n");
+    return 1;
+  }
+  for(int i = 0; i < 2*MB; i += pages)
+  {
+    if(i != MB && mm1[i] != 'a')
+    {
+      printf("Test case failed \n");
+      return 1;
+    }
+  }
+  // vm_area count should be 2, page faults 3.
+  pmap(0);
+  return 0;
+}
@@ -197,6 +197,11 @@ int break_hugepage(void *addr, u32 length)
 	return _syscall2(SYSCALL_BREAK_HUGEPAGE, (u64)addr, length);
 }
 
+int memops_bench(struct memops_bench *bench)
+{
+	return _syscall1(SYSCALL_MEMOPS_BENCH, (u64)bench);
+}
+
 
 // C library functions
 static int vuprintf(char *buf,char *format,va_list args){
@@ -53,6 +53,8 @@ typedef long long s64;
 #define SYSCALL_MAKE_HUGEPAGE	31 
 #define SYSCALL_BREAK_HUGEPAGE	32 
 
+#define SYSCALL_MEMOPS_BENCH	33
+
 #define MAP_RD  0x0
 #define MAP_WR  0x1
 
@@ -112,6 +114,30 @@ struct os_configs{
 	u64 apic_tick_interval;
 	u64 debug;
 	u64 adv_global; 
+	u64 fault_around;	// pages mapped around an mmap page fault, 0 maps just the one
+	u64 thp;		// map hugepages on faults in 2MB aligned windows of normal mmap areas
+};
+
+// kernel copy/zero implementations, see memops_bench()
+enum{
+	MEMOPS_BYTE,
+	MEMOPS_WORD,
+	MEMOPS_REP_MOVSQ,
+	MEMOPS_REP_MOVSB,
+	MEMOPS_SSE,
+	MEMOPS_AVX,
+	MAX_MEMOPS
+};
+
+struct memops_bench{
+	u64 src;
+	u64 dst;
+	u64 size;
+	u64 iterations;
+	u64 available;
+	u64 selected;
+	u64 copy_cycles[MAX_MEMOPS];
+	u64 zero_cycles[MAX_MEMOPS];
 };
 
 extern void exit(int);
@@ -143,4 +169,5 @@ extern long get_cow_fault_stats();
 
 extern long make_hugepage(void *addr, u32 length, u32 prot, u32 force_prot);
 extern int break_hugepage(void *addr, u32 length);
+extern int memops_bench(struct memops_bench *bench);
 #endif
@@ -1,5 +1,6 @@
 #include<types.h>
 #include<mmap.h>
+#include<memops.h>
 
 // Helper function to create a new vm_area
 struct vm_area* create_vm_area(u64 start_addr, u64 end_addr, u32 flags, u32 mapping_type)
@@ -13,104 +14,607 @@ struct vm_area* create_vm_area(u64 start_addr, u64 end_addr, u32 flags, u32 mapp
 }
 
 
-int normal_pagefault(struct exec_context *current, u64 addr, int error_code){
-	// printk("Handling normal pagefault!")
-	// get base addr of pgdir
-	u64 *vaddr_base = (u64 *)osmap(current->pgd);
-	u64 *entry;
-	u64 pfn;
-	// set User and Present flags
-	// set Write flag if specified in error_code
-	u64 ac_flags = 0x5 | (error_code & 0x2);
-	
-	// find the entry in page directory
-	entry = vaddr_base + ((addr & PGD_MASK) >> PGD_SHIFT);
-	if(*entry & 0x1) {
-		// PGD->PUD Present, access it
-		pfn = (*entry >> PTE_SHIFT) & 0xFFFFFFFF;
-		vaddr_base = (u64 *)osmap(pfn);
-	}else{
-		// allocate PUD
-		pfn = os_pfn_alloc(OS_PT_REG);
-		*entry = (pfn << PTE_SHIFT) | ac_flags;
-		vaddr_base = osmap(pfn);
+/*
+ * The areas of a process are kept twice: in address order on the vm_next
+ * list, which is what pmap walks, and in an AVL tree threaded through the
+ * same vm_area structures. A tree node also carries the largest free range
+ * following an area of its subtree (up to the next area, or MMAP_AREA_END
+ * after the last one), so finding the area of an address and the lowest
+ * free range of a size are both O(log n). The dummy head is the first area
+ * of the list and holds the root of the tree and the area of the last
+ * page fault.
+ */
+
+static u64 vma_gap(struct vm_area *vma)
+{
+	return (vma->vm_next ? vma->vm_next->vm_start : MMAP_AREA_END) - vma->vm_end;
+}
+
+static u32 vma_height(struct vm_area *vma)
+{
+	return vma ? vma->vm_height : 0;
+}
+
+static u64 vma_max_gap(struct vm_area *vma)
+{
+	return vma ? vma->vm_max_gap : 0;
+}
+
+// recompute the height and the max gap of vma from its children
+static void vma_fix(struct vm_area *vma)
+{
+	u32 left = vma_height(vma->vm_left);
+	u32 right = vma_height(vma->vm_right);
+	u64 gap = vma_gap(vma);
+
+	if(vma_max_gap(vma->vm_left) > gap)
+		gap = vma_max_gap(vma->vm_left);
+	if(vma_max_gap(vma->vm_right) > gap)
+		gap = vma_max_gap(vma->vm_right);
+	vma->vm_height = (left > right ? left : right) + 1;
+	vma->vm_max_gap = gap;
+}
+
+static struct vm_area *vma_rotate_right(struct vm_area *vma)
+{
+	struct vm_area *left = vma->vm_left;
+
+	vma->vm_left = left->vm_right;
+	left->vm_right = vma;
+	vma_fix(vma);
+	vma_fix(left);
+	return left;
+}
+
+static struct vm_area *vma_rotate_left(struct vm_area *vma)
+{
+	struct vm_area *right = vma->vm_right;
+
+	vma->vm_right = right->vm_left;
+	right->vm_left = vma;
+	vma_fix(vma);
+	vma_fix(right);
+	return right;
+}
+
+static struct vm_area *vma_balance(struct vm_area *vma)
+{
+	int diff;
+
+	vma_fix(vma);
+	diff = (int)vma_height(vma->vm_left) - (int)vma_height(vma->vm_right);
+	if(diff > 1){
+		if(vma_height(vma->vm_left->vm_left) < vma_height(vma->vm_left->vm_right))
+			vma->vm_left = vma_rotate_left(vma->vm_left);
+		return vma_rotate_right(vma);
+	}
+	if(diff < -1){
+		if(vma_height(vma->vm_right->vm_right) < vma_height(vma->vm_right->vm_left))
+			vma->vm_right = vma_rotate_right(vma->vm_right);
+		return vma_rotate_left(vma);
+	}
+	return vma;
+}
+
+static struct vm_area *vma_tree_insert(struct vm_area *root, struct vm_area *vma)
+{
+	if(root == NULL){
+		vma->vm_left = NULL;
+		vma->vm_right = NULL;
+		vma_fix(vma);
+		return vma;
+	}
+	if(vma->vm_start < root->vm_start)
+		root->vm_left = vma_tree_insert(root->vm_left, vma);
+	else
+		root->vm_right = vma_tree_insert(root->vm_right, vma);
+	return vma_balance(root);
+}
+
+static struct vm_area *vma_tree_remove_min(struct vm_area *root, struct vm_area **min)
+{
+	if(root->vm_left == NULL){
+		*min = root;
+		return root->vm_right;
 	}
+	root->vm_left = vma_tree_remove_min(root->vm_left, min);
+	return vma_balance(root);
+}
+
+static struct vm_area *vma_tree_remove(struct vm_area *root, struct vm_area *vma)
+{
+	struct vm_area *min;
 
-	entry = vaddr_base + ((addr & PUD_MASK) >> PUD_SHIFT);
-	if(*entry & 0x1) {
-		// PUD->PMD Present, access it
-		pfn = (*entry >> PTE_SHIFT) & 0xFFFFFFFF;
-		vaddr_base = (u64 *)osmap(pfn);
+	if(vma->vm_start < root->vm_start){
+		root->vm_left = vma_tree_remove(root->vm_left, vma);
+	}else if(vma->vm_start > root->vm_start){
+		root->vm_right = vma_tree_remove(root->vm_right, vma);
 	}else{
-		// allocate PMD
-		pfn = os_pfn_alloc(OS_PT_REG);
-		*entry = (pfn << PTE_SHIFT) | ac_flags;
-		vaddr_base = osmap(pfn);
+		if(root->vm_right == NULL)
+			return root->vm_left;
+		root->vm_right = vma_tree_remove_min(root->vm_right, &min);
+		min->vm_left = root->vm_left;
+		min->vm_right = root->vm_right;
+		root = min;
+	}
+	return vma_balance(root);
+}
+
+// the gap after vma changed, recompute the max gaps on the path down to it
+static void vma_tree_update(struct vm_area *root, struct vm_area *vma)
+{
+	if(root != vma)
+		vma_tree_update(vma->vm_start < root->vm_start ? root->vm_left : root->vm_right, vma);
+	vma_fix(root);
+}
+
+// the last area starting at or below addr
+static struct vm_area *vma_floor(struct vm_area *head, u64 addr)
+{
+	struct vm_area *vma = head->vm_root;
+	struct vm_area *found = NULL;
+
+	while(vma){
+		if(vma->vm_start <= addr){
+			found = vma;
+			vma = vma->vm_right;
+		}else{
+			vma = vma->vm_left;
+		}
+	}
+	return found;
+}
+
+// the area before vma on the list, NULL for the head
+static struct vm_area *vma_prev(struct vm_area *head, struct vm_area *vma)
+{
+	return vma == head ? NULL : vma_floor(head, vma->vm_start - 1);
+}
+
+// the lowest area followed by at least len free bytes
+static struct vm_area *vma_first_fit(struct vm_area *head, u64 len)
+{
+	struct vm_area *vma = head->vm_root;
+
+	if(vma_max_gap(vma) < len)
+		return NULL;
+	while(1){
+		if(vma_max_gap(vma->vm_left) >= len)
+			vma = vma->vm_left;
+		else if(vma_gap(vma) >= len)
+			return vma;
+		else
+			vma = vma->vm_right;
+	}
+}
+
+// put vma on the list after prev
+static void vma_link(struct vm_area *head, struct vm_area *prev, struct vm_area *vma)
+{
+	vma->vm_next = prev->vm_next;
+	prev->vm_next = vma;
+	head->vm_root = vma_tree_insert(head->vm_root, vma);
+	vma_tree_update(head->vm_root, prev);
+}
+
+// take vma, the area after prev, off the list and free it
+static void vma_unlink(struct vm_area *head, struct vm_area *prev, struct vm_area *vma)
+{
+	head->vm_root = vma_tree_remove(head->vm_root, vma);
+	prev->vm_next = vma->vm_next;
+	vma_tree_update(head->vm_root, prev);
+	if(head->vm_last == vma)
+		head->vm_last = NULL;
+	vma->vm_next = NULL;
+	dealloc_vm_area(vma);
+}
+
+// move the bounds of vma, a new start also changes the gap before it
+static void vma_adjust(struct vm_area *head, struct vm_area *vma, u64 start, u64 end)
+{
+	struct vm_area *prev = start != vma->vm_start ? vma_prev(head, vma) : NULL;
+
+	vma->vm_start = start;
+	vma->vm_end = end;
+	vma_tree_update(head->vm_root, vma);
+	if(prev)
+		vma_tree_update(head->vm_root, prev);
+}
+
+// cut vma at addr, the part below addr becomes a new area which is returned
+static struct vm_area *vma_split(struct vm_area *head, struct vm_area *vma, u64 addr)
+{
+	struct vm_area *prev = vma_prev(head, vma);
+	struct vm_area *low = create_vm_area(vma->vm_start, addr, vma->access_flags, vma->mapping_type);
+
+	// vma keeps its place in the tree, low takes its old key
+	vma->vm_start = addr;
+	vma_link(head, prev, low);
+	return low;
+}
+
+static int vma_mergeable(struct vm_area *low, struct vm_area *high)
+{
+	return low->vm_end == high->vm_start && low->mapping_type == high->mapping_type && low->access_flags == high->access_flags;
+}
+
+// join vma with the areas around it where they touch and agree, returns the area covering it
+static struct vm_area *vma_merge(struct vm_area *head, struct vm_area *vma)
+{
+	struct vm_area *prev = vma_prev(head, vma);
+	struct vm_area *next = vma->vm_next;
+
+	if(next && vma_mergeable(vma, next)){
+		vma->vm_end = next->vm_end;
+		vma_unlink(head, vma, next);
+	}
+	if(prev != head && vma_mergeable(prev, vma)){
+		prev->vm_end = vma->vm_end;
+		vma_unlink(head, prev, vma);
+		return prev;
 	}
+	return vma;
+}
+
+// does [addr, addr + len) fit between prev and the area after it?
+static int vma_fits(struct vm_area *prev, u64 addr, u64 len)
+{
+	return prev->vm_end <= addr && addr + len <= (prev->vm_next ? prev->vm_next->vm_start : MMAP_AREA_END);
+}
+
+
+/*
+Page table range walker. pt_walk() visits the last level entries of
+[start, end): the pte callback gets each 4KB entry, the pmd callback (if
+set) each PMD entry first and returns 1 when it dealt with the whole 2MB
+itself, a hugepage or a page table page it replaces. Every upper level is
+looked up once for all the entries under it. With PT_ALLOC missing tables
+are allocated on the way down, without it the range under them is skipped;
+with PT_FREE tables left empty are freed on the way back up.
+*/
+#define PT_ALLOC 0x1
+#define PT_FREE 0x2
+
+/*
+The TLB entries a walk drops are gathered and invalidated once it is over:
+page by page for up to PT_FLUSH_CEILING of them, by reloading CR3 (all of
+the non-global entries) beyond that. Nothing runs in user mode in between,
+so frames freed during the walk cannot be reached through a stale entry.
+*/
+#define PT_FLUSH_CEILING 32
+
+struct pt_walk{
+	void (*pte)(struct pt_walk *walk, u64 *entry, u64 addr);
+	int (*pmd)(struct pt_walk *walk, u64 *entry, u64 addr, u64 end);
+	u32 flags;
+	u64 ac_flags;	// access flags of the entries installed
+	int ret;	// set to -1 when memory runs out, which ends the walk
+	u32 flushes;	// pages to invalidate, the first PT_FLUSH_CEILING in flush[]
+	u64 flush[PT_FLUSH_CEILING];
+};
+
+static inline u64 pt_pfn(u64 entry){
+	return (entry >> PTE_SHIFT) & 0xFFFFFFFF;
+}
 
-	entry = vaddr_base + ((addr & PMD_MASK) >> PMD_SHIFT);
-	if(*entry & 0x1) {
-		// PMD->PTE Present, access it
-		pfn = (*entry >> PTE_SHIFT) & 0xFFFFFFFF;
-		vaddr_base = (u64 *)osmap(pfn);
+// physical (and kernel) address of the hugepage a PMD entry maps
+static inline void *pt_hugepage(u64 entry){
+	return (void *)(entry & FLAG_MASK & ~(u64)(HUGE_PAGE_SIZE - 1));
+}
+
+static inline void pt_invlpg(u64 addr){
+	// invalidates tlb entry corresponding to Virtual Address addr 
+	asm volatile (
+		"invlpg (%0);" 
+		:: "r"(addr) 
+		: "memory"
+	);
+}
+
+static inline void pt_flush_tlb(){
+	u64 cr3;
+
+	asm volatile (
+		"mov %%cr3, %0;"
+		"mov %0, %%cr3;"
+		: "=r"(cr3)
+		:
+		: "memory"
+	);
+}
+
+// the mapping of addr (a 4KB page, a hugepage or a page table) is going away
+static void pt_flush_page(struct pt_walk *walk, u64 addr){
+	if(walk->flushes < PT_FLUSH_CEILING)
+		walk->flush[walk->flushes] = addr;
+	walk->flushes++;
+}
+
+static void pt_flush_finish(struct pt_walk *walk){
+	if(walk->flushes > PT_FLUSH_CEILING){
+		pt_flush_tlb();
 	}else{
-		// allocate PLD
-		pfn = os_pfn_alloc(OS_PT_REG);
-		*entry = (pfn << PTE_SHIFT) | ac_flags;
-		vaddr_base = osmap(pfn);
+		for(u32 i = 0; i < walk->flushes; i++)
+			pt_invlpg(walk->flush[i]);
+	}
+	walk->flushes = 0;
+}
+
+static int pt_table_empty(u64 *table){
+	for(int i = 0; i < 512; i++)
+		if(table[i] & 0x1)
+			return 0;
+	return 1;
+}
+
+static void pt_walk_level(struct pt_walk *walk, u64 *table, u32 shift, u64 start, u64 end){
+	u64 size = (u64)1 << shift;
+	u64 addr, next, pfn;
+	u64 *entry, *lower;
+
+	for(addr = start; addr < end && walk->ret == 0; addr = next){
+		next = (addr & ~(size - 1)) + size;
+		if(next > end)
+			next = end;
+		entry = table + ((addr >> shift) & 0x1FF);
+
+		if(shift == PTE_SHIFT){
+			walk->pte(walk, entry, addr);
+			continue;
+		}
+		if(shift == PMD_SHIFT && walk->pmd && walk->pmd(walk, entry, addr, next))
+			continue;
+		if(!(*entry & 0x1)){
+			if(!(walk->flags & PT_ALLOC))
+				continue;
+			pfn = os_pfn_alloc(OS_PT_REG);
+			if(!pfn){
+				walk->ret = -1;
+				return;
+			}
+			// upper levels leave the access check to the last one
+			*entry = (pfn << PTE_SHIFT) | 0x7;
+		}else if(shift == PMD_SHIFT && (*entry & 0x80)){
+			continue;	// a hugepage nobody asked about
+		}
+
+		pfn = pt_pfn(*entry);
+		lower = (u64 *)osmap(pfn);
+		pt_walk_level(walk, lower, shift - 9, addr, next);
+		if((walk->flags & PT_FREE) && pt_table_empty(lower)){
+			os_pfn_free(OS_PT_REG, pfn);
+			*entry = 0;
+			pt_flush_page(walk, addr);
+		}
 	}
+}
 
-	entry = vaddr_base + ((addr & PTE_MASK) >> PTE_SHIFT);
-	// since this fault occured as frame was not present, we don't need present check here
+static int pt_walk(struct exec_context *current, struct pt_walk *walk, u64 start, u64 end){
+	walk->ret = 0;
+	walk->flushes = 0;
+	pt_walk_level(walk, (u64 *)osmap(current->pgd), PGD_SHIFT, start, end);
+	pt_flush_finish(walk);
+	return walk->ret;
+}
+
+// populate: back every missing 4KB entry with a new frame
+static void pte_populate(struct pt_walk *walk, u64 *entry, u64 addr){
+	u64 pfn;
+
+	if(*entry & 0x1)
+		return;
 	pfn = os_pfn_alloc(USER_REG);
-	*entry = (pfn << PTE_SHIFT) | ac_flags;
+	if(!pfn){
+		walk->ret = -1;
+		return;
+	}
+	*entry = (pfn << PTE_SHIFT) | walk->ac_flags;
+}
 
+// populate: back a missing PMD entry with a zeroed hugepage, 4KB pages
+// left under it by a failed collapse are populated as such
+static int pmd_populate_huge(struct pt_walk *walk, u64 *entry, u64 addr, u64 end){
+	void *hpg;
+
+	if(*entry & 0x1)
+		return (*entry & 0x80) ? 1 : 0;
+	hpg = os_hugepage_alloc();
+	if(hpg == NULL){
+		walk->ret = -1;
+		return 1;
+	}
+	fast_bzero((char *)hpg, HUGE_PAGE_SIZE);	// unlike os_pfn_alloc, not cleared
+	*entry = (get_hugepage_pfn(hpg) << HUGEPAGE_SHIFT) | walk->ac_flags | 0x80;
 	return 1;
 }
 
-int hugepg_pagefault(struct exec_context *current, u64 addr, int error_code){
-	// get base addr of pgdir
-	u64 *vaddr_base = (u64 *)osmap(current->pgd);
-	u64 *entry;
+// unmap: free the frame of a 4KB entry
+static void pte_unmap(struct pt_walk *walk, u64 *entry, u64 addr){
+	if(!(*entry & 0x1))
+		return;
+	os_pfn_free(USER_REG, pt_pfn(*entry));
+	*entry = 0;
+	pt_flush_page(walk, addr);
+}
+
+// copy: replace a page table page by a hugepage holding the data of its pages
+static int pmd_collapse(struct pt_walk *walk, u64 *entry, u64 addr, u64 end){
+	u64 *ptes;
+	char *hpg = NULL;
+
+	if(!(*entry & 0x1))
+		return 1;	// nothing faulted in yet, the hugepage comes with the first fault
+	if(*entry & 0x80){
+		// a transparent hugepage already, only its protection may change
+		*entry = (*entry & ~(u64)0x2) | (walk->ac_flags & 0x2);
+		pt_flush_page(walk, addr);
+		return 1;
+	}
+
+	ptes = (u64 *)osmap(pt_pfn(*entry));
+	for(int i = 0; i < 512; i++){
+		if(!(ptes[i] & 0x1))
+			continue;
+		if(hpg == NULL){
+			hpg = (char *)os_hugepage_alloc();
+			if(hpg == NULL){
+				walk->ret = -1;
+				return 1;
+			}
+			// the pages never faulted in read as zeroes
+			fast_bzero(hpg, HUGE_PAGE_SIZE);
+		}
+		fast_memcpy(hpg + i*0x1000, (char *)osmap(pt_pfn(ptes[i])), 0x1000);
+		os_pfn_free(USER_REG, pt_pfn(ptes[i]));
+		pt_flush_page(walk, addr + i*0x1000);
+	}
+	os_pfn_free(OS_PT_REG, pt_pfn(*entry));
+	*entry = hpg ? (get_hugepage_pfn(hpg) << HUGEPAGE_SHIFT) | walk->ac_flags | 0x80 : 0;
+	pt_flush_page(walk, addr);	// the cached PDE of the freed table goes too
+	return 1;
+}
+
+// copy: replace a hugepage by a page table page of 4KB pages holding its data,
+// the hugepage stays if there is not enough memory for them
+static int pmd_split(struct pt_walk *walk, u64 *entry, u64 addr, u64 end){
+	u64 *ptes;
+	char *hpg;
 	u64 pfn;
-	// set User and Present flags
-	// set Write flag if specified in error_code
-	u64 ac_flags = 0x5 | (error_code & 0x2);
-	
-	// find the entry in page directory
-	entry = vaddr_base + ((addr & PGD_MASK) >> PGD_SHIFT);
-	if(*entry & 0x1) {
-		// PGD->PUD Present, access it
-		pfn = (*entry >> PTE_SHIFT) & 0xFFFFFFFF;
-		vaddr_base = (u64 *)osmap(pfn);
-	}else{
-		// allocate PUD
-		pfn = os_pfn_alloc(OS_PT_REG);
-		*entry = (pfn << PTE_SHIFT) | ac_flags;
-		vaddr_base = osmap(pfn);
+
+	if((*entry & 0x81) != 0x81)
+		return 1;	// not faulted in, 4KB pages come with the faults
+
+	hpg = (char *)pt_hugepage(*entry);
+	pfn = os_pfn_alloc(OS_PT_REG);
+	if(!pfn){
+		walk->ret = -1;
+		return 1;
+	}
+	ptes = (u64 *)osmap(pfn);
+	for(int i = 0; i < 512; i++){
+		u64 pfn_normalpg = os_pfn_alloc(USER_REG);
+		if(!pfn_normalpg){
+			while(i--)
+				os_pfn_free(USER_REG, pt_pfn(ptes[i]));
+			os_pfn_free(OS_PT_REG, pfn);
+			walk->ret = -1;
+			return 1;
+		}
+		fast_memcpy((char *)osmap(pfn_normalpg), hpg + i*0x1000, 0x1000);
+		ptes[i] = (pfn_normalpg << PTE_SHIFT) | 0x5 | (*entry & 0x2);
 	}
+	os_hugepage_free(hpg);
+	*entry = (pfn << PTE_SHIFT) | 0x7;
+	pt_flush_page(walk, addr);
+	return 1;
+}
 
-	entry = vaddr_base + ((addr & PUD_MASK) >> PUD_SHIFT);
-	if(*entry & 0x1) {
-		// PUD->PMD Present, access it
-		pfn = (*entry >> PTE_SHIFT) & 0xFFFFFFFF;
-		vaddr_base = (u64 *)osmap(pfn);
-	}else{
-		// allocate PMD
-		pfn = os_pfn_alloc(OS_PT_REG);
-		*entry = (pfn << PTE_SHIFT) | ac_flags;
-		vaddr_base = osmap(pfn);
+// unmap: free a hugepage, page table pages are left to the walker; a
+// transparent hugepage of a normal area only partly unmapped is split first
+// (vm_area_unmap has done that already, see thp_split_partial)
+static int pmd_unmap(struct pt_walk *walk, u64 *entry, u64 addr, u64 end){
+	if((*entry & 0x81) != 0x81)
+		return 0;
+	if(end - addr < HUGE_PAGE_SIZE){
+		pmd_split(walk, entry, addr, end);
+		return 0;
 	}
+	os_hugepage_free(pt_hugepage(*entry));
+	*entry = 0;
+	pt_flush_page(walk, addr);
+	return 1;
+}
 
-	entry = vaddr_base + ((addr & PMD_MASK) >> PMD_SHIFT);
-	
-	// since this fault occured as huge page frame was not present, we don't need present check here
-	u32 pfn_hpg = get_hugepage_pfn(os_hugepage_alloc());
-	*entry = (pfn << PTE_SHIFT) | (ac_flags|0x80);
+/*
+Map the pages of [start, end) that are not mapped yet. Returns -1 if memory
+ran out part way, the pages mapped till then stay.
+*/
+int normal_map_range(struct exec_context *current, u64 start, u64 end, u64 ac_flags){
+	struct pt_walk walk = {
+		.pte = pte_populate,
+		.flags = PT_ALLOC,
+		.ac_flags = ac_flags,
+	};
+
+	return pt_walk(current, &walk, start, end);
+}
+
+// THP: back a PMD entry with no 4KB pages under it by a zeroed hugepage
+static int pmd_populate_thp(struct pt_walk *walk, u64 *entry, u64 addr, u64 end){
+	if(*entry & 0x1){
+		walk->ret = -1;	// 4KB pages were faulted in here, stay with them
+		return 1;
+	}
+	return pmd_populate_huge(walk, entry, addr, end);
+}
+
+/*
+With config thp set, a fault in a 2MB aligned window that the normal area
+covers whole maps a hugepage for the window. The area stays a normal one.
+Returns 0 when the window already has 4KB pages or no hugepage is left, the
+fault is then served with 4KB pages.
+*/
+static int thp_pagefault(struct exec_context *current, struct vm_area *vm_node, u64 addr, u64 ac_flags){
+	struct pt_walk walk = {
+		.pte = pte_populate,
+		.pmd = pmd_populate_thp,
+		.flags = PT_ALLOC,
+		.ac_flags = ac_flags,
+	};
+	u64 start = addr & ~(u64)(HUGE_PAGE_SIZE - 1);
+
+	if(start < vm_node->vm_start || start + HUGE_PAGE_SIZE > vm_node->vm_end)
+		return 0;
+	return pt_walk(current, &walk, start, start + HUGE_PAGE_SIZE) < 0 ? 0 : 1;
+}
 
+/*
+Map the faulting page and, with config fault_around set, the other pages of
+the aligned window of that many pages around it (a power of two, at most a
+page table page) which lie in the same vm area.
+*/
+int normal_pagefault(struct exec_context *current, struct vm_area *vm_node, u64 addr, int error_code){
+	// printk("Handling normal pagefault!")
+	// set User and Present flags, and Write if the area is writable
+	u64 ac_flags = 0x5 | (vm_node->access_flags & PROT_WRITE);
+	u64 window = os_config.fault_around;
+	u64 start, end;
+
+	if(os_config.thp && thp_pagefault(current, vm_node, addr, ac_flags))
+		return 1;
+
+	if(window > 512)
+		window = 512;
+	while(window & (window - 1))
+		window &= window - 1;
+	if(window < 1)
+		window = 1;
+
+	start = addr & ~(window*0x1000 - 1);
+	end = start + window*0x1000;
+	if(start < vm_node->vm_start)
+		start = vm_node->vm_start;
+	if(end > vm_node->vm_end)
+		end = vm_node->vm_end;
+
+	if(normal_map_range(current, start, end, ac_flags) < 0)
+		return -1;
 	return 1;
 }
 
+int hugepg_pagefault(struct exec_context *current, struct vm_area *vm_node, u64 addr, int error_code){
+	struct pt_walk walk = {
+		.pte = pte_populate,
+		.pmd = pmd_populate_huge,
+		.flags = PT_ALLOC,
+		.ac_flags = 0x5 | (vm_node->access_flags & PROT_WRITE),
+	};
+	u64 start = addr & ~(u64)(HUGE_PAGE_SIZE - 1);
+
+	if(pt_walk(current, &walk, start, start + HUGE_PAGE_SIZE) < 0)
+		return -1;
+	return 1;
+}
 
 /**
  * Function will invoked whenever there is page fault. (Lazy allocation)
@@ -127,22 +631,26 @@ int vm_area_pagefault(struct exec_context *current, u64 addr, int error_code)
 	if(error_code == 0x7)
 		return -1;
 
-	struct vm_area* vm_node = current->vm_area;
-	while(vm_node){
-		if(vm_node->vm_start <= addr && vm_node->vm_end > addr)
-			break;
-		vm_node = vm_node->vm_next;
-	}
-	if(vm_node==NULL)
+	struct vm_area* head = current->vm_area;
+	if(head==NULL)
 		return -1;
 
+	// faults tend to come in runs on one area, try the last one first
+	struct vm_area* vm_node = head->vm_last;
+	if(vm_node==NULL || vm_node->vm_start > addr || vm_node->vm_end <= addr){
+		vm_node = vma_floor(head, addr);
+		if(vm_node==NULL || vm_node->vm_end <= addr)
+			return -1;
+		head->vm_last = vm_node;
+	}
+
 	if(vm_node->access_flags==PROT_READ && error_code==0x6)
 		return -1;
 
 	if(vm_node->mapping_type==NORMAL_PAGE_MAPPING){
-		return normal_pagefault(current, addr, error_code);
+		return normal_pagefault(current, vm_node, addr, error_code);
 	}else{
-		return hugepg_pagefault(current, addr, error_code);
+		return hugepg_pagefault(current, vm_node, addr, error_code);
 	}
 }
 
@@ -151,394 +659,137 @@ int vm_area_pagefault(struct exec_context *current, u64 addr, int error_code)
  */
 long vm_area_map(struct exec_context *current, u64 addr, int length, int prot, int flags)
 {
-	if(current==NULL)
+	if(current==NULL || length<=0)
 		return -1;
 	
 	// if this is the first mmap call, add the dummy vm_area
 	if(current->vm_area==NULL){
 		struct vm_area* dummy_area = create_vm_area(MMAP_AREA_START, MMAP_AREA_START + 0x1000, 0x4, NORMAL_PAGE_MAPPING);
 		
+		dummy_area->vm_next = NULL;
+		dummy_area->vm_root = vma_tree_insert(NULL, dummy_area);
+		dummy_area->vm_last = NULL;
 		current->vm_area = dummy_area;
 	}
+	struct vm_area* head = current->vm_area;
 
 	int num_vm_areas = length/0x1000;
 	if(length%0x1000)
 		num_vm_areas++;
-	
-	if(flags==MAP_FIXED){
-		if((u64*)addr==NULL || addr%0x1000!=0 || addr+num_vm_areas*0x1000>MMAP_AREA_END)
-			return -1;
+	u64 len = 0x1000*(u64)num_vm_areas;
 
-		struct vm_area* vm_node1 = current->vm_area;
-		struct vm_area* vm_node2 = NULL;
-	
-		while(vm_node1){
-			if(vm_node1->vm_start > addr)
-				break;
-			vm_node2 = vm_node1;
-			vm_node1 = vm_node1->vm_next;
-		}
+	struct vm_area* vm_node2;
+	if(flags & MAP_FIXED){
+		if((u64*)addr==NULL || addr%0x1000!=0 || addr+len>MMAP_AREA_END)
+			return -1;
 
-		if(vm_node1==NULL){
-			if(vm_node2->vm_end > addr)
-				return -1;
-			else if(vm_node2->mapping_type!=HUGE_PAGE_MAPPING && vm_node2->vm_start!=MMAP_AREA_START && vm_node2->vm_end== addr && vm_node2->access_flags==prot){
-				vm_node2->vm_end += 0x1000 * num_vm_areas;
-				return vm_node2->vm_end;
-			}else{
-				struct vm_area* new_vm_area = create_vm_area(addr, addr + 0x1000*num_vm_areas, prot, NORMAL_PAGE_MAPPING);
-				new_vm_area->vm_next = NULL;
-
-				vm_node2->vm_next = new_vm_area;
-				return new_vm_area->vm_start;
-			}
-		}else{
-			if(vm_node2->vm_end > addr || vm_node1->vm_start < addr + 0x1000*num_vm_areas){
-				return -1;
-			}else if(vm_node2->mapping_type!=HUGE_PAGE_MAPPING && vm_node1->mapping_type!=HUGE_PAGE_MAPPING && vm_node2->vm_start!=MMAP_AREA_START && vm_node2->vm_end == addr && vm_node1->vm_start == addr + 0x1000*num_vm_areas && vm_node1->access_flags==prot && vm_node2->access_flags==prot){
-				vm_node2->vm_next = vm_node1->vm_next;
-				vm_node1->vm_next = NULL;
-				vm_node2->vm_end = vm_node1->vm_end;
-				dealloc_vm_area(vm_node1);
-				return addr;
-			}else if(vm_node2->mapping_type!=HUGE_PAGE_MAPPING && vm_node2->vm_start!=MMAP_AREA_START && vm_node2->vm_end == addr && vm_node2->access_flags==prot){
-				vm_node2->vm_end += 0x1000*num_vm_areas;
-				return vm_node2->vm_end;
-			}else if(vm_node1->mapping_type!=HUGE_PAGE_MAPPING && vm_node1->vm_end == addr && vm_node1->access_flags==prot){
-				vm_node1->vm_start = addr;
-				return vm_node1->vm_start;
-			}else{
-				struct vm_area* new_vm_area = create_vm_area(addr, addr + 0x1000*num_vm_areas, prot, NORMAL_PAGE_MAPPING);
-			
-				vm_node2->vm_next = new_vm_area;
-				new_vm_area->vm_next = vm_node1;
-				return new_vm_area->vm_start;
-			}
-		}
+		vm_node2 = vma_floor(head, addr);
+		if(vm_node2==NULL || !vma_fits(vm_node2, addr, len))
+			return -1;
 	}else{
 		if(addr%0x1000)
 			addr = (addr - addr%0x1000) + 0x1000;
-		
-		if((u64*)addr == NULL){
-			// printk("ADDR IS NULL!\n");
-			struct vm_area* vm_node1 = current->vm_area;
-			struct vm_area* vm_node2 = NULL;
-			u64 curr_addr = vm_node1->vm_end;
-
-			while(vm_node1){
-				if(vm_node1->vm_start >= curr_addr + num_vm_areas*0x1000)
-					break;
-				curr_addr = vm_node1->vm_end;
-				vm_node2 = vm_node1;
-				vm_node1 = vm_node1->vm_next;
-			}
-			// printk("VM NODE 1 BEGIN : %x\nCURR_ADDR : %x\nCURR_END_ADDR : %x\n", vm_node1->vm_start, curr_addr, curr_addr + 0x1000*num_vm_areas);
-			// printk("VM NODE 1 ACCESS FLAGS: %x\nPROT : %x\n", vm_node1->access_flags, prot);
-			if(vm_node1==NULL){
-				if(vm_node2->vm_end > curr_addr)
-					return -1;
-				else if(vm_node2->mapping_type!=HUGE_PAGE_MAPPING && vm_node2->vm_start!=MMAP_AREA_START && vm_node2->vm_end== curr_addr && vm_node2->access_flags==prot){
-					vm_node2->vm_end += 0x1000 * num_vm_areas;
-					return vm_node2->vm_end;
-				}else{
-					struct vm_area* new_vm_area = create_vm_area(curr_addr, curr_addr + 0x1000*num_vm_areas, prot, NORMAL_PAGE_MAPPING);
-					new_vm_area->vm_next = NULL;
-
-					vm_node2->vm_next = new_vm_area;
-					return new_vm_area->vm_start;
-				}
-			}else{
-				
-				if(curr_addr + num_vm_areas*0x1000 > MMAP_AREA_END)
-					return -1;
-				if(vm_node2->mapping_type!=HUGE_PAGE_MAPPING && vm_node1->mapping_type!=HUGE_PAGE_MAPPING && vm_node2->vm_start!=MMAP_AREA_START && vm_node1->vm_start == curr_addr + 0x1000*num_vm_areas && vm_node1->access_flags==prot && vm_node2->access_flags==prot){
-					vm_node2->vm_next = vm_node1->vm_next;
-					vm_node1->vm_next = NULL;
-					vm_node2->vm_end = vm_node1->vm_end;
-					dealloc_vm_area(vm_node1);
-					return curr_addr;
-				}else if(vm_node2->mapping_type!=HUGE_PAGE_MAPPING && vm_node2->vm_start!=MMAP_AREA_START && vm_node2->access_flags==prot){
-					vm_node2->vm_end += 0x1000*num_vm_areas;
-					return curr_addr;
-				}else if(vm_node1->mapping_type!=HUGE_PAGE_MAPPING && vm_node1->vm_start == curr_addr + 0x1000*num_vm_areas && vm_node1->access_flags==prot){
-					vm_node1->vm_start = curr_addr;
-					return curr_addr;
-				}else{
-					struct vm_area* new_vm_area = create_vm_area(curr_addr, curr_addr+0x1000*num_vm_areas, prot, NORMAL_PAGE_MAPPING);
-					
-					vm_node2->vm_next = new_vm_area;
-					new_vm_area->vm_next = vm_node1;
-					return new_vm_area->vm_start;
-				}
-			}
-		}else{
-			struct vm_area* vm_node1 = current->vm_area;
-			struct vm_area* vm_node2 = NULL;
-			
-			while(vm_node1){
-				if(vm_node1->vm_start > addr)
-					break;
-				vm_node2 = vm_node1;
-				vm_node1 = vm_node1->vm_next;
-			}
-			// printk("VM NODE 1 START : %x END : %x\n", vm_node1->vm_start, vm_node1->vm_end);
-			if(vm_node1==NULL){
-				if(vm_node2->vm_end > addr)
-					return -1;
-				else if(vm_node2->mapping_type!=HUGE_PAGE_MAPPING && vm_node2->vm_start!=MMAP_AREA_START && vm_node2->vm_end == addr && vm_node2->access_flags==prot){
-					vm_node2->vm_end += 0x1000 * num_vm_areas;
-					return vm_node2->vm_end;
-				}else{
-					struct vm_area* new_vm_area = create_vm_area(addr, addr + 0x1000*num_vm_areas, prot, NORMAL_PAGE_MAPPING);
-					new_vm_area->vm_next = NULL;
-
-					vm_node2->vm_next = new_vm_area;
-					return new_vm_area->vm_start;
-				}
-			}else{
-				if(vm_node2->vm_end > addr || vm_node1->vm_start < addr + 0x1000*num_vm_areas){
-					return vm_area_map(current, (u64)NULL, length, prot, flags);
-				}else if(vm_node2->mapping_type!=HUGE_PAGE_MAPPING && vm_node1->mapping_type!=HUGE_PAGE_MAPPING && vm_node2->vm_start!=MMAP_AREA_START && vm_node2->vm_end == addr && vm_node1->vm_start == addr + 0x1000*num_vm_areas && vm_node1->access_flags==prot && vm_node2->access_flags==prot){
-					vm_node2->vm_next = vm_node1->vm_next;
-					vm_node1->vm_next = NULL;
-					vm_node2->vm_end = vm_node1->vm_end;
-					dealloc_vm_area(vm_node1);
-					return addr;
-				}else if(vm_node2->mapping_type!=HUGE_PAGE_MAPPING && vm_node2->vm_start!=MMAP_AREA_START && vm_node2->vm_end == addr && vm_node2->access_flags==prot){
-					vm_node2->vm_end += 0x1000*num_vm_areas;
-					return addr;
-				}else if(vm_node1->mapping_type!=HUGE_PAGE_MAPPING && vm_node1->vm_end == addr + 0x1000*num_vm_areas && vm_node1->access_flags==prot){
-					vm_node1->vm_start = addr;
-					return addr;
-				}else{
-					struct vm_area* new_vm_area = create_vm_area(addr, addr + 0x1000*num_vm_areas, prot, NORMAL_PAGE_MAPPING);
-					
-					vm_node2->vm_next = new_vm_area;
-					new_vm_area->vm_next = vm_node1;
-					return addr;
-				}
-			}
+
+		// no hint, or one that is taken: the lowest free range that fits
+		vm_node2 = (u64*)addr == NULL ? NULL : vma_floor(head, addr);
+		if(vm_node2==NULL || !vma_fits(vm_node2, addr, len)){
+			vm_node2 = vma_first_fit(head, len);
+			if(vm_node2==NULL)
+				return -1;
+			addr = vm_node2->vm_end;
 		}
 	}
-}
 
-void unmap_normal_vm_area(struct exec_context* current, u64 start_addr, u64 end_addr, struct vm_area** vm_node1, struct vm_area** vm_node2){
-	u64 start_unmap;
-	u64 end_unmap;
-	// printk("\nVM NODE VM_START : %x , VM_END : %x\n", (*vm_node1)->vm_start, (*vm_node1)->vm_end);
-	if(start_addr <= (*vm_node1)->vm_start && end_addr >= (*vm_node1)->vm_end){
-		start_unmap = (*vm_node1)->vm_start;
-		end_unmap = (*vm_node1)->vm_end;
-		// printk("1.Start Unmap : %x\nEnd Unmap : %x\n", start_unmap, end_unmap);
-
-		(*vm_node2)->vm_next = (*vm_node1)->vm_next;
-		(*vm_node1)->vm_next = NULL;
-		dealloc_vm_area(*vm_node1);
-		*vm_node1 = *vm_node2;
-	}else if(start_addr >= (*vm_node1)->vm_start && start_addr < (*vm_node1)->vm_end && end_addr >= (*vm_node1)->vm_end){
-		start_unmap = start_addr;
-		end_unmap = (*vm_node1)->vm_end;
-		// printk("2.Start Unmap : %x\nEnd Unmap : %x\n", start_unmap, end_unmap);
-	
-		(*vm_node1)->vm_end = start_addr;
-	}else if(start_addr <= (*vm_node1)->vm_start && end_addr <= (*vm_node1)->vm_end && end_addr > (*vm_node1)->vm_start){
-		start_unmap = (*vm_node1)->vm_start;
-		end_unmap = end_addr;
-		// printk("3.Start Unmap : %x\nEnd Unmap : %x\n", start_unmap, end_unmap);
-			
-		(*vm_node1)->vm_start = end_addr;
-	}else if(start_addr > (*vm_node1)->vm_start && end_addr < (*vm_node1)->vm_end){
-		start_unmap = start_addr;
-		end_unmap = end_addr;
-		// printk("4.Start Unmap : %x\nEnd Unmap : %x\n", start_unmap, end_unmap);
-			
-		struct vm_area* new_vm_area = create_vm_area((*vm_node1)->vm_start, start_addr, (*vm_node1)->access_flags, (*vm_node1)->mapping_type);
-		new_vm_area->vm_next = (*vm_node1);
-
-		(*vm_node2)->vm_next = new_vm_area;
-		(*vm_node1)->vm_start = end_addr;
+	// grow a neighbour with the same protection rather than add an area
+	struct vm_area* vm_node1 = vm_node2->vm_next;
+	int join_prev = vm_node2!=head && vm_node2->mapping_type!=HUGE_PAGE_MAPPING && vm_node2->vm_end==addr && vm_node2->access_flags==prot;
+	int join_next = vm_node1 && vm_node1->mapping_type!=HUGE_PAGE_MAPPING && vm_node1->vm_start==addr+len && vm_node1->access_flags==prot;
+
+	if(join_prev && join_next){
+		vm_node2->vm_end = vm_node1->vm_end;
+		vma_unlink(head, vm_node2, vm_node1);
+	}else if(join_prev){
+		vma_adjust(head, vm_node2, vm_node2->vm_start, addr + len);
+	}else if(join_next){
+		vma_adjust(head, vm_node1, addr, vm_node1->vm_end);
 	}else{
-		return;
+		vma_link(head, vm_node2, create_vm_area(addr, addr + len, prot, NORMAL_PAGE_MAPPING));
 	}
 
-	for(u64 unmap_addr = start_unmap; unmap_addr<end_unmap; unmap_addr+=0x1000){
-			
-		int check_pmd = 0;
-		int check_pud = 0;
-		// get base addr of pgdir
-		u64 *vaddr_base_pgd = (u64 *)osmap(current->pgd);
-		u64 *entry_pgd;
-
-		// find the entry in page directory
-		entry_pgd = (u64*)(vaddr_base_pgd + ((unmap_addr & PGD_MASK) >> PGD_SHIFT));
-		if(*entry_pgd & 0x1) {
-			// PGD->PUD Present, access it
-			u64 pfn_pud = (*entry_pgd >> PTE_SHIFT) & 0xFFFFFFFF;
-			u64 vaddr_base_pud = (u64 *)osmap(pfn_pud);
-			u64 *entry_pud = (u64*)(vaddr_base_pud + ((unmap_addr & PUD_MASK) >> PUD_SHIFT));
-			if(*entry_pud & 0x1) {
-				// PUD->PMD Present, access it
-				u64 pfn_pmd = (*entry_pud >> PTE_SHIFT) & 0xFFFFFFFF;
-				u64 vaddr_base_pmd = (u64 *)osmap(pfn_pmd);
-
-				u64 *entry_pmd = vaddr_base_pmd + ((unmap_addr & PMD_MASK) >> PMD_SHIFT);
-				if(*entry_pmd & 0x1) {
-					// PMD->PTE Present, access it
-					u64 pfn_pte = (*entry_pmd >> PTE_SHIFT) & 0xFFFFFFFF;
-					u64 vaddr_base_pte = (u64 *)osmap(pfn_pte);
-
-					u64 *entry_pte = vaddr_base_pte + ((unmap_addr & PTE_MASK) >> PTE_SHIFT);
-					if(*entry_pte & 0x1){
-						u64 pfn_phys = (*entry_pte >> PTE_SHIFT) & 0xFFFFFFFF;
-						os_pfn_free(USER_REG, pfn_phys);
-
-						// invalidates tlb entry corresponding to Virtual Address addr 
-						asm volatile (
-							"invlpg (%0);" 
-							:: "r"(unmap_addr) 
-							: "memory"
-						);
-
-						*entry_pte = *entry_pte^0x1;
-					}
-					entry_pte = vaddr_base_pte;
-					while(entry_pte<vaddr_base_pte + 0x1000 && !*entry_pte&0x1){
-						entry_pte += 0x40;
-					}
-					if(entry_pte==vaddr_base_pte + 0x1000){
-						os_pfn_free(OS_PT_REG, pfn_pte);
-						*entry_pmd = *entry_pmd^0x1;
-						check_pmd=1;
-					}
-
-				}
-				if(check_pmd){
-					entry_pmd = vaddr_base_pmd;
-					while(entry_pmd<vaddr_base_pmd + 0x1000 && !*entry_pmd&0x1){
-						entry_pmd += 0x40;
-					}
-					if(entry_pmd==vaddr_base_pmd + 0x1000){
-						os_pfn_free(OS_PT_REG, pfn_pmd);
-						*entry_pud = *entry_pud^0x1;
-						check_pud=1;
-					}
-				}
-			}
-			if(check_pud){
-				entry_pud = vaddr_base_pud;
-				while((u64)entry_pud < vaddr_base_pud + 0x1000 && !*entry_pud&0x1){
-					entry_pud += 0x40;
-				}
-				if((u64)entry_pud == vaddr_base_pud + 0x1000){
-					os_pfn_free(OS_PT_REG, pfn_pud);
-					*entry_pgd = *entry_pgd^0x1;
-				}
-			}
-		}
+	if((flags & MAP_POPULATE) && normal_map_range(current, addr, addr + len, 0x5 | (prot & PROT_WRITE)) < 0){
+		vm_area_unmap(current, addr, len);
+		return -1;
 	}
+	return addr;
 }
 
-void unmap_hpg_vm_area(struct exec_context* current, u64 start_addr, u64 end_addr, struct vm_area** vm_node1, struct vm_area** vm_node2){
-	
-	start_addr = start_addr - start_addr%0x200000;
-	
-	if(end_addr%0x200000){
-		end_addr = end_addr - end_addr%0x200000 + 0x200000;
-	}
-	
+/*
+Take [start_addr, end_addr) out of vm_node and unmap its pages. Returns the
+area the walk over the areas goes on from.
+*/
+struct vm_area* unmap_vm_area(struct exec_context* current, u64 start_addr, u64 end_addr, struct vm_area* vm_node){
+	struct vm_area* head = current->vm_area;
+	struct pt_walk walk = {
+		.pte = pte_unmap,
+		.pmd = pmd_unmap,
+		.flags = PT_FREE,
+	};
 	u64 start_unmap;
 	u64 end_unmap;
-	// printk("\nVM NODE VM_START : %x , VM_END : %x\n", vm_node1->vm_start, vm_node1->vm_end);
-	if(start_addr <= (*vm_node1)->vm_start && end_addr >= (*vm_node1)->vm_end){
-		start_unmap = (*vm_node1)->vm_start;
-		end_unmap = (*vm_node1)->vm_end;
+	// printk("\nVM NODE VM_START : %x , VM_END : %x\n", vm_node->vm_start, vm_node->vm_end);
+	if(start_addr <= vm_node->vm_start && end_addr >= vm_node->vm_end){
+		start_unmap = vm_node->vm_start;
+		end_unmap = vm_node->vm_end;
 		// printk("1.Start Unmap : %x\nEnd Unmap : %x\n", start_unmap, end_unmap);
 
-		(*vm_node2)->vm_next = (*vm_node1)->vm_next;
-		(*vm_node1)->vm_next = NULL;
-		dealloc_vm_area(*vm_node1);
-		*vm_node1 = *vm_node2;
-	}else if(start_addr >= (*vm_node1)->vm_start && start_addr < (*vm_node1)->vm_end && end_addr >= (*vm_node1)->vm_end){
+		struct vm_area* vm_prev = vma_prev(head, vm_node);
+		vma_unlink(head, vm_prev, vm_node);
+		vm_node = vm_prev;
+	}else if(start_addr >= vm_node->vm_start && start_addr < vm_node->vm_end && end_addr >= vm_node->vm_end){
 		start_unmap = start_addr;
-		end_unmap = (*vm_node1)->vm_end;
+		end_unmap = vm_node->vm_end;
 		// printk("2.Start Unmap : %x\nEnd Unmap : %x\n", start_unmap, end_unmap);
 	
-		(*vm_node1)->vm_end = start_addr;
-	}else if(start_addr <= (*vm_node1)->vm_start && end_addr <= (*vm_node1)->vm_end && end_addr > (*vm_node1)->vm_start){
-		start_unmap = (*vm_node1)->vm_start;
+		vma_adjust(head, vm_node, vm_node->vm_start, start_addr);
+	}else if(start_addr <= vm_node->vm_start && end_addr <= vm_node->vm_end && end_addr > vm_node->vm_start){
+		start_unmap = vm_node->vm_start;
 		end_unmap = end_addr;
 		// printk("3.Start Unmap : %x\nEnd Unmap : %x\n", start_unmap, end_unmap);
 			
-		(*vm_node1)->vm_start = end_addr;
-	}else if(start_addr > (*vm_node1)->vm_start && end_addr < (*vm_node1)->vm_end){
+		vma_adjust(head, vm_node, end_addr, vm_node->vm_end);
+	}else if(start_addr > vm_node->vm_start && end_addr < vm_node->vm_end){
 		start_unmap = start_addr;
 		end_unmap = end_addr;
 		// printk("4.Start Unmap : %x\nEnd Unmap : %x\n", start_unmap, end_unmap);
 			
-		struct vm_area* new_vm_area = create_vm_area((*vm_node1)->vm_start, start_addr, (*vm_node1)->access_flags, (*vm_node1)->mapping_type);
-		new_vm_area->vm_next = *vm_node1;
-
-		(*vm_node2)->vm_next = new_vm_area;
-		(*vm_node1)->vm_start = end_addr;
+		vma_split(head, vm_node, start_addr);
+		vma_adjust(head, vm_node, end_addr, vm_node->vm_end);
 	}else{
-		return;
+		return vm_node;
 	}
 
-	for(u64 unmap_addr = start_unmap; unmap_addr<end_unmap; unmap_addr+=0x200000){
-		
-		// invalidates tlb entry corresponding to Virtual Address addr 
-		asm volatile (
-			"invlpg (%0);" 
-			:: "r"(unmap_addr) 
-			: "memory"
-		);	
-		
-		int check_pud = 0;
-		// get base addr of pgdir
-		u64 *vaddr_base_pgd = (u64 *)osmap(current->pgd);
-		u64 *entry_pgd;
-
-		// find the entry in page directory
-		entry_pgd = (u64*)(vaddr_base_pgd + ((unmap_addr & PGD_MASK) >> PGD_SHIFT));
-		if(*entry_pgd & 0x1) {
-			// PGD->PUD Present, access it
-			u64 pfn_pud = (*entry_pgd >> PTE_SHIFT) & 0xFFFFFFFF;
-			u64 vaddr_base_pud = (u64 *)osmap(pfn_pud);
-			u64 *entry_pud = (u64*)(vaddr_base_pud + ((unmap_addr & PUD_MASK) >> PUD_SHIFT));
-			if(*entry_pud & 0x1) {
-				// PUD->PMD Present, access it
-				u64 pfn_pmd = (*entry_pud >> PTE_SHIFT) & 0xFFFFFFFF;
-				u64 vaddr_base_pmd = (u64 *)osmap(pfn_pmd);
-
-				u64 *entry_pmd = vaddr_base_pmd + ((unmap_addr & PMD_MASK) >> PMD_SHIFT);
-				if(*entry_pmd & 0x1) {
-					u64 pfn_hpg = (*entry_pmd >>  PTE_SHIFT) & 0xFFFFFFFF;
-					os_hugepage_free(pfn_hpg*HUGE_PAGE_SIZE);
-
-					*entry_pmd = *entry_pmd^1;
-				}
-				entry_pmd = vaddr_base_pmd;
-				while(entry_pmd<vaddr_base_pmd + 0x1000 && !((*entry_pmd)&0x1)){
-					entry_pmd += 0x40;
-				}
-				if(entry_pmd==vaddr_base_pmd + 0x1000){
-					os_pfn_free(OS_PT_REG, pfn_pmd);
-					*entry_pud = *entry_pud^0x1;
-					check_pud=1;
-				}
-			}
-			if(check_pud){
-				entry_pud = vaddr_base_pud;
-				while((u64)entry_pud < vaddr_base_pud + 0x1000 && !((*entry_pud)&0x1)){
-					entry_pud += 0x40;
-				}
-				if((u64)entry_pud == vaddr_base_pud + 0x1000){
-					os_pfn_free(OS_PT_REG, pfn_pud);
-					*entry_pgd = *entry_pgd^0x1;
-				}
-			}
-		}
-	}
+	pt_walk(current, &walk, start_unmap, end_unmap);
+	return vm_node;
+}
+
+/*
+Split the transparent hugepage of a normal area that addr falls inside of, so
+that an unmap starting or ending at addr only has to free 4KB pages. Done up
+front, since running out of memory here must leave the areas as they are.
+*/
+static int thp_split_partial(struct exec_context *current, u64 addr){
+	struct pt_walk walk = {
+		.pmd = pmd_split,
+	};
+	u64 start = addr & ~(u64)(HUGE_PAGE_SIZE - 1);
+	struct vm_area *vm_node;
+
+	if(addr == start)
+		return 0;
+	vm_node = vma_floor(current->vm_area, addr);
+	if(vm_node==NULL || vm_node->vm_end <= addr || vm_node->mapping_type!=NORMAL_PAGE_MAPPING)
+		return 0;
+	return pt_walk(current, &walk, start, start + HUGE_PAGE_SIZE);
 }
 
 /**
@@ -546,8 +797,7 @@ void unmap_hpg_vm_area(struct exec_context* current, u64 start_addr, u64 end_add
  */
 int vm_area_unmap(struct exec_context *current, u64 addr, int length)
 {
-	struct vm_area* vm_node1 = current->vm_area;
-	struct vm_area* vm_node2 = NULL;
+	struct vm_area* head = current->vm_area;
 	
 	u64 start_addr = addr - addr%0x1000;
 	u64 end_addr = addr + length;
@@ -556,19 +806,26 @@ int vm_area_unmap(struct exec_context *current, u64 addr, int length)
 		end_addr = end_addr - end_addr%0x1000 + 0x1000;
 	}
 
-	u64 start_unmap;
-	u64 end_unmap;
-	
+	if(head==NULL)
+		return 0;
+	if(thp_split_partial(current, start_addr) < 0 || thp_split_partial(current, end_addr) < 0)
+		return -ENOMEMORY;
+
 	// printk("\nUNMAP CALLED!~~~~~~~~~~~~~~~~\nStart Addr : %x\nEnd Addr : %x\n", start_addr, end_addr);
-	while(vm_node1){
+	// from the area holding start_addr on, the dummy head is never unmapped
+	struct vm_area* vm_node = vma_floor(head, start_addr);
+	if(vm_node==NULL || vm_node==head)
+		vm_node = head->vm_next;
+
+	while(vm_node && vm_node->vm_start < end_addr){
 		
-		if(vm_node1->mapping_type==NORMAL_PAGE_MAPPING)
-			unmap_normal_vm_area(current, start_addr, end_addr, &vm_node1, &vm_node2);
+		// a hugepage goes as a whole
+		if(vm_node->mapping_type==HUGE_PAGE_MAPPING)
+			vm_node = unmap_vm_area(current, start_addr & ~(u64)0x1FFFFF, (end_addr + 0x1FFFFF) & ~(u64)0x1FFFFF, vm_node);
 		else
-			unmap_hpg_vm_area(current, start_addr, end_addr, &vm_node1, &vm_node2);
+			vm_node = unmap_vm_area(current, start_addr, end_addr, vm_node);
 
-		vm_node2 = vm_node1;
-		vm_node1 = vm_node1->vm_next;
+		vm_node = vm_node->vm_next;
 	}
 	return 0;
 }
@@ -576,39 +833,14 @@ int vm_area_unmap(struct exec_context *current, u64 addr, int length)
 /**
  *Helper function to split normal vm area at huge page boundaries
  */
-void split_vma_at_boundaries(struct vm_area *vm_area, u64 hpg_start, u64 hpg_end){
-	struct vm_area* vm_node1 = vm_area;
-	struct vm_area* vm_node2 = NULL;
-	while(vm_node1){
-		if(vm_node1->vm_start < hpg_start && vm_node1->vm_end > hpg_end){
-			struct vm_area* new_vm_area1 = create_vm_area(vm_node1->vm_start, hpg_start, vm_node1->access_flags, NORMAL_PAGE_MAPPING);
-			struct vm_area* new_vm_area2 = create_vm_area(hpg_start, hpg_end, vm_node1->access_flags, NORMAL_PAGE_MAPPING);
-			
-			vm_node1->vm_start = hpg_end;
-
-			vm_node2->vm_next = new_vm_area1;
-			new_vm_area1->vm_next = new_vm_area2;
-			new_vm_area2->vm_next = vm_node1;
-		}else if(vm_node1->vm_start < hpg_start && vm_node1->vm_end > hpg_start){
-			struct vm_area* new_vm_area = create_vm_area(vm_node1->vm_start, hpg_start, vm_node1->access_flags, NORMAL_PAGE_MAPPING);
-			
-			vm_node1->vm_start = hpg_start;
-
-			vm_node2->vm_next = new_vm_area;
-			new_vm_area->vm_next = vm_node1;
-		}else if(vm_node1->vm_end < hpg_end && vm_node1->vm_end > hpg_end){
-			struct vm_area* new_vm_area = create_vm_area(vm_node1->vm_start, hpg_end, vm_node1->access_flags, NORMAL_PAGE_MAPPING);
-			
-			vm_node1->vm_start = hpg_end;
-			
-			vm_node2->vm_next = new_vm_area;
-			new_vm_area->vm_next = vm_node1;
-		}else if(vm_node1->vm_start >= hpg_end){
-			break;
-		}
-		vm_node2 = vm_node1;
-		vm_node1 = vm_node1->vm_next;
-	}
+void split_vma_at_boundaries(struct vm_area *head, u64 hpg_start, u64 hpg_end){
+	struct vm_area* vm_node = vma_floor(head, hpg_start);
+	if(vm_node && vm_node->vm_start < hpg_start && vm_node->vm_end > hpg_start)
+		vma_split(head, vm_node, hpg_start);
+
+	vm_node = vma_floor(head, hpg_end);
+	if(vm_node && vm_node->vm_start < hpg_end && vm_node->vm_end > hpg_end)
+		vma_split(head, vm_node, hpg_end);
 }
 
 
@@ -616,116 +848,25 @@ void split_vma_at_boundaries(struct vm_area *vm_area, u64 hpg_start, u64 hpg_end
 Insert the created hugepage vm area and delete the normal vm areas
 */
 
-void insert_hugepage_vma(struct vm_area* vm_area, struct vm_area* new_huge_page, u64 hpg_start, u64 hpg_end){
-
-	struct vm_area* vm_node1 = vm_area;
-	struct vm_area* vm_node2 = NULL;
-	while(vm_node1){
-		if(vm_node1->vm_start == hpg_start){
-			vm_node2->vm_next = new_huge_page;
-			new_huge_page->vm_next = vm_node1->vm_next;
-			vm_node1->vm_next = NULL;
-			dealloc_vm_area(vm_node1);
-			vm_node1 = new_huge_page;
-		}else if(vm_node1->vm_start > hpg_start && vm_node1->vm_end < hpg_end){
-			vm_node2->vm_next = vm_node1->vm_next;
-			vm_node1->vm_next = NULL;
-			dealloc_vm_area(vm_node1);
-			vm_node1 = vm_node2;
-		}else if(vm_node1->vm_end == hpg_end){
-			vm_node2->vm_next = vm_node1->vm_next;
-			vm_node1->vm_next = NULL;
-			dealloc_vm_area(vm_node1);
-			break;
-		}
-		vm_node2 = vm_node1;
-		vm_node1 = vm_node1->vm_next;
-	}
-}
+void insert_hugepage_vma(struct vm_area* head, struct vm_area* new_huge_page, u64 hpg_start, u64 hpg_end){
 
-/*
-Copy data from given normal page to hugepage
-*/
-void copy_to_hugepage(struct exec_context* current, u64* pfn_hugepg, u64* entry_pmd, u64 vaddr_base_phys, u64 addr){
-	if(*entry_pmd & 0x80){
-		u64 vaddr_base_hugepg = (u64*)((*pfn_hugepg) * HUGE_PAGE_SIZE);
-		u64 vaddr_base_page = vaddr_base_hugepg + (addr & 0x1FFFFF);
-		// printk("Created hpg PFN and Copying!\n");
-		memcpy(vaddr_base_page, vaddr_base_phys, 0x1000);
-	}else{
-		*pfn_hugepg = get_hugepage_pfn(os_hugepage_alloc());
-		*entry_pmd = (*entry_pmd)|0x80;
-		u64 vaddr_base_hugepg = (u64*)((*pfn_hugepg)*HUGE_PAGE_SIZE);
-		u64 vaddr_base_page = vaddr_base_hugepg + (addr & 0x1FFFFF);
-		// printk("Copying!\n");
-		memcpy(vaddr_base_page, vaddr_base_phys, 0x1000);
-	}
+	struct vm_area* vm_prev = vma_floor(head, hpg_start - 1);
+	while(vm_prev->vm_next && vm_prev->vm_next->vm_start < hpg_end)
+		vma_unlink(head, vm_prev, vm_prev->vm_next);
+	vma_link(head, vm_prev, new_huge_page);
 }
 
-
 /*
-Frees normal pages and copies the data from given 
-address to the hugepage physical memory
+Move the data of the 4KB pages in [hpg_start, hpg_end) to hugepages and
+free them
 */
+int free_and_copy_to_hugepage(struct exec_context* current, u64 hpg_start, u64 hpg_end, u32 prot){
+	struct pt_walk walk = {
+		.pmd = pmd_collapse,
+		.ac_flags = 0x5 | (prot & PROT_WRITE),
+	};
 
-void free_and_copy_to_hugepage(struct exec_context* current, u64 hpg_start, u64 hpg_end, u32 prot){
-	
-	u64	pfn_hugepg;
-	u64 unmap_addr = hpg_start;
-	for(u64 addr = hpg_start; addr<hpg_end; addr+=0x1000){
-		// invalidates tlb entry corresponding to Virtual Address addr 
-		asm volatile (
-			"invlpg (%0);" 
-			:: "r"(addr) 
-			: "memory"
-		);
-	}
-
-	// get base addr of pgdir
-	u64 *vaddr_base_pgd = (u64 *)osmap(current->pgd);
-	u64 *entry_pgd;
-	// find the entry in page directory
-	entry_pgd = (u64*)(vaddr_base_pgd + ((unmap_addr & PGD_MASK) >> PGD_SHIFT));
-	if(*entry_pgd & 0x1) {
-		*entry_pgd = (*entry_pgd)|(0x2 & prot);
-
-		// PGD->PUD Present, access it
-		u64 pfn_pud = (*entry_pgd >> PTE_SHIFT) & 0xFFFFFFFF;
-		u64 vaddr_base_pud = (u64 *)osmap(pfn_pud);
-		u64 *entry_pud = (u64*)(vaddr_base_pud + ((unmap_addr & PUD_MASK) >> PUD_SHIFT));
-		if(*entry_pud & 0x1) {
-			*entry_pud = (*entry_pud)|(0x2 & prot);
-
-			// PUD->PMD Present, access it
-			u64 pfn_pmd = (*entry_pud >> PTE_SHIFT) & 0xFFFFFFFF;
-			u64 vaddr_base_pmd = (u64 *)osmap(pfn_pmd);
-
-			u64 *entry_pmd = vaddr_base_pmd + ((unmap_addr & PMD_MASK) >> PMD_SHIFT);
-			if(*entry_pmd & 0x1) {
-				*entry_pmd = (*entry_pmd)|(0x2 & prot);
-
-				// PMD->PTE Present, access it
-				u64 pfn_pte = (*entry_pmd >> PTE_SHIFT) & 0xFFFFFFFF;
-				u64 vaddr_base_pte = (u64 *)osmap(pfn_pte);
-
-				for(unmap_addr = hpg_start; unmap_addr<hpg_end; unmap_addr+=0x1000){
-					
-					u64 *entry_pte = vaddr_base_pte + ((unmap_addr & PTE_MASK) >> PTE_SHIFT);
-					if(*entry_pte & 0x1){
-						u64 pfn_phys = (*entry_pte >> PTE_SHIFT) & 0xFFFFFFFF;
-						u64 vaddr_base_data = (u64 *)osmap(pfn_phys);
-
-						copy_to_hugepage(current, &pfn_hugepg, entry_pmd,vaddr_base_data, unmap_addr);
-								
-						os_pfn_free(USER_REG, pfn_phys);
-					}
-				}
-				os_pfn_free(OS_PT_REG, pfn_pte);
-				*entry_pmd = (*entry_pmd & 0xFFFFF00000000FFF)|(( pfn_hugepg & 0xFFFFFFFF)<<12);
-			}
-		}
-	}
-
+	return pt_walk(current, &walk, hpg_start, hpg_end);
 }
 
 /**
@@ -746,151 +887,73 @@ long vm_area_make_hugepage(struct exec_context *current, void *addr, u32 length,
 	if(hpg_start >= hpg_end)
 		return -EINVAL;
 
-	struct vm_area* vm_node = current->vm_area;
+	struct vm_area* head = current->vm_area;
+	if(head==NULL)
+		return -ENOMAPPING;
+
+	// every page of the range must be in a normal area
+	struct vm_area* vm_node = vma_floor(head, hpg_start);
 	u64 addr_ptr = hpg_start;
 	
-	while(vm_node){
+	while(addr_ptr < hpg_end){
 		// printk("ADDR PTR : %x\n", addr_ptr);
-		if(addr_ptr >= hpg_end)
-			break;
-		
-		if(vm_node->vm_start <= addr_ptr && vm_node->vm_end <= hpg_end && vm_node->vm_end > addr_ptr){
-			if(vm_node->mapping_type == HUGE_PAGE_MAPPING){
-				// printk("VMA OCCUPIED\n");
-				return -EVMAOCCUPIED;
-			}
-			// printk("PROT = %x ACCESS_FLAGS = %x\n", prot, vm_node->access_flags);
-			if(!force_prot && vm_node->access_flags!=prot){
-				// printk("DIFFPROT\n");
-				return -EDIFFPROT;
-			}
-				
-			
-			addr_ptr = vm_node->vm_end;
-
-		}else if(vm_node->vm_start > addr_ptr){
+		if(vm_node==NULL || vm_node==head || vm_node->vm_start > addr_ptr || vm_node->vm_end <= addr_ptr){
 			// printk("NO MAPPING\n");
 			return -ENOMAPPING;
 		}
+		if(vm_node->mapping_type == HUGE_PAGE_MAPPING){
+			// printk("VMA OCCUPIED\n");
+			return -EVMAOCCUPIED;
+		}
+		// printk("PROT = %x ACCESS_FLAGS = %x\n", prot, vm_node->access_flags);
+		if(!force_prot && vm_node->access_flags!=prot){
+			// printk("DIFFPROT\n");
+			return -EDIFFPROT;
+		}
 		
+		addr_ptr = vm_node->vm_end;
 		vm_node = vm_node->vm_next;
 	}
 
 	// printk("CREATING HUGE PAGE AFTER ERROR CHECK!\n");
-	split_vma_at_boundaries(current->vm_area, hpg_start, hpg_end);
+	split_vma_at_boundaries(head, hpg_start, hpg_end);
 	// pmap(1);
 	// printk("SPLIT DONE!\n");
 	struct vm_area* new_huge_page = create_vm_area(hpg_start, hpg_end, prot, HUGE_PAGE_MAPPING);
 	
-	insert_hugepage_vma(current->vm_area, new_huge_page, hpg_start, hpg_end);
+	insert_hugepage_vma(head, new_huge_page, hpg_start, hpg_end);
 
-	free_and_copy_to_hugepage(current, hpg_start, hpg_end, prot);
+	vma_merge(head, new_huge_page);
 
-	vm_node = current->vm_area->vm_next;
-	struct vm_area* vm_node_prev = current->vm_area;
+	if(free_and_copy_to_hugepage(current, hpg_start, hpg_end, prot) < 0)
+		return -ENOMEMORY;
 
-	while(vm_node){
-		if(vm_node_prev->vm_end == vm_node->vm_start && vm_node_prev->mapping_type == vm_node->mapping_type && vm_node_prev->access_flags == vm_node->access_flags){
-			vm_node_prev->vm_end = vm_node->vm_end;
-			vm_node_prev->vm_next = vm_node->vm_next;
-			vm_node->vm_next = NULL;
-			dealloc_vm_area(vm_node);
-			vm_node = vm_node_prev;
-		}
-		vm_node_prev = vm_node;
-		vm_node = vm_node->vm_next;
-	}
-
-	
 	return hpg_start;
 }
 
 
-void split_hugepages_at_boundary(struct vm_area* vm_area, u64 start_addr, u64 end_addr){
-	struct vm_area* vm_node1 = vm_area;
-	struct vm_area* vm_node2 = NULL;
-	while(vm_node1){
-		if(vm_node1->mapping_type==HUGE_PAGE_MAPPING){
-			if(vm_node1->vm_start < start_addr && vm_node1->vm_end > end_addr){
-				struct vm_area* new_vm_area1 = create_vm_area(vm_node1->vm_start, start_addr, vm_node1->access_flags, HUGE_PAGE_MAPPING);
-				struct vm_area* new_vm_area2 = create_vm_area(start_addr, end_addr, vm_node1->access_flags, HUGE_PAGE_MAPPING);
-				
-				vm_node1->vm_start = end_addr;
-
-				vm_node2->vm_next = new_vm_area1;
-				new_vm_area1->vm_next = new_vm_area2;
-				new_vm_area2->vm_next = vm_node1;
-			}else if(vm_node1->vm_start > start_addr && vm_node1->vm_end >= end_addr){
-				struct vm_area* new_vm_area = create_vm_area(vm_node1->vm_start, start_addr, vm_node1->access_flags, HUGE_PAGE_MAPPING);
-				
-				vm_node1->vm_start = start_addr;
-
-				vm_node2->vm_next = new_vm_area;
-				new_vm_area->vm_next = vm_node1;
-			}else if(vm_node1->vm_start >= start_addr && vm_node1->vm_end > end_addr){
-				struct vm_area* new_vm_area = create_vm_area(vm_node1->vm_start, end_addr, vm_node1->access_flags, HUGE_PAGE_MAPPING);
-				
-				vm_node1->vm_start = end_addr;
-				
-				vm_node2->vm_next = new_vm_area;
-				new_vm_area->vm_next = vm_node1;
-			}else if(vm_node1->vm_start >= end_addr){
-				break;
-			}
-		}
-		vm_node2 = vm_node1;
-		vm_node1 = vm_node1->vm_next;
-	}
-}
+void split_hugepages_at_boundary(struct vm_area* head, u64 start_addr, u64 end_addr){
+	struct vm_area* vm_node = vma_floor(head, start_addr);
+	if(vm_node && vm_node->mapping_type==HUGE_PAGE_MAPPING && vm_node->vm_start < start_addr && vm_node->vm_end > start_addr)
+		vma_split(head, vm_node, start_addr);
 
-void copy_and_free_hugepg(struct exec_context* current, struct vm_area* vm_node){
-	vm_node->mapping_type = NORMAL_PAGE_MAPPING;
+	vm_node = vma_floor(head, end_addr);
+	if(vm_node && vm_node->mapping_type==HUGE_PAGE_MAPPING && vm_node->vm_start < end_addr && vm_node->vm_end > end_addr)
+		vma_split(head, vm_node, end_addr);
+}
 
-	for(u64 hpg_addr = vm_node->vm_start; hpg_addr<vm_node->vm_end; hpg_addr+=0x200000){
-
-		u64 pfn_pte =  os_pfn_alloc(OS_PT_REG);
-		u64 vaddr_base_pte = (u64*)osmap(pfn_pte);
-
-		// get base addr of pgdir
-		u64 *vaddr_base_pgd = (u64 *)osmap(current->pgd);
-		u64 *entry_pgd;
-		// find the entry in page directory
-		entry_pgd = (u64*)(vaddr_base_pgd + ((hpg_addr & PGD_MASK) >> PGD_SHIFT));
-		if(*entry_pgd & 0x1) {
-			// PGD->PUD Present, access it
-			u64 pfn_pud = (*entry_pgd >> PTE_SHIFT) & 0xFFFFFFFF;
-			u64 vaddr_base_pud = (u64 *)osmap(pfn_pud);
-			u64 *entry_pud = (u64*)(vaddr_base_pud + ((hpg_addr & PUD_MASK) >> PUD_SHIFT));
-			if(*entry_pud & 0x1) {
-				// PUD->PMD Present, access it
-				u64 pfn_pmd = (*entry_pud >> PTE_SHIFT) & 0xFFFFFFFF;
-				u64 vaddr_base_pmd = (u64 *)osmap(pfn_pmd);
-
-				u64 *entry_pmd = vaddr_base_pmd + ((hpg_addr & PMD_MASK) >> PMD_SHIFT);
-				if(*entry_pmd & 0x1) {
-					u64 pfn_hugepg = (*entry_pmd >> PTE_SHIFT) & 0xFFFFFFFF;
-					u64 vaddr_base_hugepg = pfn_hugepg*HUGE_PAGE_SIZE;
-
-					for(u64 normalpg_addr = hpg_addr; normalpg_addr < hpg_addr + 0x200000; normalpg_addr+=0x1000){
-						u64* hpg_entry = vaddr_base_hugepg + (normalpg_addr & 0x1FFFFF);
-						
-						u64* entry_pte = vaddr_base_pte + (normalpg_addr & PTE_MASK) >> PTE_SHIFT;
-						
-						u64 pfn_normalpg = os_pfn_alloc(USER_REG);
-						u64 vaddr_base_normalpg = (u64*)osmap(pfn_normalpg);
-						
-						*entry_pte = (pfn_normalpg << PTE_SHIFT)|(0x5 | (0x2 &(*entry_pmd)));
-						memcpy(vaddr_base_normalpg, hpg_entry, 0x1000);
-
-					}
-					os_hugepage_free(vaddr_base_hugepg);
-					*entry_pmd = (pfn_pte << PTE_SHIFT) | (0x5 | (0x2 &(*entry_pmd)));
-
-				}
-			}
-		}
-	}
+/*
+Turn a hugepage area into a normal one. If memory runs out the hugepages not
+split yet stay, as transparent hugepages of the now normal area, and -1 is
+returned.
+*/
+int copy_and_free_hugepg(struct exec_context* current, struct vm_area* vm_node){
+	struct pt_walk walk = {
+		.pmd = pmd_split,
+	};
 
+	vm_node->mapping_type = NORMAL_PAGE_MAPPING;
+	return pt_walk(current, &walk, vm_node->vm_start, vm_node->vm_end);
 }
 
 /**
@@ -903,32 +966,26 @@ int vm_area_break_hugepage(struct exec_context *current, void *addr, u32 length)
 	if(start_addr%0x200000 || end_addr%0x200000)
 		return -EINVAL;
 	
-	split_hugepages_at_boundary(current->vm_area, start_addr, end_addr);
+	struct vm_area* head = current->vm_area;
+	if(head==NULL)
+		return 0;
+
+	split_hugepages_at_boundary(head, start_addr, end_addr);
 	// printk("Details after split\n");
 	// pmap(1);
 	// printk("-----------------\n");
 
-	struct vm_area* vm_node = current->vm_area;
-
-	while(vm_node){
-		if(vm_node->mapping_type==HUGE_PAGE_MAPPING && vm_node->vm_start <= start_addr && vm_node->vm_end <= end_addr){
-			copy_and_free_hugepg(current, vm_node);
-		}
-		vm_node = vm_node->vm_next;
-	}
-
-	vm_node = current->vm_area->vm_next;
-	struct vm_area* vm_node_prev = current->vm_area;
-
-	while(vm_node){
-		if(vm_node_prev->vm_end == vm_node->vm_start && vm_node_prev->mapping_type == vm_node->mapping_type && vm_node_prev->access_flags == vm_node->access_flags){
-			vm_node_prev->vm_end = vm_node->vm_end;
-			vm_node_prev->vm_next = vm_node->vm_next;
-			vm_node->vm_next = NULL;
-			dealloc_vm_area(vm_node);
-			vm_node = vm_node_prev;
+	struct vm_area* vm_node = vma_floor(head, start_addr);
+	if(vm_node==NULL)
+		vm_node = head;
+
+	while(vm_node && vm_node->vm_start < end_addr){
+		if(vm_node->mapping_type==HUGE_PAGE_MAPPING && vm_node->vm_start >= start_addr && vm_node->vm_end <= end_addr){
+			int ret = copy_and_free_hugepg(current, vm_node);
+			vm_node = vma_merge(head, vm_node);
+			if(ret < 0)
+				return -ENOMEMORY;
 		}
-		vm_node_prev = vm_node;
 		vm_node = vm_node->vm_next;
 	}
 